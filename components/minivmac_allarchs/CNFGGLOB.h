@@ -97,3 +97,33 @@ typedef si5b si5r;
 #define EmLocalTalk 0
 #define AutoLocation 1
 #define AutoTimeZone 1
+
+/* platform specific tracing of the parts of a tick, see MYOSGLUE.h */
+
+#ifdef CONFIG_MINIVMAC_TRACE
+#define WantTickTraceDump 1
+#else
+#define WantTickTraceDump 0
+#endif
+
+#ifdef CONFIG_MINIVMAC_PERF
+#define WantPerfHUD 1
+#else
+#define WantPerfHUD 0
+#endif
+
+#ifdef CONFIG_MINIVMAC_LATENCY
+#define WantLatencyProbe 1
+#else
+#define WantLatencyProbe 0
+#endif
+
+#define WantTickTrace (WantTickTraceDump || WantPerfHUD || WantLatencyProbe)
+
+/* only compare the rows of the screen written to, see MYOSGLUE.h */
+
+#ifdef CONFIG_MINIVMAC_SCREEN_DIRTY_ROWS
+#define WantScreenDirtyRows 1
+#else
+#define WantScreenDirtyRows 0
+#endif
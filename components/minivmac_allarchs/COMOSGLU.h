@@ -283,6 +283,35 @@ LOCALPROC DiskEjectedNotify(tDrive Drive_No)
 #define ln2uiblockbitsn (3 + ln2uiblockn)
 #define uiblockbitsn (8 * uiblockn)
 
+/*
+	OSGLUxxx may define FindFirstChangeInBlocks(p1, p2, L) and
+	FindLastChangeInBlocks(p1, p2, L), returning the index of
+	the first or last uibb that differs, or L if none does,
+	to use something faster than the loops below.
+*/
+
+#ifdef FindFirstChangeInBlocks
+
+LOCALFUNC blnr FindFirstChangeInLVecs(uibb *ptr1, uibb *ptr2,
+					uimr L, uimr *j)
+{
+	uimr i = FindFirstChangeInBlocks(ptr1, ptr2, L);
+
+	if (i == L) {
+		return falseblnr;
+	}
+	*j = i;
+	return trueblnr;
+}
+
+LOCALPROC FindLastChangeInLVecs(uibb *ptr1, uibb *ptr2,
+					uimr L, uimr *j)
+{
+	*j = FindLastChangeInBlocks(ptr1, ptr2, L);
+}
+
+#else
+
 LOCALFUNC blnr FindFirstChangeInLVecs(uibb *ptr1, uibb *ptr2,
 					uimr L, uimr *j)
 {
@@ -317,6 +346,8 @@ LOCALPROC FindLastChangeInLVecs(uibb *ptr1, uibb *ptr2,
 	*j = p1 - ptr1;
 }
 
+#endif
+
 LOCALPROC FindLeftRightChangeInLMat(uibb *ptr1, uibb *ptr2,
 	uimr width, uimr top, uimr bottom,
 	uimr *LeftMin0, uibr *LeftMask0,
@@ -371,6 +402,189 @@ LOCALVAR ui3p screencomparebuff = nullpr;
 
 LOCALVAR uimr NextDrawRow = 0;
 
+GLOBALVAR ui5r ScreenDiffByteCount = 0;
+
+#if WantScreenDirtyRows
+
+GLOBALVAR ui5b ScreenDirtyRows[kScreenDirtyRowWords];
+
+/* first and last plus one of the rows marked, if any */
+LOCALFUNC blnr ScreenDirtyRowsRange(uimr *top, uimr *bottom)
+{
+	int i;
+	int j;
+	ui5b v;
+
+	for (i = 0; i < kScreenDirtyRowWords; ++i) {
+		v = ScreenDirtyRows[i];
+		if (0 != v) {
+			for (j = 0; 0 == (v & (((ui5b)1) << j)); ++j) {
+			}
+			*top = i * 32 + j;
+
+			for (i = kScreenDirtyRowWords; 0 == ScreenDirtyRows[--i]; ) {
+			}
+			v = ScreenDirtyRows[i];
+			for (j = 31; 0 == (v & (((ui5b)1) << j)); --j) {
+			}
+			*bottom = i * 32 + j + 1;
+
+			return trueblnr;
+		}
+	}
+
+	return falseblnr;
+}
+
+LOCALPROC ScreenDirtyRowsClear(uimr top, uimr bottom)
+{
+	uimr r;
+
+	for (r = top; r < bottom; ++r) {
+		ScreenDirtyRows[r >> 5] &= ~ (((ui5b)1) << (r & 31));
+	}
+}
+
+#endif /* WantScreenDirtyRows */
+
+/*
+	OSGLUxxx may set WantScreenRowSigs to keep a 32 bit signature
+	of each row of screencomparebuff. Only the rows whose signature
+	changed are compared byte by byte and copied, so
+	screencomparebuff may be in slow memory while the signatures
+	are not. A change that leaves the signature of its row as it
+	was is missed until the row changes again. OSGLUxxx must then
+	define ScreenRowSig(p) to compute the signature of the row at
+	p, it must give 0 for a row of zeros.
+*/
+#ifndef WantScreenRowSigs
+#define WantScreenRowSigs 0
+#endif
+
+#if WantScreenRowSigs
+
+#if 0 != vMacScreenDepth
+#error "WantScreenRowSigs only for the monochrome screen"
+#endif
+
+#ifndef ScreenRowSig
+#error "WantScreenRowSigs needs ScreenRowSig"
+#endif
+
+/* screencomparebuff starts out cleared */
+LOCALVAR ui5r ScreenRowSigs[vMacScreenHeight];
+LOCALVAR ui5r ScreenRowNewSigs[vMacScreenHeight];
+
+/*
+	Like FindFirstChangeInLVecs and the rest for rows top to
+	bottom, but only the rows whose signature changed are read
+	from screencomparebuff. Rows compared the same get their new
+	signature right away.
+*/
+LOCALFUNC blnr ScreenRowSigsFind(ui3p screencurrentbuff,
+	uimr top, uimr bottom, uimr MaxRows,
+	uimr *j0v, uimr *j1v, uimr *j0h, uimr *j1h, uimr *LimitDrawRow)
+{
+	uimr y;
+	uimr x0;
+	uimr x1;
+	uimr limit = bottom;
+	ui3r d;
+	blnr found = falseblnr;
+
+	for (y = top; y < bottom; ++y) {
+		ScreenRowNewSigs[y] = ScreenRowSig(screencurrentbuff
+			+ y * vMacScreenMonoByteWidth);
+	}
+
+	for (y = top; y < limit; ++y) {
+		ui3p p = screencurrentbuff + y * vMacScreenMonoByteWidth;
+		ui3p q = screencomparebuff + y * vMacScreenMonoByteWidth;
+
+		if (ScreenRowNewSigs[y] == ScreenRowSigs[y]) {
+			continue;
+		}
+
+		ScreenDiffByteCount += vMacScreenMonoByteWidth;
+		for (x0 = 0; (x0 < vMacScreenMonoByteWidth) && (p[x0] == q[x0]);
+			++x0)
+		{
+		}
+		if (x0 == vMacScreenMonoByteWidth) {
+			ScreenRowSigs[y] = ScreenRowNewSigs[y];
+			continue;
+		}
+		for (x1 = vMacScreenMonoByteWidth - 1; p[x1] == q[x1]; --x1) {
+		}
+
+		if (! found) {
+			found = trueblnr;
+			*j0v = y;
+			*j0h = vMacScreenWidth;
+			*j1h = 0;
+			limit = y + MaxRows;
+			if (limit > bottom) {
+				limit = bottom;
+			}
+		}
+		*j1v = y + 1;
+
+		/* to the pixel, msb first */
+		d = p[x0] ^ q[x0];
+		x0 *= 8;
+		while (0 == (d & 0x80)) {
+			d <<= 1;
+			++x0;
+		}
+		if (x0 < *j0h) {
+			*j0h = x0;
+		}
+		d = p[x1] ^ q[x1];
+		x1 = x1 * 8 + 8;
+		while (0 == (d & 1)) {
+			d >>= 1;
+			--x1;
+		}
+		if (x1 > *j1h) {
+			*j1h = x1;
+		}
+	}
+
+	*LimitDrawRow = limit;
+
+	return found;
+}
+
+/* rows top to bottom of screencomparebuff are brought up to date */
+LOCALPROC ScreenRowSigsCopy(ui3p screencurrentbuff,
+	uimr top, uimr bottom)
+{
+	uimr y;
+
+	for (y = top; y < bottom; ++y) {
+		if (ScreenRowNewSigs[y] != ScreenRowSigs[y]) {
+			MyMoveBytes(
+				(anyp)screencurrentbuff + y * vMacScreenMonoByteWidth,
+				(anyp)screencomparebuff + y * vMacScreenMonoByteWidth,
+				vMacScreenMonoByteWidth);
+			ScreenRowSigs[y] = ScreenRowNewSigs[y];
+		}
+	}
+}
+
+/* after screencomparebuff was written to as a whole */
+LOCALPROC ScreenRowSigsSync(void)
+{
+	uimr y;
+
+	for (y = 0; y < vMacScreenHeight; ++y) {
+		ScreenRowSigs[y] = ScreenRowSig(screencomparebuff
+			+ y * vMacScreenMonoByteWidth);
+	}
+}
+
+#endif /* WantScreenRowSigs */
+
 
 #if BigEndianUnaligned
 
@@ -392,25 +606,130 @@ LOCALVAR uimr NextDrawRow = 0;
 LOCALVAR blnr ColorTransValid = falseblnr;
 #endif
 
+/*
+	OSGLUxxx may define these to measure
+	the time spent looking for screen changes.
+*/
+#ifndef ScreenDiffBeginNotify
+#define ScreenDiffBeginNotify()
+#endif
+#ifndef ScreenDiffEndNotify
+#define ScreenDiffEndNotify()
+#endif
+
+/*
+	OSGLUxxx may define this to be told of each changed
+	rectangle of the screen Screen_OutputFrame found.
+*/
+#ifndef ScreenOutputNotify
+#define ScreenOutputNotify(p, top, left, bottom, right)
+#endif
+
+/*
+	OSGLUxxx may set WantScreenChangeBands and define
+	ScreenBandChangedNotify(top, left, bottom, right) to be told
+	about each band of changed rows separately, instead of
+	only the bounding box of all changes.
+*/
+#ifndef WantScreenChangeBands
+#define WantScreenChangeBands 0
+#endif
+
+#if WantScreenChangeBands
+
+/* rows at most this far apart go into one band */
+#ifndef kScreenBandGap
+#define kScreenBandGap 4
+#endif
+
+LOCALPROC ScreenFindChangedBands(ui3p screencurrentbuff,
+	uimr top, uimr bottom, uimr rowbytes)
+{
+	uimr y;
+	uimr x;
+	uimr x0;
+	uimr x1;
+	uimr bandtop = 0;
+	uimr lastrow = 0;
+	uimr left = 0;
+	uimr right = 0;
+	blnr InBand = falseblnr;
+
+	for (y = top; y < bottom; ++y) {
+		ui3p p = screencurrentbuff + y * rowbytes;
+		ui3p q = screencomparebuff + y * rowbytes;
+
+#if WantScreenRowSigs
+		if (ScreenRowNewSigs[y] == ScreenRowSigs[y]) {
+			continue;
+		}
+#endif
+		for (x = 0; (x < rowbytes) && (p[x] == q[x]); ++x) {
+		}
+		if (x == rowbytes) {
+			continue;
+		}
+		x0 = x;
+		for (x = rowbytes - 1; p[x] == q[x]; --x) {
+		}
+		x1 = x + 1;
+
+		if (InBand && (y - lastrow > kScreenBandGap)) {
+			ScreenBandChangedNotify(bandtop,
+				left * vMacScreenWidth / rowbytes,
+				lastrow + 1,
+				right * vMacScreenWidth / rowbytes);
+			InBand = falseblnr;
+		}
+		if (! InBand) {
+			InBand = trueblnr;
+			bandtop = y;
+			left = x0;
+			right = x1;
+		} else {
+			if (x0 < left) {
+				left = x0;
+			}
+			if (x1 > right) {
+				right = x1;
+			}
+		}
+		lastrow = y;
+	}
+
+	if (InBand) {
+		ScreenBandChangedNotify(bandtop,
+			left * vMacScreenWidth / rowbytes,
+			lastrow + 1,
+			right * vMacScreenWidth / rowbytes);
+	}
+}
+
+#endif /* WantScreenChangeBands */
+
 LOCALFUNC blnr ScreenFindChanges(ui3p screencurrentbuff,
 	si3b TimeAdjust, si4b *top, si4b *left, si4b *bottom, si4b *right)
 {
-	uimr j0;
-	uimr j1;
 	uimr j0h;
 	uimr j1h;
 	uimr j0v;
 	uimr j1v;
 	uimr copysize;
-	uimr copyoffset;
 	uimr copyrows;
 	uimr LimitDrawRow;
 	uimr MaxRowsDrawnPerTick;
+	uimr DiffTop;
+	uimr DiffBottom;
+#if ! WantScreenRowSigs
+	uimr j0;
+	uimr j1;
+	uimr copyoffset;
 	uimr LeftMin;
 	uimr RightMax;
 	uibr LeftMask;
 	uibr RightMask;
 	int j;
+#endif
 
 	if (TimeAdjust < 4) {
 		MaxRowsDrawnPerTick = vMacScreenHeight;
@@ -420,6 +739,22 @@ LOCALFUNC blnr ScreenFindChanges(ui3p screencurrentbuff,
 		MaxRowsDrawnPerTick = vMacScreenHeight / 4;
 	}
 
+	/* rows to look at */
+#if WantScreenDirtyRows
+	if ((! ScreenDirtyRowsRange(&DiffTop, &DiffBottom))
+		|| (NextDrawRow >= DiffBottom))
+	{
+		NextDrawRow = 0;
+		return falseblnr;
+	}
+	if (DiffTop < NextDrawRow) {
+		DiffTop = NextDrawRow;
+	}
+#else
+	DiffTop = NextDrawRow;
+	DiffBottom = vMacScreenHeight;
+#endif
+
 #if 0 != vMacScreenDepth
 	if (UseColorMode) {
 		if (ColorMappingChanged) {
@@ -428,28 +763,39 @@ LOCALFUNC blnr ScreenFindChanges(ui3p screencurrentbuff,
 			j1h = vMacScreenWidth;
 			j0v = 0;
 			j1v = vMacScreenHeight;
+			DiffTop = 0;
+			LimitDrawRow = vMacScreenHeight;
 #if WantColorTransValid
 			ColorTransValid = falseblnr;
+#endif
+#if WantScreenChangeBands
+			ScreenBandChangedNotify(0, 0,
+				vMacScreenHeight, vMacScreenWidth);
 #endif
 		} else {
+			ScreenDiffByteCount += (DiffBottom - DiffTop)
+				* (vMacScreenBitWidth / 8);
 			if (! FindFirstChangeInLVecs(
 				(uibb *)screencurrentbuff
-					+ NextDrawRow * (vMacScreenBitWidth / uiblockbitsn),
+					+ DiffTop * (vMacScreenBitWidth / uiblockbitsn),
 				(uibb *)screencomparebuff
-					+ NextDrawRow * (vMacScreenBitWidth / uiblockbitsn),
-				((uimr)(vMacScreenHeight - NextDrawRow)
+					+ DiffTop * (vMacScreenBitWidth / uiblockbitsn),
+				((uimr)(DiffBottom - DiffTop)
 					* (uimr)vMacScreenBitWidth) / uiblockbitsn,
 				&j0))
 			{
+#if WantScreenDirtyRows
+				ScreenDirtyRowsClear(DiffTop, DiffBottom);
+#endif
 				NextDrawRow = 0;
 				return falseblnr;
 			}
 			j0v = j0 / (vMacScreenBitWidth / uiblockbitsn);
 			j0h = j0 - j0v * (vMacScreenBitWidth / uiblockbitsn);
-			j0v += NextDrawRow;
+			j0v += DiffTop;
 			LimitDrawRow = j0v + MaxRowsDrawnPerTick;
-			if (LimitDrawRow >= vMacScreenHeight) {
-				LimitDrawRow = vMacScreenHeight;
+			if (LimitDrawRow >= DiffBottom) {
+				LimitDrawRow = DiffBottom;
 				NextDrawRow = 0;
 			} else {
 				NextDrawRow = LimitDrawRow;
@@ -517,6 +863,11 @@ Label_2c:
 		copyrows = j1v - j0v;
 		copyoffset = j0v * vMacScreenByteWidth;
 		copysize = copyrows * vMacScreenByteWidth;
+#if WantScreenChangeBands
+		ScreenFindChangedBands(screencurrentbuff, j0v, j1v,
+			vMacScreenByteWidth);
+		ScreenDiffByteCount += copysize;
+#endif
 	} else
 #endif
 	{
@@ -527,30 +878,60 @@ Label_2c:
 			j1h = vMacScreenWidth;
 			j0v = 0;
 			j1v = vMacScreenHeight;
+			DiffTop = 0;
+			LimitDrawRow = vMacScreenHeight;
 #if WantColorTransValid
 			ColorTransValid = falseblnr;
+#endif
+#if WantScreenChangeBands
+			ScreenBandChangedNotify(0, 0,
+				vMacScreenHeight, vMacScreenWidth);
 #endif
 		} else
 #endif
+#if WantScreenRowSigs
+		{
+			if (! ScreenRowSigsFind(screencurrentbuff,
+				DiffTop, DiffBottom, MaxRowsDrawnPerTick,
+				&j0v, &j1v, &j0h, &j1h, &LimitDrawRow))
+			{
+#if WantScreenDirtyRows
+				ScreenDirtyRowsClear(DiffTop, DiffBottom);
+#endif
+				NextDrawRow = 0;
+				return falseblnr;
+			}
+			if (LimitDrawRow >= DiffBottom) {
+				NextDrawRow = 0;
+			} else {
+				NextDrawRow = LimitDrawRow;
+			}
+		}
+#else
 		{
+			ScreenDiffByteCount += (DiffBottom - DiffTop)
+				* (vMacScreenWidth / 8);
 			if (! FindFirstChangeInLVecs(
 				(uibb *)screencurrentbuff
-					+ NextDrawRow * (vMacScreenWidth / uiblockbitsn),
+					+ DiffTop * (vMacScreenWidth / uiblockbitsn),
 				(uibb *)screencomparebuff
-					+ NextDrawRow * (vMacScreenWidth / uiblockbitsn),
-				((uimr)(vMacScreenHeight - NextDrawRow)
+					+ DiffTop * (vMacScreenWidth / uiblockbitsn),
+				((uimr)(DiffBottom - DiffTop)
 					* (uimr)vMacScreenWidth) / uiblockbitsn,
 				&j0))
 			{
+#if WantScreenDirtyRows
+				ScreenDirtyRowsClear(DiffTop, DiffBottom);
+#endif
 				NextDrawRow = 0;
 				return falseblnr;
 			}
 			j0v = j0 / (vMacScreenWidth / uiblockbitsn);
 			j0h = j0 - j0v * (vMacScreenWidth / uiblockbitsn);
-			j0v += NextDrawRow;
+			j0v += DiffTop;
 			LimitDrawRow = j0v + MaxRowsDrawnPerTick;
-			if (LimitDrawRow >= vMacScreenHeight) {
-				LimitDrawRow = vMacScreenHeight;
+			if (LimitDrawRow >= DiffBottom) {
+				LimitDrawRow = DiffBottom;
 				NextDrawRow = 0;
 			} else {
 				NextDrawRow = LimitDrawRow;
@@ -597,15 +978,31 @@ Label_1:
 Label_2:
 			j1h = RightMax * uiblockbitsn + j + 1;
 		}
+#endif /* WantScreenRowSigs */
 
 		copyrows = j1v - j0v;
+#if ! WantScreenRowSigs
 		copyoffset = j0v * vMacScreenMonoByteWidth;
+#endif
 		copysize = copyrows * vMacScreenMonoByteWidth;
+#if WantScreenChangeBands
+		ScreenFindChangedBands(screencurrentbuff, j0v, j1v,
+			vMacScreenMonoByteWidth);
+		ScreenDiffByteCount += copysize;
+#endif
 	}
 
+#if WantScreenRowSigs
+	ScreenRowSigsCopy(screencurrentbuff, DiffTop, LimitDrawRow);
+#else
 	MyMoveBytes((anyp)screencurrentbuff + copyoffset,
 		(anyp)screencomparebuff + copyoffset,
 		copysize);
+#endif
+#if WantScreenDirtyRows
+	/* the rows up to LimitDrawRow match now */
+	ScreenDirtyRowsClear(DiffTop, LimitDrawRow);
+#endif
 
 	*top = j0v;
 	*left = j0h;
@@ -615,8 +1012,21 @@ Label_2:
 	return trueblnr;
 }
 
+/*
+	OSGLUxxx may set WantScreenDiffElsewhere and define
+	ScreenDiffElsewhere(screencurrentbuff, TimeAdjust,
+	top, left, bottom, right) to hand the screen to some other
+	thread, which then looks for the changes, instead of calling
+	ScreenFindChanges. It returns the changes found there since
+	the last call, like ScreenFindChanges does.
+*/
+#ifndef WantScreenDiffElsewhere
+#define WantScreenDiffElsewhere 0
+#endif
+
 GLOBALVAR blnr EmVideoDisable = falseblnr;
 GLOBALVAR si3b EmLagTime = 0;
+GLOBALVAR ui5r EmCycleCount = 0;
 
 GLOBALVAR ui5b OnTrueTime = 0;
 	/*
@@ -643,6 +1053,9 @@ LOCALPROC ScreenChangedAll(void)
 	ScreenChangedBottom = vMacScreenHeight;
 	ScreenChangedLeft = 0;
 	ScreenChangedRight = vMacScreenWidth;
+#if WantScreenChangeBands
+	ScreenBandChangedNotify(0, 0, vMacScreenHeight, vMacScreenWidth);
+#endif
 }
 
 #if EnableAutoSlow
@@ -660,9 +1073,21 @@ GLOBALOSGLUPROC Screen_OutputFrame(ui3p screencurrentbuff)
 	si4b right;
 
 	if (! EmVideoDisable) {
-		if (ScreenFindChanges(screencurrentbuff, EmLagTime,
-			&top, &left, &bottom, &right))
-		{
+		blnr HaveChanges;
+
+		ScreenDiffBeginNotify();
+#if WantScreenDiffElsewhere
+		HaveChanges = ScreenDiffElsewhere(screencurrentbuff, EmLagTime,
+			&top, &left, &bottom, &right);
+#else
+		HaveChanges = ScreenFindChanges(screencurrentbuff, EmLagTime,
+			&top, &left, &bottom, &right);
+#endif
+		ScreenDiffEndNotify();
+
+		if (HaveChanges) {
+			ScreenOutputNotify(screencurrentbuff,
+				top, left, bottom, right);
 			if (top < ScreenChangedTop) {
 				ScreenChangedTop = top;
 			}
@@ -1008,10 +1433,21 @@ GLOBALOSGLUPROC dbglog_writelnNum(char *s, simr v)
 
 /* my event queue */
 
+#ifndef MyEvtQLg2Sz
 #define MyEvtQLg2Sz 4
+#endif
 #define MyEvtQSz (1 << MyEvtQLg2Sz)
 #define MyEvtQIMask (MyEvtQSz - 1)
 
+/*
+	OSGLUxxx may define this to be told of each change
+	the queue takes: the kind, then the key and whether
+	it is down, the button state, or the position or delta.
+*/
+#ifndef MyEvtQInNotify
+#define MyEvtQInNotify(kind, a, b)
+#endif
+
 LOCALVAR MyEvtQEl MyEvtQA[MyEvtQSz];
 LOCALVAR ui4r MyEvtQIn = 0;
 LOCALVAR ui4r MyEvtQOut = 0;
@@ -1072,6 +1508,7 @@ LOCALPROC Keyboard_UpdateKeyMap(ui3r key, blnr down)
 			p->kind = MyEvtQElKindKey;
 			p->u.press.key = k;
 			p->u.press.down = down;
+			MyEvtQInNotify(MyEvtQElKindKey, k, down);
 
 			if (down) {
 				*kpi |= bit;
@@ -1093,6 +1530,7 @@ LOCALPROC MyMouseButtonSet(blnr down)
 		if (NULL != p) {
 			p->kind = MyEvtQElKindMouseButton;
 			p->u.press.down = down;
+			MyEvtQInNotify(MyEvtQElKindMouseButton, 0, down);
 
 			MyMouseButtonState = down;
 		}
@@ -1117,6 +1555,9 @@ LOCALPROC MyMousePositionSetDelta(ui4r dh, ui4r dv)
 				p->u.pos.v = dv;
 			}
 		}
+		if (NULL != p) {
+			MyEvtQInNotify(MyEvtQElKindMouseDelta, dh, dv);
+		}
 
 		QuietEnds();
 	}
@@ -1137,6 +1578,7 @@ LOCALPROC MyMousePositionSet(ui4r h, ui4r v)
 			p->kind = MyEvtQElKindMousePos;
 			p->u.pos.h = h;
 			p->u.pos.v = v;
+			MyEvtQInNotify(MyEvtQElKindMousePos, h, v);
 
 			MyMousePosCurH = h;
 			MyMousePosCurV = v;
@@ -525,6 +525,16 @@ enum {
 #if 0 && (UseActvCode || EnableDemoMsg)
 	kCntrlMsgRegStrCopied,
 #endif
+#if WantTickTraceDump
+	kCntrlMsgTraceDumped,
+#endif
+#if WantPerfHUD
+	kCntrlMsgPerfHUD,
+#endif
+#if WantLatencyProbe
+	kCntrlMsgLatency,
+	kCntrlMsgLatencyDumped,
+#endif
 
 	kNumCntrlMsgs
 };
@@ -637,6 +647,17 @@ LOCALPROC CopyRegistrationStr(void)
 #endif
 
 
+#if WantTickTraceDump
+FORWARDPROC TickTraceDump(void);
+#endif
+#if WantPerfHUD
+FORWARDPROC DrawCellsPerfHUDBody(void);
+#endif
+#if WantLatencyProbe
+FORWARDPROC DrawCellsLatencyBody(void);
+FORWARDPROC LatencyDump(void);
+#endif
+
 LOCALPROC DoControlModeKey(ui3r key)
 {
 	switch (CurControlMode) {
@@ -685,6 +706,26 @@ LOCALPROC DoControlModeKey(ui3r key)
 				case MKC_H:
 					ControlMessage = kCntrlMsgHelp;
 					break;
+#if WantTickTraceDump
+				case MKC_T:
+					TickTraceDump();
+					ControlMessage = kCntrlMsgTraceDumped;
+					break;
+#endif
+#if WantPerfHUD
+				case MKC_U:
+					ControlMessage = kCntrlMsgPerfHUD;
+					break;
+#endif
+#if WantLatencyProbe
+				case MKC_L:
+					ControlMessage = kCntrlMsgLatency;
+					break;
+				case MKC_V:
+					LatencyDump();
+					ControlMessage = kCntrlMsgLatencyDumped;
+					break;
+#endif
 #if NeedRequestInsertDisk
 				case MKC_O:
 					RequestInsertDisk = trueblnr;
@@ -935,6 +976,16 @@ LOCALPROC DrawCellsControlModeBody(void)
 			DrawCellsKeyCommand("I", kStrCmdInterrupt);
 #endif
 			DrawCellsKeyCommand("P", kStrCmdCopyOptions);
+#if WantTickTraceDump
+			DrawCellsKeyCommand("T", "Dump tick trace");
+#endif
+#if WantPerfHUD
+			DrawCellsKeyCommand("U", "Performance counters");
+#endif
+#if WantLatencyProbe
+			DrawCellsKeyCommand("L", "Input latency");
+			DrawCellsKeyCommand("V", "Dump input latency");
+#endif
 			DrawCellsKeyCommand("H", kStrCmdHelp);
 			break;
 		case kCntrlMsgSpeedControlStart:
@@ -1036,6 +1087,24 @@ LOCALPROC DrawCellsControlModeBody(void)
 		case kCntrlMsgEmCntrl:
 			DrawCellsOneLineStr(kStrNewCntrlKey);
 			break;
+#endif
+#if WantTickTraceDump
+		case kCntrlMsgTraceDumped:
+			DrawCellsOneLineStr("Tick trace is being dumped.");
+			break;
+#endif
+#if WantPerfHUD
+		case kCntrlMsgPerfHUD:
+			DrawCellsPerfHUDBody();
+			break;
+#endif
+#if WantLatencyProbe
+		case kCntrlMsgLatency:
+			DrawCellsLatencyBody();
+			break;
+		case kCntrlMsgLatencyDumped:
+			DrawCellsOneLineStr("Input latency is being dumped.");
+			break;
 #endif
 		case kCntrlMsgBaseStart:
 		default:
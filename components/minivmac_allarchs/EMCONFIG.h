@@ -34,7 +34,11 @@
 
 #define EmVidCard 0
 
+#if WantScreenDirtyRows
+#define MaxATTListN 32
+#else
 #define MaxATTListN 16
+#endif
 #define IncludeExtnPbufs 0
 #define IncludeExtnHostTextClipExchange 0
 
@@ -74,6 +78,9 @@ enum {
 	Wire_VIA1_iA6_SCRNvPage2,
 #define SCRNvPage2 (Wires[Wire_VIA1_iA6_SCRNvPage2])
 #define VIA1_iA6 (Wires[Wire_VIA1_iA6_SCRNvPage2])
+#if WantScreenDirtyRows
+#define VIA1_iA6_ChangeNtfy SCRNvPage2_ChangeNtfy
+#endif
 
 	Wire_VIA1_iA5_IWMvSel,
 #define IWMvSel (Wires[Wire_VIA1_iA5_IWMvSel])
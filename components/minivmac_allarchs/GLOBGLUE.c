@@ -677,6 +677,9 @@ enum {
 #endif
 	kMMDV_SCSI,
 	kMMDV_IWM,
+#if WantScreenDirtyRows
+	kMMDV_Screen,
+#endif
 
 	kNumMMDVs
 };
@@ -1138,6 +1141,121 @@ LOCALPROC AddToATTListWithMTB(ATTep p)
 }
 #endif
 
+#if WantScreenDirtyRows
+
+#if IncludeVidMem || (CurEmMd == kEmMd_II) || (CurEmMd == kEmMd_IIx)
+#error "WantScreenDirtyRows needs the screen in RAM"
+#endif
+#ifdef ln2mtb
+#error "WantScreenDirtyRows not compatible with ln2mtb"
+#endif
+
+/*
+	The RAM around the displayed screen page gets its own
+	entries in the ATT list, that are read ready but not
+	write ready, so writes go through MMDV_Access, which
+	marks the rows written to in ScreenDirtyRows. The
+	entries are aligned to kScrnTrackAlign, so a little of
+	the RAM next to the page goes that way too. The rest of
+	RAM stays write ready.
+*/
+
+#ifndef kScrnTrackAlign
+#define kScrnTrackAlign 0x1000
+#endif
+
+LOCALVAR ui5r ScrnTrackBase;
+	/* offset in RAM of the displayed screen page */
+
+LOCALPROC ScrnDirtyMark(ui5r offset, ui5r n)
+{
+	ui5r r0;
+	ui5r r1;
+
+	if ((offset < ScrnTrackBase + vMacScreenNumBytes)
+		&& (offset + n > ScrnTrackBase))
+	{
+		if (offset < ScrnTrackBase) {
+			r0 = 0;
+		} else {
+			r0 = (offset - ScrnTrackBase) / vMacScreenByteWidth;
+		}
+		if (offset + n > ScrnTrackBase + vMacScreenNumBytes) {
+			r1 = vMacScreenHeight - 1;
+		} else {
+			r1 = (offset + n - 1 - ScrnTrackBase) / vMacScreenByteWidth;
+		}
+		for (; r0 <= r1; ++r0) {
+			ScreenDirtyRows[r0 >> 5] |= ((ui5b)1) << (r0 & 31);
+		}
+	}
+}
+
+LOCALPROC ScrnDirtyMarkAll(void)
+{
+	ScrnDirtyMark(ScrnTrackBase, vMacScreenNumBytes);
+}
+
+LOCALFUNC blnr IsScrnTrackATTel(ATTep p)
+{
+	return (0 != (p->Access & kATTA_mmdvmask))
+		&& (kMMDV_Screen == p->MMDV);
+}
+
+/*
+	add entries for the offsets lo up to hi of the memory
+	mapped by p, in the largest aligned blocks possible.
+*/
+LOCALPROC AddRAMBlocksToATTList(ATTep p, ui5r lo, ui5r hi,
+	blnr Screen)
+{
+	ATTer r;
+	ui5r n;
+
+	r = *p;
+	if (Screen) {
+		r.Access = kATTA_readreadymask | kATTA_mmdvmask;
+		r.MMDV = kMMDV_Screen;
+	}
+	while (lo < hi) {
+		n = 1;
+		while ((0 == (lo & n)) && (n <= hi - lo - n)) {
+			n <<= 1;
+		}
+		r.cmpmask = p->cmpmask | (p->usemask & ~ (n - 1));
+		r.cmpvalu = p->cmpvalu | lo;
+		AddToATTList(&r);
+		lo += n;
+	}
+}
+
+#endif /* WantScreenDirtyRows */
+
+/*
+	p maps the RAM from offset base on. If that includes the
+	displayed screen page, split it up as described above.
+*/
+LOCALPROC AddRAMToATTList(ATTep p, ui5r base)
+{
+#if WantScreenDirtyRows
+	ui5r size = p->usemask + 1;
+	ui5r lo = ScrnTrackBase & ~ (kScrnTrackAlign - 1);
+	ui5r hi = (ScrnTrackBase + vMacScreenNumBytes
+		+ kScrnTrackAlign - 1) & ~ (kScrnTrackAlign - 1);
+
+	if ((lo >= base) && (hi <= base + size)) {
+		AddRAMBlocksToATTList(p, 0, lo - base, falseblnr);
+		AddRAMBlocksToATTList(p, lo - base, hi - base, trueblnr);
+		AddRAMBlocksToATTList(p, hi - base, size, falseblnr);
+	} else
+#else
+	UnusedParam(base);
+#endif
+	{
+		AddToATTListWithMTB(p);
+	}
+}
+
 #if (CurEmMd != kEmMd_II) && (CurEmMd != kEmMd_IIx)
 LOCALPROC SetUp_RAM24(void)
 {
@@ -1149,7 +1267,7 @@ LOCALPROC SetUp_RAM24(void)
 	r.usemask = kRAM_Size - 1;
 	r.usebase = RAM;
 	r.Access = kATTA_readwritereadymask;
-	AddToATTListWithMTB(&r);
+	AddRAMToATTList(&r, 0);
 #else
 	/* unbalanced memory */
 
@@ -1160,7 +1278,7 @@ LOCALPROC SetUp_RAM24(void)
 	r.usemask = kRAMb_Size - 1;
 	r.usebase = kRAMa_Size + RAM;
 	r.Access = kATTA_readwritereadymask;
-	AddToATTListWithMTB(&r);
+	AddRAMToATTList(&r, kRAMa_Size);
 #endif
 
 	r.cmpmask = 0x00FFFFFF & (kRAMa_Size | ~ ((1 << kRAM_ln2Spc) - 1));
@@ -1168,7 +1286,7 @@ LOCALPROC SetUp_RAM24(void)
 	r.usemask = kRAMa_Size - 1;
 	r.usebase = RAM;
 	r.Access = kATTA_readwritereadymask;
-	AddToATTListWithMTB(&r);
+	AddRAMToATTList(&r, 0);
 #endif
 }
 #endif
@@ -1281,6 +1399,15 @@ LOCALPROC SetUp_address(void)
 
 LOCALPROC SetUpMemBanks(void)
 {
+#if WantScreenDirtyRows
+	if (SCRNvPage2 == 1) {
+		ScrnTrackBase = kMain_Buffer;
+	} else {
+		ScrnTrackBase = kAlternate_Buffer;
+	}
+	ScrnDirtyMarkAll();
+#endif
+
 	InitATTList();
 
 	SetUp_address();
@@ -1524,6 +1651,29 @@ GLOBALFUNC ui5b MMDV_Access(ATTep p, ui5b Data,
 			}
 
 			break;
+#if WantScreenDirtyRows
+		case kMMDV_Screen:
+			{
+				ui3p m = p->usebase + (addr & p->usemask);
+
+				if (! WriteMem) {
+					/* not used, the entry is read ready */
+					if (ByteSize) {
+						Data = do_get_mem_byte(m);
+					} else {
+						Data = do_get_mem_word(m);
+					}
+				} else {
+					if (ByteSize) {
+						do_put_mem_byte(m, Data);
+					} else {
+						do_put_mem_word(m, Data);
+					}
+					ScrnDirtyMark(m - RAM, ByteSize ? 1 : 2);
+				}
+			}
+			break;
+#endif
 	}
 
 	return Data;
@@ -1559,6 +1709,14 @@ GLOBALPROC MemOverlay_ChangeNtfy(void)
 #endif
 }
 
+#if WantScreenDirtyRows
+GLOBALPROC SCRNvPage2_ChangeNtfy(void)
+{
+	/* track writes to the other page */
+	SetUpMemBanks();
+}
+#endif
+
 #if (CurEmMd == kEmMd_II) || (CurEmMd == kEmMd_IIx)
 GLOBALPROC Addr32_ChangeNtfy(void)
 {
@@ -1576,6 +1734,10 @@ Label_Retry:
 		(WriteMem ? kATTA_writereadymask : kATTA_readreadymask)))
 	{
 		/* ok */
+#if WantScreenDirtyRows
+	} else if (WriteMem && IsScrnTrackATTel(p)) {
+		/* ok, get_real_address0 marks the rows */
+#endif
 	} else {
 		if (0 != (p->Access & kATTA_ntfymask)) {
 			if (MemAccessNtfy(p)) {
@@ -1610,6 +1772,12 @@ GLOBALFUNC ui3p get_real_address0(ui5b L, blnr WritableMem, CPTR addr,
 		} else {
 			*actL = bankleft;
 		}
+
+#if WantScreenDirtyRows
+		if (WritableMem && IsScrnTrackATTel(q)) {
+			ScrnDirtyMark(p - RAM, *actL);
+		}
+#endif
 	}
 
 	return p;
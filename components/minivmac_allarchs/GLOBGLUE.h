@@ -54,6 +54,10 @@ EXPORTVAR(ui3p, VidMem)
 
 EXPORTPROC MemOverlay_ChangeNtfy(void);
 
+#if WantScreenDirtyRows
+EXPORTPROC SCRNvPage2_ChangeNtfy(void);
+#endif
+
 #if (CurEmMd == kEmMd_II) || (CurEmMd == kEmMd_IIx)
 EXPORTPROC Addr32_ChangeNtfy(void);
 #endif
@@ -100,6 +104,14 @@ EXPORTFUNC ui3p get_real_address0(ui5b L, blnr WritableMem, CPTR addr,
 
 #define get_ram_address(addr) ((addr) + RAM)
 
+#if ! IncludeVidMem
+/* the two screen pages, at the top of RAM */
+#define kMain_Offset      0x5900
+#define kAlternate_Offset 0xD900
+#define kMain_Buffer      (kRAM_Size - kMain_Offset)
+#define kAlternate_Buffer (kRAM_Size - kAlternate_Offset)
+#endif
+
 /*
 	accessing addresses that don't map to
 	real memory, i.e. memory mapped devices
@@ -210,6 +210,21 @@ EXPORTVAR(blnr, EmVideoDisable)
 EXPORTVAR(si3b, EmLagTime)
 
 EXPORTOSGLUPROC Screen_OutputFrame(ui3p screencurrentbuff);
+
+#if WantScreenDirtyRows
+/*
+	One bit per row of the displayed screen page, set by the
+	memory system in GLOBGLUE.c when the row is written to.
+	Screen_OutputFrame only compares the rows with the bit
+	set, and clears the bits of the rows it has compared.
+*/
+#define kScreenDirtyRowWords ((vMacScreenHeight + 31) / 32)
+
+EXPORTVAR(ui5b, ScreenDirtyRows[kScreenDirtyRowWords])
+#endif
+
+/* bytes of the screen compared for changes so far, wraps around */
+EXPORTVAR(ui5r, ScreenDiffByteCount)
 EXPORTOSGLUPROC DoneWithDrawingForTick(void);
 
 EXPORTVAR(blnr, ForceMacOff)
@@ -288,6 +303,35 @@ EXPORTOSGLUPROC LT_ReceivePacket(void);
 
 EXPORTOSGLUPROC WaitForNextTick(void);
 
+/* emulated cycles done so far, wraps around */
+EXPORTVAR(ui5r, EmCycleCount)
+
+#if WantTickTrace
+/*
+	Mark the begin and end of the parts of a tick, so the
+	platform specific code can record a timeline or count
+	host time per part. Ids from
+	kNumTickTraceIds up to 15 are reserved, the platform
+	specific code may use ids from 16 on for its own parts.
+*/
+enum {
+	kTickTraceTick,
+	kTickTraceExtraTime,
+	kTickTraceCPU,
+	kTickTraceICT,
+	kTickTraceDevices,
+	kTickTraceScreenOut,
+
+	kNumTickTraceIds
+};
+
+EXPORTOSGLUPROC TickTraceBegin(ui3r id);
+EXPORTOSGLUPROC TickTraceEnd(ui3r id);
+#else
+#define TickTraceBegin(id)
+#define TickTraceEnd(id)
+#endif
+
 #define MyEvtQElKindKey 0
 #define MyEvtQElKindMouseButton 1
 #define MyEvtQElKindMousePos 2
@@ -160,6 +160,7 @@ LOCALPROC SixtiethSecondNotify(void)
 #if dbglog_HAVE && 0
 	dbglog_WriteNote("begin new Sixtieth");
 #endif
+	TickTraceBegin(kTickTraceDevices);
 	Mouse_Update();
 	InterruptReset_Update();
 #if EmClassicKbrd
@@ -183,13 +184,16 @@ LOCALPROC SixtiethSecondNotify(void)
 #endif
 
 	SubTickTaskStart();
+	TickTraceEnd(kTickTraceDevices);
 }
 
 LOCALPROC SixtiethEndNotify(void)
 {
 	SubTickTaskEnd();
 	Mouse_EndTickNotify();
+	TickTraceBegin(kTickTraceScreenOut);
 	Screen_EndTickNotify();
+	TickTraceEnd(kTickTraceScreenOut);
 #if dbglog_HAVE && 0
 	dbglog_WriteNote("end Sixtieth");
 #endif
@@ -312,7 +316,9 @@ LOCALPROC ICT_DoCurrentTasks(void)
 #ifdef _VIA_Debug
 				fprintf(stderr, "doing task %d, %d\n", NextiCount, i);
 #endif
+				TickTraceBegin(kTickTraceICT);
 				ICT_DoTask(i);
+				TickTraceEnd(kTickTraceICT);
 
 				/*
 					A Task may set the time of
@@ -362,6 +368,8 @@ LOCALPROC m68k_go_nCycles_1(ui5b n)
 {
 	ui5b n2;
 	ui5b StopiCount = NextiCount + n;
+
+	EmCycleCount += n >> kLn2CycleScale;
 	do {
 		ICT_DoCurrentTasks();
 		n2 = ICT_DoGetNext(n);
@@ -376,7 +384,9 @@ LOCALPROC m68k_go_nCycles_1(ui5b n)
 		dbglog_writeReturn();
 #endif
 		NextiCount += n2;
+		TickTraceBegin(kTickTraceCPU);
 		m68k_go_nCycles(n2);
+		TickTraceEnd(kTickTraceCPU);
 		n = StopiCount - NextiCount;
 	} while (n != 0);
 }
@@ -406,12 +416,16 @@ LOCALPROC DoEmulateOneTick(void)
 	}
 #endif
 
+	TickTraceBegin(kTickTraceTick);
+
 	SixtiethSecondNotify();
 
 	m68k_go_nCycles_1(CyclesScaledPerTick);
 
 	SixtiethEndNotify();
 
+	TickTraceEnd(kTickTraceTick);
+
 	if ((ui3b) -1 == SpeedValue) {
 		ExtraSubTicksToDo = (ui5b) -1;
 	} else {
@@ -459,6 +473,7 @@ LOCALPROC DoEmulateExtraTime(void)
 	*/
 
 	if (MoreSubTicksToDo()) {
+		TickTraceBegin(kTickTraceExtraTime);
 		ExtraTimeBeginNotify();
 		do {
 #if EnableAutoSlow
@@ -475,6 +490,7 @@ LOCALPROC DoEmulateExtraTime(void)
 			--ExtraSubTicksToDo;
 		} while (MoreSubTicksToDo());
 		ExtraTimeEndNotify();
+		TickTraceEnd(kTickTraceExtraTime);
 	}
 }
 
@@ -0,0 +1,204 @@
+/*
+	SCRNDOWN.h
+
+	Copyright (C) 2025  <uliuc@gmx.net >
+
+	You can redistribute this file and/or modify it under the terms
+	of version 2 of the GNU General Public License as published by
+	the Free Software Foundation.  You should have received a copy
+	of the license along with this file; see the file COPYING.
+
+	This file is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	license for more details.
+*/
+
+/*
+	SCReeN DOWNscaler
+
+	Maps a 1 bit deep screen to a smaller 16 bit deep one,
+	ScrnDown_SrcN source pixels to ScrnDown_DstN destination pixels
+	in each direction. Box filter: each destination pixel adds up the
+	set bits of the source area it covers, each weighted by how much
+	of it is covered, and looks the sum up in ScrnDown_Map, which has
+	ScrnDown_SrcN * ScrnDown_SrcN + 1 entries.
+
+	Works on groups of ScrnDown_SrcN x ScrnDown_SrcN source pixels,
+	so the destination rows and columns of a group are always done
+	together. A destination pixel only partly over the screen is
+	never written.
+*/
+
+/* required arguments for this template */
+
+#ifndef ScrnDown_DoMap /* procedure to be created by this template */
+#error "ScrnDown_DoMap not defined"
+#endif
+#ifndef ScrnDown_Src
+#error "ScrnDown_Src not defined"
+#endif
+#ifndef ScrnDown_Dst
+#error "ScrnDown_Dst not defined"
+#endif
+#ifndef ScrnDown_SrcN
+#error "ScrnDown_SrcN not defined"
+#endif
+#ifndef ScrnDown_DstN
+#error "ScrnDown_DstN not defined"
+#endif
+#ifndef ScrnDown_Map
+#error "ScrnDown_Map not defined"
+#endif
+
+/* optional arguments for this template */
+
+#ifndef ScrnDown_SrcWidth
+#define ScrnDown_SrcWidth vMacScreenWidth
+#endif
+#ifndef ScrnDown_SrcHeight
+#define ScrnDown_SrcHeight vMacScreenHeight
+#endif
+
+/* check of parameters */
+
+#if (ScrnDown_SrcN < 2) || (ScrnDown_SrcN > 8)
+#error "bad ScrnDown_SrcN"
+#endif
+
+#if (ScrnDown_DstN < 1) || (ScrnDown_DstN >= ScrnDown_SrcN)
+#error "bad ScrnDown_DstN"
+#endif
+
+/* calculate a few things local to this template */
+
+#define ScrnDown_SrcWB (ScrnDown_SrcWidth >> 3)
+#define ScrnDown_DstWidth \
+	(ScrnDown_SrcWidth * ScrnDown_DstN / ScrnDown_SrcN)
+#define ScrnDown_DstHeight \
+	(ScrnDown_SrcHeight * ScrnDown_DstN / ScrnDown_SrcN)
+
+/* now define the procedure */
+
+LOCALPROC ScrnDown_DoMap(si4b top, si4b left,
+	si4b bottom, si4b right)
+{
+	int i;
+	int j;
+	int s;
+	int d;
+	int e;
+	ui5r bits;
+	ui3b w[ScrnDown_DstN][ScrnDown_SrcN];
+	ui3b h[ScrnDown_DstN];
+	ui3b acc[ScrnDown_DstN][ScrnDown_DstN];
+	ui4r gy0 = top / ScrnDown_SrcN;
+	ui4r gy1 = (bottom + ScrnDown_SrcN - 1) / ScrnDown_SrcN;
+	ui4r gx0 = left / ScrnDown_SrcN;
+	ui4r gx1 = (right + ScrnDown_SrcN - 1) / ScrnDown_SrcN;
+
+	/*
+		a source pixel is ScrnDown_DstN units wide, a destination
+		pixel ScrnDown_SrcN, w is how many units they share
+	*/
+	for (d = 0; d < ScrnDown_DstN; ++d) {
+		for (s = 0; s < ScrnDown_SrcN; ++s) {
+			int lo = d * ScrnDown_SrcN;
+			int hi = (d + 1) * ScrnDown_SrcN;
+
+			if (lo < s * ScrnDown_DstN) {
+				lo = s * ScrnDown_DstN;
+			}
+			if (hi > (s + 1) * ScrnDown_DstN) {
+				hi = (s + 1) * ScrnDown_DstN;
+			}
+			w[d][s] = (hi > lo) ? (hi - lo) : 0;
+		}
+	}
+
+	for (i = gy0; i < gy1; ++i) {
+		for (j = gx0; j < gx1; ++j) {
+			ui5r x = j * ScrnDown_SrcN;
+
+			for (d = 0; d < ScrnDown_DstN; ++d) {
+				for (e = 0; e < ScrnDown_DstN; ++e) {
+					acc[d][e] = 0;
+				}
+			}
+
+			for (s = 0; s < ScrnDown_SrcN; ++s) {
+				ui5r y = i * ScrnDown_SrcN + s;
+				ui3p p = ((ui3p)ScrnDown_Src)
+					+ ScrnDown_SrcWB * y + (x >> 3);
+
+				if (y >= ScrnDown_SrcHeight) {
+					break;
+				}
+
+				/* the group's pixels from bit 15 down */
+				bits = (ui5r)p[0] << 8;
+				if ((x >> 3) + 1 < ScrnDown_SrcWB) {
+					bits |= p[1];
+				}
+				bits = (bits << (x & 7)) & 0xFFFF;
+				if (x + ScrnDown_SrcN > ScrnDown_SrcWidth) {
+					bits &= (0xFFFF << (16 - (ScrnDown_SrcWidth - x)))
+						& 0xFFFF;
+				}
+
+				/* weighted count along the row */
+				for (d = 0; d < ScrnDown_DstN; ++d) {
+					h[d] = 0;
+				}
+				for (e = 0; e < ScrnDown_SrcN; ++e) {
+					if (0 != (bits & (0x8000 >> e))) {
+						for (d = 0; d < ScrnDown_DstN; ++d) {
+							h[d] += w[d][e];
+						}
+					}
+				}
+
+				/* and down the column */
+				for (d = 0; d < ScrnDown_DstN; ++d) {
+					if (0 != w[d][s]) {
+						for (e = 0; e < ScrnDown_DstN; ++e) {
+							acc[d][e] += w[d][s] * h[e];
+						}
+					}
+				}
+			}
+
+			for (d = 0; d < ScrnDown_DstN; ++d) {
+				ui5r dy = i * ScrnDown_DstN + d;
+				ui4b *pDst;
+
+				if (dy >= ScrnDown_DstHeight) {
+					break;
+				}
+				pDst = ((ui4b *)ScrnDown_Dst)
+					+ ScrnDown_DstWidth * dy + j * ScrnDown_DstN;
+				for (e = 0; e < ScrnDown_DstN; ++e) {
+					if (j * ScrnDown_DstN + e >= ScrnDown_DstWidth) {
+						break;
+					}
+					pDst[e] = ((ui4b *)ScrnDown_Map)[acc[d][e]];
+				}
+			}
+		}
+	}
+}
+
+/* undefine template locals and parameters */
+
+#undef ScrnDown_DstHeight
+#undef ScrnDown_DstWidth
+#undef ScrnDown_SrcWB
+
+#undef ScrnDown_DoMap
+#undef ScrnDown_Src
+#undef ScrnDown_Dst
+#undef ScrnDown_SrcN
+#undef ScrnDown_DstN
+#undef ScrnDown_Map
+#undef ScrnDown_SrcWidth
+#undef ScrnDown_SrcHeight
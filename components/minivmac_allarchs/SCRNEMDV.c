@@ -34,13 +34,6 @@
 
 #include "SCRNEMDV.h"
 
-#if ! IncludeVidMem
-#define kMain_Offset      0x5900
-#define kAlternate_Offset 0xD900
-#define kMain_Buffer      (kRAM_Size - kMain_Offset)
-#define kAlternate_Buffer (kRAM_Size - kAlternate_Offset)
-#endif
-
 GLOBALPROC Screen_EndTickNotify(void)
 {
 	ui3p screencurrentbuff;
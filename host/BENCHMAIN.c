@@ -0,0 +1,350 @@
+/*
+ Copyright (C) 2025  <uliuc@gmx.net >
+
+ This program is free software; you can redistribute it and/or modify it
+ under the terms of the GNU General Public License as published by the
+ Free Software Foundation; either version 3 of the License, or (at your
+ option) any later version.
+
+ This program is distributed in the hope that it will be useful, but
+ WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ for more details.
+
+ For the complete text of the GNU General Public License see
+ http://www.gnu.org/licenses/.
+
+*/
+
+// benchmark driver for the headless host port
+//
+// Runs the unmodified emulator core and OSGLUESP32.c against HOSTAPI.c
+// for a number of emulated seconds, or until the Finder runs, and
+// reports emulated cycles and ticks per second of host time plus the
+// boot-to-Finder time.
+//
+// With -v a VNC client can watch and use the emulated Mac, best in real
+// time (-r).
+//
+// With -w the screen output is recorded as by CONFIG_MINIVMAC_RECORD on
+// the device, for RECREAD.c to turn into images.
+//
+// With -e the input is recorded as by CONFIG_MINIVMAC_EVENTS, e.g. of a
+// session over VNC in real time, and -E replays such a recording, from
+// here or from the device, as fast as the host allows, until it ends.
+// Both print a hash of the screen at the end; the replay exits with 1 if
+// it differs from the recording.
+//
+// With -c it only checks the screen conversion of ESP32CONV.c, plain
+// and turned, against converting pixel by pixel, the screen compare of
+// ESP32DIFF.c against random changes of known place, the downscaling
+// of ESP32SCALE.c against computing each pixel's cover from scratch,
+// and the colour mapping of ESP32MAP.c against looking up each pixel.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include "ESP32API.h"
+#include "ESP32CONV.h"
+#include "ESP32DIFF.h"
+#include "ESP32SCALE.h"
+#include "ESP32MAP.h"
+#include "ESP32REC.h"
+#include "ESP32RFB.h"
+#include "ESP32EVT.h"
+#include "HOSTAPI.h"
+
+#include "SYSDEPNS.h"
+#include "MYOSGLUE.h"
+#include "EMCONFIG.h"
+#include "GLOBGLUE.h"
+
+// low memory global with the name of the current application
+#define kCurApName 0x0910
+
+#define kTicksPerSecond 60.14742
+
+static const char* out_dir = NULL;
+static uint32_t dump_every = 0;
+static uint32_t stop_ticks = 60 * 60;
+static bool stop_ticks_set = false;
+static bool stop_at_finder = false;
+static bool recording_events = false;
+static bool replaying_events = false;
+
+static volatile sig_atomic_t dump_requested = 0;
+static volatile sig_atomic_t stop_requested = 0;
+
+// measurement, started at the first poll
+static bool started = false;
+static uint64_t start_wall_us = 0;
+static uint32_t start_tick = 0;
+static uint32_t last_tick = 0;
+static uint32_t ticks = 0;
+static ui5r last_cycles = 0;
+static uint64_t cycles = 0;
+static ui5r last_diff_bytes = 0;
+static uint64_t diff_bytes = 0;
+static uint32_t dumps = 0;
+static uint32_t finder_tick = 0;
+static uint64_t finder_wall_us = 0;
+
+static void on_sigusr1(int sig)
+{
+    dump_requested = 1;
+}
+
+static void on_sigint(int sig)
+{
+    stop_requested = 1;
+}
+
+static void dump_screen(const char* name)
+{
+    char path[1024];
+
+    snprintf(path, sizeof(path), "%s/%s.pbm", out_dir, name);
+    if (HOSTAPI_WritePBM(path)) {
+        fprintf(stderr, "I (BENCH) wrote %s\n", path);
+    }
+}
+
+static bool finder_running(void)
+{
+    ui3p p = RAM + kCurApName;
+
+    return p[0] == 6 && memcmp(p + 1, "Finder", 6) == 0;
+}
+
+static void bench_poll(void)
+{
+    if (!started) {
+        started = true;
+        start_wall_us = HOSTAPI_GetWallTimeUS();
+        start_tick = OnTrueTime;
+        last_tick = OnTrueTime;
+        last_cycles = EmCycleCount;
+        last_diff_bytes = ScreenDiffByteCount;
+    }
+
+    // 32 bit counters, accumulate the deltas
+    cycles += (ui5r)(EmCycleCount - last_cycles);
+    last_cycles = EmCycleCount;
+    diff_bytes += (ui5r)(ScreenDiffByteCount - last_diff_bytes);
+    last_diff_bytes = ScreenDiffByteCount;
+
+    if (OnTrueTime != last_tick) {
+        last_tick = OnTrueTime;
+        ticks = OnTrueTime - start_tick;
+
+        if (out_dir && dump_every && (ticks % dump_every) == 0) {
+            char name[32];
+            snprintf(name, sizeof(name), "screen_%06lu", (unsigned long)ticks);
+            dump_screen(name);
+            dumps++;
+        }
+
+        if (finder_tick == 0 && finder_running()) {
+            finder_tick = ticks;
+            finder_wall_us = HOSTAPI_GetWallTimeUS() - start_wall_us;
+            if (stop_at_finder) {
+                ForceMacOff = trueblnr;
+            }
+        }
+
+        if (ticks >= stop_ticks) {
+            ForceMacOff = trueblnr;
+        }
+    }
+
+    if (dump_requested && out_dir) {
+        char name[32];
+        dump_requested = 0;
+        snprintf(name, sizeof(name), "request_%06lu", (unsigned long)ticks);
+        dump_screen(name);
+        dumps++;
+    }
+
+    if (stop_requested || (replaying_events && ESP32EVT_Done())) {
+        ForceMacOff = trueblnr;
+    }
+}
+
+static void report(bool fast)
+{
+    uint64_t wall_us = HOSTAPI_GetWallTimeUS() - start_wall_us;
+    double wall_s = wall_us / 1e6;
+
+    if (wall_s <= 0) {
+        wall_s = 1e-6;
+    }
+
+    printf("mode:              %s\n", fast ? "fast" : "real time");
+    printf("speed value:       %d\n", (int)(si3b)SpeedValue);
+    printf("host time:         %.3f s\n", wall_s);
+    printf("emulated time:     %.3f s (%lu ticks)\n",
+        ticks / kTicksPerSecond, (unsigned long)ticks);
+    printf("ticks per second:  %.1f\n", ticks / wall_s);
+    printf("emulated cycles:   %llu\n", (unsigned long long)cycles);
+    printf("cycles per second: %.3f M (%.2fx a Mac Plus)\n",
+        cycles / wall_s / 1e6, cycles / wall_s / 7833600.0);
+    printf("frames:            %lu\n", (unsigned long)HOSTAPI_GetFrameCount());
+    printf("screen diff:       %.0f bytes compared per tick\n",
+        ticks ? (double)diff_bytes / ticks : 0.0);
+    if (finder_tick) {
+        printf("boot to Finder:    %.3f s emulated, %.3f s host\n",
+            finder_tick / kTicksPerSecond, finder_wall_us / 1e6);
+    } else {
+        printf("boot to Finder:    not reached\n");
+    }
+    if (dumps) {
+        printf("screen dumps:      %lu\n", (unsigned long)dumps);
+    }
+    if (recording_events || replaying_events) {
+        uint32_t hash;
+        bool same = ESP32EVT_GetResult(&hash);
+
+        printf("screen hash:       %08lx%s\n", (unsigned long)hash,
+            !replaying_events ? "" : same ? ", as recorded" : ", NOT as recorded");
+    }
+}
+
+static void usage(const char* prog)
+{
+    fprintf(stderr,
+        "usage: %s [options]\n"
+        "  -d dir   directory with vMac.ROM and disk1.dsk .. (default .)\n"
+        "  -r       run in real time (default: skip all waits)\n"
+        "  -t sec   stop after this many emulated seconds (default 60)\n"
+        "  -f       stop once the Finder runs\n"
+        "  -s n     speed: 0 = 1x, 1 = 2x .. 5 = 32x, a = all out\n"
+        "  -o dir   write screen dumps (PBM) to dir, at the end, on SIGUSR1\n"
+        "  -p n     and every n ticks\n"
+        "  -w file  record the screen output to file, a fifo works too\n"
+        "  -e file  record the input to file\n"
+        "  -E file  replay the input of file, until it ends (unless -t)\n"
+        "  -v port  VNC server on 127.0.0.1:port, or on a UNIX socket path\n"
+        "  -c       check the screen conversions and the screen compare and exit\n",
+        prog);
+}
+
+int main(int argc, char** argv)
+{
+    const char* image_dir = ".";
+    bool fast = true;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "d:rt:fs:o:p:w:e:E:v:ch")) != -1) {
+        switch (opt) {
+            case 'd':
+                image_dir = optarg;
+                break;
+            case 'r':
+                fast = false;
+                break;
+            case 't':
+                stop_ticks = (uint32_t)(atof(optarg) * kTicksPerSecond);
+                stop_ticks_set = true;
+                break;
+            case 'f':
+                stop_at_finder = true;
+                break;
+            case 's':
+                SpeedValue = (optarg[0] == 'a') ? (ui3b)-1 : (ui3b)atoi(optarg);
+                break;
+            case 'o':
+                out_dir = optarg;
+                break;
+            case 'p':
+                dump_every = (uint32_t)atoi(optarg);
+                break;
+            case 'w':
+                if (!ESP32REC_Start((ESP32File)fopen(optarg, "wb"),
+                        vMacScreenWidth, vMacScreenHeight)) {
+                    fprintf(stderr, "could not record to %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'e':
+                if (!ESP32EVT_StartRecord((ESP32File)fopen(optarg, "wb"),
+                        vMacScreenWidth, vMacScreenHeight)) {
+                    fprintf(stderr, "could not record the input to %s\n", optarg);
+                    return 1;
+                }
+                recording_events = true;
+                break;
+            case 'E':
+                if (!ESP32EVT_StartReplay((ESP32File)fopen(optarg, "rb"),
+                        vMacScreenWidth, vMacScreenHeight)) {
+                    fprintf(stderr, "could not replay the input of %s\n", optarg);
+                    return 1;
+                }
+                replaying_events = true;
+                break;
+            case 'v': {
+                bool unix_socket = strchr(optarg, '/') != NULL;
+
+                if (!ESP32RFB_Start(unix_socket ? optarg : NULL,
+                        unix_socket ? 0 : atoi(optarg))) {
+                    return 1;
+                }
+                break;
+            }
+            case 'c': {
+                uint32_t expanded;
+                uint32_t compared;
+                uint32_t turned;
+                uint32_t scaled;
+                uint32_t mapped;
+
+                ESP32CONV_Init();
+                expanded = ESP32CONV_CheckExpand();
+                printf("conversion:        %lu wrong pixels\n", (unsigned long)expanded);
+                compared = ESP32DIFF_Check();
+                printf("screen compare:    %lu wrong trials\n", (unsigned long)compared);
+                turned = ESP32CONV_CheckTurned();
+                printf("turned conversion: %lu wrong pixels\n", (unsigned long)turned);
+                ESP32SCALE_Init(8);
+                scaled = ESP32SCALE_Check();
+                printf("downscaling:       %lu wrong pixels\n", (unsigned long)scaled);
+                ESP32MAP_Init();
+                mapped = ESP32MAP_Check();
+                printf("colour mapping:    %lu wrong pixels\n", (unsigned long)mapped);
+                return (expanded || compared || turned || scaled || mapped) ? 1 : 0;
+            }
+            default:
+                usage(argv[0]);
+                return 2;
+        }
+    }
+
+    if (replaying_events && !stop_ticks_set) {
+        stop_ticks = UINT32_MAX;
+    }
+
+    HOSTAPI_SetImageDir(image_dir);
+    HOSTAPI_SetFastTime(fast);
+    HOSTAPI_SetPollHook(bench_poll);
+
+    signal(SIGUSR1, on_sigusr1);
+    signal(SIGINT, on_sigint);
+
+    char* emu_argv[] = { argv[0], NULL };
+    minivmac_main(1, emu_argv);
+
+    if (out_dir) {
+        dump_screen("screen_end");
+    }
+    report(fast);
+
+    if (replaying_events) {
+        uint32_t hash;
+
+        return ESP32EVT_GetResult(&hash) ? 0 : 1;
+    }
+
+    return 0;
+}
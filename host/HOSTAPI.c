@@ -0,0 +1,273 @@
+/*
+ Copyright (C) 2025  <uliuc@gmx.net >
+
+ This program is free software; you can redistribute it and/or modify it
+ under the terms of the GNU General Public License as published by the
+ Free Software Foundation; either version 3 of the License, or (at your
+ option) any later version.
+
+ This program is distributed in the hope that it will be useful, but
+ WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ for more details.
+
+ For the complete text of the GNU General Public License see
+ http://www.gnu.org/licenses/.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "ESP32API.h"
+#include "HOSTAPI.h"
+#include "esp_log.h"
+
+#include "SYSDEPNS.h"
+#include "MYOSGLUE.h"
+
+static const char* TAG = "HOSTAPI";
+
+static const char* image_dir = ".";
+
+// time: wall clock plus everything skipped in fast mode
+static bool fast_time = false;
+static uint64_t start_us = 0;
+static uint64_t skipped_us = 0;
+
+static void (*poll_hook)(void) = NULL;
+
+// last frame handed over by the emulator
+static const uint8_t* mac_fb = NULL;
+static bool Changed = false;
+static uint32_t frames = 0;
+
+void HOSTAPI_SetImageDir(const char* Dir)
+{
+    image_dir = Dir;
+}
+
+void HOSTAPI_SetFastTime(bool Fast)
+{
+    fast_time = Fast;
+}
+
+uint64_t HOSTAPI_GetWallTimeUS(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + (uint64_t)(ts.tv_nsec / 1000);
+}
+
+void HOSTAPI_SetPollHook(void (*Hook)(void))
+{
+    poll_hook = Hook;
+}
+
+bool HOSTAPI_WritePBM(const char* Path)
+{
+    FILE* f;
+    bool ok;
+
+    if (!mac_fb) {
+        return false;
+    }
+
+    f = fopen(Path, "wb");
+    if (!f) {
+        ESP_LOGE(TAG, "could not open %s", Path);
+        return false;
+    }
+
+    // Mac and PBM agree: msb first, 1 is black
+    fprintf(f, "P4\n%d %d\n", vMacScreenWidth, vMacScreenHeight);
+    ok = fwrite(mac_fb, 1, vMacScreenNumBytes, f) == (size_t)vMacScreenNumBytes;
+    fclose(f);
+
+    return ok;
+}
+
+uint32_t HOSTAPI_GetFrameCount(void)
+{
+    return frames;
+}
+
+static uint64_t host_time_us(void)
+{
+    if (start_us == 0) {
+        start_us = HOSTAPI_GetWallTimeUS();
+    }
+    return HOSTAPI_GetWallTimeUS() - start_us + skipped_us;
+}
+
+void ESP32API_GiveEmulatedMouseToESP32(int* EmMouseX, int* EmMouseY)
+{
+  // not used
+}
+
+// same epoch as the device, so the guest sees the same date
+uint64_t ESP32API_GetTimeMS(void)
+{
+    return 1591551981844ULL + (host_time_us() / 1000ULL);
+}
+
+uint64_t ESP32API_GetTimeUS(void)
+{
+    return host_time_us();
+}
+
+void ESP32API_Yield(void)
+{
+    if (fast_time) {
+        // the emulator only yields while it waits for the next ms
+        skipped_us += 1000 - (host_time_us() % 1000);
+    } else {
+        struct timespec ts = { 0, 200000 };
+        nanosleep(&ts, NULL);
+    }
+}
+
+void ESP32API_Delay(uint32_t MSToDelay)
+{
+    if (fast_time) {
+        skipped_us += (uint64_t)MSToDelay * 1000;
+    } else {
+        struct timespec ts = { MSToDelay / 1000, (MSToDelay % 1000) * 1000000L };
+        nanosleep(&ts, NULL);
+    }
+}
+
+ESP32File ESP32API_open(const char* Path, const char* Mode)
+{
+    char HostPath[1024];
+    snprintf(HostPath, sizeof(HostPath), "%s/%s", image_dir, Path);
+    return (ESP32File) fopen(HostPath, Mode);
+}
+
+void ESP32API_close(ESP32File Handle)
+{
+    if (Handle) {
+        fclose((FILE*) Handle);
+    }
+}
+
+size_t ESP32API_read(void* Buffer, size_t Size, size_t Nmemb, ESP32File Handle)
+{
+    size_t BytesRead = 0;
+    if (Handle) {
+        BytesRead = fread(Buffer, Size, Nmemb, (FILE*) Handle);
+    }
+
+    return BytesRead;
+}
+
+size_t ESP32API_write(const void* Buffer, size_t Size, size_t Nmemb, ESP32File Handle)
+{
+    size_t BytesWritten = 0;
+    if (Handle) {
+        BytesWritten = fwrite(Buffer, Size, Nmemb, (FILE*) Handle);
+    }
+    return BytesWritten;
+}
+
+// no flash to wait for here, so write right away
+void ESP32API_WriteStart(ESP32Write* Write, ESP32File Handle, const void* Buffer, size_t Size)
+{
+    Write->Handle = Handle;
+    Write->Buffer = Buffer;
+    Write->Size = Size;
+    Write->Failed = ESP32API_write(Buffer, 1, Size, Handle) != Size;
+    Write->Busy = false;
+}
+
+bool ESP32API_WriteWait(ESP32Write* Write)
+{
+    return !Write->Failed;
+}
+
+long ESP32API_tell(ESP32File Handle)
+{
+    long Offset = 0;
+    if (Handle) {
+        Offset = ftell((FILE*) Handle);
+    }
+    return Offset;
+}
+
+long ESP32API_seek(ESP32File Handle, long Offset, int Whence)
+{
+    if (Handle) {
+        return fseek((FILE*) Handle, Offset, Whence);
+    }
+    return -1;
+}
+
+int ESP32API_eof(ESP32File Handle)
+{
+    if (Handle) {
+        return feof((FILE*)Handle);
+    }
+    return 0;
+}
+
+void* ESP32API_malloc(size_t Size) {
+    return malloc(Size);
+}
+
+void* ESP32API_calloc(size_t Nmemb, size_t Size) {
+    return calloc(Nmemb, Size);
+}
+
+void ESP32API_free(void* Memory) {
+    free(Memory);
+}
+
+void ESP32API_CheckForEvents(void) {
+    if (poll_hook) {
+        poll_hook();
+    }
+}
+
+void ESP32API_ScreenChanged(int top, int left, int bottom, int right) {
+    Changed = true;
+}
+
+void ESP32API_SetScreenColors(int Depth, const uint16_t* Reds, const uint16_t* Greens, const uint16_t* Blues) {
+    // the screen dumps stay 1 bit
+    Changed = true;
+}
+
+uint32_t ESP32API_GetNextFrame(void) {
+    return frames + 1;
+}
+
+void ESP32API_DrawScreen(const uint8_t* new_fb) {
+    // keep the pointer even without changes, control mode swaps buffers
+    mac_fb = new_fb;
+    if (Changed) {
+        Changed = false;
+        frames++;
+    }
+}
+
+// no input link
+void ESP32API_GetInputStats(uint32_t* Wakeups, uint32_t* Packets, uint32_t* Coalesced, uint32_t* Errors) {
+    *Wakeups = 0;
+    *Packets = 0;
+    *Coalesced = 0;
+    *Errors = 0;
+}
+
+uint32_t ESP32API_GetDisplayLatencyUS(void) {
+    return 0;
+}
+
+// no display task, every frame is shown as it is handed over
+void ESP32API_GetFrameCounts(uint32_t* Produced, uint32_t* Consumed, uint32_t* Dropped) {
+    *Produced = frames;
+    *Consumed = frames;
+    *Dropped = 0;
+}
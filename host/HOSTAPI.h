@@ -0,0 +1,32 @@
+#ifndef _HOSTAPI_H_
+#define _HOSTAPI_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// headless Linux implementation of ESP32API.h
+//
+// Files are opened relative to an image directory instead of /spiffs,
+// there is no input, and the screen is only kept so it can be written to
+// a PBM file. Time either follows the wall clock or, in fast mode, skips
+// every wait of the emulator so it runs as fast as the host allows.
+
+// directory with vMac.ROM and disk1.dsk .. disk6.dsk
+void HOSTAPI_SetImageDir( const char* Dir );
+
+// skip waits instead of sleeping
+void HOSTAPI_SetFastTime( bool Fast );
+
+// wall clock, independent of fast mode
+uint64_t HOSTAPI_GetWallTimeUS( void );
+
+// called from ESP32API_CheckForEvents, i.e. at least once per tick
+void HOSTAPI_SetPollHook( void (*Hook)( void ) );
+
+// write the frame last handed to ESP32API_DrawScreen as binary PBM
+bool HOSTAPI_WritePBM( const char* Path );
+
+// frames handed over with changes since the start
+uint32_t HOSTAPI_GetFrameCount( void );
+
+#endif
@@ -0,0 +1,359 @@
+/*
+ Copyright (C) 2025  <uliuc@gmx.net >
+
+ This program is free software; you can redistribute it and/or modify it
+ under the terms of the GNU General Public License as published by the
+ Free Software Foundation; either version 3 of the License, or (at your
+ option) any later version.
+
+ This program is distributed in the hope that it will be useful, but
+ WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ for more details.
+
+ For the complete text of the GNU General Public License see
+ http://www.gnu.org/licenses/.
+
+*/
+
+// reader for screen recordings (ESP32REC.h)
+//
+// Replays the records of a recording from the device or from
+// minivmac_bench -w and writes the frames of a range of ticks as PGM or
+// PNG images, or just the screen as it was at one tick. Without any
+// output it only checks the file and prints the record sizes.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "ESP32REC.h"
+
+static const char* out_dir = NULL;
+static bool png = false;
+static uint32_t first_tick = 0;
+static uint32_t last_tick = UINT32_MAX;
+static bool at_tick = false;
+
+static int width = 0;
+static int height = 0;
+static uint8_t* frame = NULL;
+
+static uint32_t get16(const uint8_t* p)
+{
+    return p[0] | ((uint32_t)p[1] << 8);
+}
+
+static uint32_t get32(const uint8_t* p)
+{
+    return get16(p) | (get16(p + 2) << 16);
+}
+
+// xor the coded data into the rectangle, false if they do not fit it
+static bool apply(const uint8_t* data, uint32_t length,
+    int top, int left, int bottom, int right)
+{
+    uint32_t row_bytes = (right - left) / 8;
+    uint32_t total = row_bytes * (bottom - top);
+    uint32_t pos = 0;
+    uint32_t i = 0;
+
+    while (i < length) {
+        uint32_t n = data[i++];
+
+        if (n < 128) {
+            // zeros leave the frame as it is
+            pos += n + 1;
+        } else {
+            n -= 127;
+            if (i + n > length || pos + n > total) {
+                return false;
+            }
+            for (uint32_t k = 0; k < n; k++, pos++) {
+                uint32_t y = top + pos / row_bytes;
+                uint32_t x = left / 8 + pos % row_bytes;
+                frame[y * (width / 8) + x] ^= data[i++];
+            }
+        }
+    }
+
+    return pos == total;
+}
+
+static bool write_pgm(const char* path)
+{
+    FILE* f = fopen(path, "wb");
+
+    if (!f) {
+        return false;
+    }
+    fprintf(f, "P5\n%d %d\n255\n", width, height);
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            // Mac: 1 is black
+            fputc((frame[y * (width / 8) + x / 8] & (0x80 >> (x & 7))) ? 0 : 255, f);
+        }
+    }
+    return fclose(f) == 0;
+}
+
+static uint32_t crc_table[256];
+
+static uint32_t png_crc(uint32_t crc, const uint8_t* p, uint32_t n)
+{
+    if (crc_table[1] == 0) {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++) {
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            }
+            crc_table[i] = c;
+        }
+    }
+    crc = ~crc;
+    while (n--) {
+        crc = crc_table[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+static void put_be32(uint8_t* p, uint32_t v)
+{
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+static void png_chunk(FILE* f, const char* type, const uint8_t* data, uint32_t n)
+{
+    uint8_t b[4];
+    uint32_t crc;
+
+    put_be32(b, n);
+    fwrite(b, 1, 4, f);
+    fwrite(type, 1, 4, f);
+    if (n != 0) {
+        // IEND has no data
+        fwrite(data, 1, n, f);
+    }
+    crc = png_crc(png_crc(0, (const uint8_t*)type, 4), data, n);
+    put_be32(b, crc);
+    fwrite(b, 1, 4, f);
+}
+
+// 1 bit gray, zlib stream of stored blocks, no compression library needed
+static bool write_png(const char* path)
+{
+    static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    uint32_t row_bytes = width / 8;
+    uint32_t raw_size = (row_bytes + 1) * height;
+    uint32_t blocks = (raw_size + 65534) / 65535;
+    uint8_t* raw = malloc(raw_size);
+    uint8_t* z = malloc(2 + raw_size + blocks * 5 + 4);
+    uint8_t ihdr[13];
+    uint32_t a = 1;
+    uint32_t b = 0;
+    uint32_t n = 0;
+    FILE* f;
+
+    if (!raw || !z) {
+        free(raw);
+        free(z);
+        return false;
+    }
+
+    for (int y = 0; y < height; y++) {
+        raw[y * (row_bytes + 1)] = 0;
+        for (uint32_t x = 0; x < row_bytes; x++) {
+            // PNG: 0 is black
+            raw[y * (row_bytes + 1) + 1 + x] = ~frame[y * row_bytes + x];
+        }
+    }
+
+    z[n++] = 0x78;
+    z[n++] = 0x01;
+    for (uint32_t pos = 0; pos < raw_size; ) {
+        uint32_t len = raw_size - pos < 65535 ? raw_size - pos : 65535;
+
+        z[n++] = (pos + len == raw_size) ? 1 : 0;
+        z[n++] = len;
+        z[n++] = len >> 8;
+        z[n++] = ~len;
+        z[n++] = ~len >> 8;
+        memcpy(z + n, raw + pos, len);
+        n += len;
+        pos += len;
+    }
+    for (uint32_t i = 0; i < raw_size; i++) {
+        a = (a + raw[i]) % 65521;
+        b = (b + a) % 65521;
+    }
+    put_be32(z + n, (b << 16) | a);
+    n += 4;
+
+    put_be32(ihdr, width);
+    put_be32(ihdr + 4, height);
+    ihdr[8] = 1;  // bit depth
+    ihdr[9] = 0;  // gray
+    ihdr[10] = 0;
+    ihdr[11] = 0;
+    ihdr[12] = 0;
+
+    f = fopen(path, "wb");
+    if (f) {
+        fwrite(signature, 1, sizeof(signature), f);
+        png_chunk(f, "IHDR", ihdr, sizeof(ihdr));
+        png_chunk(f, "IDAT", z, n);
+        png_chunk(f, "IEND", NULL, 0);
+    }
+
+    free(raw);
+    free(z);
+
+    return f && fclose(f) == 0;
+}
+
+static bool write_frame(uint32_t tick)
+{
+    char path[1024];
+
+    snprintf(path, sizeof(path), "%s/frame_%06lu.%s", out_dir,
+        (unsigned long)tick, png ? "png" : "pgm");
+    if (!(png ? write_png(path) : write_pgm(path))) {
+        fprintf(stderr, "could not write %s\n", path);
+        return false;
+    }
+    return true;
+}
+
+static void usage(const char* prog)
+{
+    fprintf(stderr,
+        "usage: %s [options] file\n"
+        "  -o dir   write the frames to dir\n"
+        "  -f tick  first tick to write (default 0)\n"
+        "  -l tick  last tick to write (default all)\n"
+        "  -t tick  only write the screen as it was at this tick\n"
+        "  -p       write PNG instead of PGM\n",
+        prog);
+}
+
+int main(int argc, char** argv)
+{
+    uint8_t header[ESP32REC_HEADER_SIZE];
+    uint8_t rec[ESP32REC_RECORD_SIZE];
+    uint8_t* data = NULL;
+    uint32_t data_size = 0;
+    uint32_t records = 0;
+    uint32_t written = 0;
+    uint64_t bytes = 0;
+    uint32_t tick = 0;
+    bool tick_written = false;
+    FILE* f;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "o:f:l:t:ph")) != -1) {
+        switch (opt) {
+            case 'o':
+                out_dir = optarg;
+                break;
+            case 'f':
+                first_tick = strtoul(optarg, NULL, 0);
+                break;
+            case 'l':
+                last_tick = strtoul(optarg, NULL, 0);
+                break;
+            case 't':
+                first_tick = last_tick = strtoul(optarg, NULL, 0);
+                at_tick = true;
+                break;
+            case 'p':
+                png = true;
+                break;
+            default:
+                usage(argv[0]);
+                return 2;
+        }
+    }
+    if (optind + 1 != argc) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    f = fopen(argv[optind], "rb");
+    if (!f) {
+        fprintf(stderr, "could not open %s\n", argv[optind]);
+        return 1;
+    }
+    if (fread(header, 1, sizeof(header), f) != sizeof(header)
+            || memcmp(header, ESP32REC_MAGIC, 4) != 0) {
+        fprintf(stderr, "not a screen recording\n");
+        return 1;
+    }
+    width = get16(header + 4);
+    height = get16(header + 6);
+    frame = calloc(1, (width / 8) * height);
+    if (!frame || (width & 7) != 0) {
+        fprintf(stderr, "bad screen size %dx%d\n", width, height);
+        return 1;
+    }
+
+    while (fread(rec, 1, sizeof(rec), f) == sizeof(rec)) {
+        uint32_t rec_tick = get32(rec);
+        int top = get16(rec + 4);
+        int left = get16(rec + 6);
+        int bottom = get16(rec + 8);
+        int right = get16(rec + 10);
+        uint32_t length = get32(rec + 12);
+
+        if (top > bottom || bottom > height || left > right || right > width
+                || ((left | right) & 7) != 0) {
+            fprintf(stderr, "record %lu: bad rectangle\n", (unsigned long)records);
+            return 1;
+        }
+        if (length > data_size) {
+            data_size = length;
+            data = realloc(data, data_size);
+        }
+        if (fread(data, 1, length, f) != length) {
+            fprintf(stderr, "record %lu: cut off\n", (unsigned long)records);
+            break;
+        }
+
+        // the screen at -t is complete once a later tick comes
+        if (at_tick && out_dir && !tick_written && records != 0
+                && tick <= first_tick && rec_tick > first_tick) {
+            tick_written = true;
+            written += write_frame(first_tick) ? 1 : 0;
+        }
+
+        if (!apply(data, length, top, left, bottom, right)) {
+            fprintf(stderr, "record %lu: bad data\n", (unsigned long)records);
+            return 1;
+        }
+        tick = rec_tick;
+        records++;
+        bytes += ESP32REC_RECORD_SIZE + length;
+
+        if (!at_tick && out_dir && tick >= first_tick && tick <= last_tick) {
+            if (write_frame(tick)) {
+                written++;
+            }
+        }
+    }
+    if (at_tick && out_dir && !tick_written && records != 0 && tick <= first_tick) {
+        written += write_frame(first_tick) ? 1 : 0;
+    }
+    fclose(f);
+
+    fprintf(stderr, "%dx%d, %lu records up to tick %lu, %.1f bytes per record, %lu frames written\n",
+        width, height, (unsigned long)records, (unsigned long)tick,
+        records ? (double)bytes / records : 0.0, (unsigned long)written);
+
+    free(data);
+    free(frame);
+
+    return 0;
+}
@@ -0,0 +1,12 @@
+#ifndef _ESP_ATTR_H_
+#define _ESP_ATTR_H_
+
+// host build: no IRAM/DRAM placement
+
+#include "sdkconfig.h"
+
+#define IRAM_ATTR
+#define DRAM_ATTR
+#define EXT_RAM_BSS_ATTR
+
+#endif
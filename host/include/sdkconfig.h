@@ -0,0 +1,30 @@
+#ifndef _SDKCONFIG_H_
+#define _SDKCONFIG_H_
+
+// host build: stands in for the sdkconfig.h generated by ESP-IDF
+//
+// The governor, power management, tracer and cycle counters of the ESP32
+// port depend on the display task, esp_pm and CCOUNT, so they stay off
+// here. The emulated machine is configured by CNFGGLOB.h and CNFGRAPI.h
+// only, and is the same as on the device.
+
+#define CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ 240
+
+// core options, as on the device
+#define CONFIG_MINIVMAC_SCREEN_DIRTY_ROWS 1
+
+// input ring and emulator event queue, 64 entries each
+#define CONFIG_MINIVMAC_INPUT_RING_LG2 6
+#define CONFIG_MINIVMAC_EVTQ_LG2 6
+
+// screen recording, started by minivmac_bench -w instead of from a
+// file named here
+#define CONFIG_MINIVMAC_RECORD 1
+
+// VNC server, started by minivmac_bench -v on loopback or a UNIX socket
+#define CONFIG_MINIVMAC_RFB 1
+
+// input recording and replay, started by minivmac_bench -e and -E
+#define CONFIG_MINIVMAC_EVENTS 1
+
+#endif
@@ -18,37 +18,49 @@
 */
 
 #include <string.h>
+#include <limits.h>
 
 #include "ESP32API.h"
+#include "ESP32POWER.h"
+#include "ESP32TRACE.h"
+#include "ESP32LAT.h"
+#include "ESP32CONV.h"
+#include "ESP32DIFF.h"
+#include "ESP32RFB.h"
+#include "ESP32SCALE.h"
+#include "ESP32MAP.h"
+#include "ESP32INPUT.h"
 #include "esp_timer.h"
+#include "esp_cpu.h"
 #include "esp_spiffs.h"
 #include "esp_err.h"
 #include "esp_log.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/queue.h"
 #include "lvgl.h"
 #include "esp_lv_adapter.h"
 #include "driver/uart.h"
 #include "driver/gpio.h"
+#if defined(CONFIG_MINIVMAC_DISPLAY_BOUNCE) || defined(CONFIG_MINIVMAC_DISPLAY_IDLE)
+#include "esp_lcd_panel_rgb.h"
+#endif
 
 #include "SYSDEPNS.h"
 
 static const char* TAG = "ESP32API";
 
 // mouse and keyboard functions
-FORWARDPROC DoKeyCode(int key_code, blnr down);
 static uart_port_t s_rx_uart;
+static QueueHandle_t s_rx_queue;
 static int s_rx_tx; // S3 TX (geht zum ESP32 RX)
 static int s_rx_rx; // S3 RX (kommt vom ESP32 TX)
 
-// combine mouse events
-static int g_mouse_dx = 0;
-static int g_mouse_dy = 0;
-static uint8_t g_mouse_buttons = 0;
-static bool mouse_btn_state = false;
-
-static SemaphoreHandle_t g_mouse_mutex;
-static SemaphoreHandle_t upd_area_mutex = NULL;
+// UART driver events, characters of idle line before the rx timeout
+// event, and bytes in the rx FIFO before the full event
+#define HID_EVENT_QUEUE_LEN 16
+#define HID_RX_TIMEOUT 2
+#define HID_RX_FULL 64
 
 void hid_link_uart_init_rx(uart_port_t uart, int tx_pin, int rx_pin, int baud)
 {
@@ -66,69 +78,86 @@ void hid_link_uart_init_rx(uart_port_t uart, int tx_pin, int rx_pin, int baud)
     };
     uart_param_config(uart, &cfg);
     uart_set_pin(uart, tx_pin, rx_pin, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE);
-    uart_driver_install(uart, 2048, 0, 0, NULL, ESP_INTR_FLAG_IRAM);
+    uart_driver_install(uart, 2048, 0, HID_EVENT_QUEUE_LEN, &s_rx_queue, ESP_INTR_FLAG_IRAM);
+    // the packets are binary, so no pattern detection: a packet ends a
+    // burst and the line going idle for a few characters wakes the task
+    uart_set_rx_timeout(uart, HID_RX_TIMEOUT);
+    uart_set_rx_full_threshold(uart, HID_RX_FULL);
 }
 
-bool hid_link_data_available(size_t min_bytes)
+// input statistics, since start
+static volatile uint32_t hid_wakeups = 0;
+static volatile uint32_t hid_packets = 0;
+static volatile uint32_t hid_coalesced = 0; // mouse packets merged into one before
+static volatile uint32_t hid_errors = 0; // bytes skipped, events lost
+
+// bytes read, up to the end of the last complete packet taken
+#define HID_RX_BUF 256
+#define HID_MAX_PAYLOAD 64
+static uint8_t hid_rx[HID_RX_BUF];
+static int hid_rx_len = 0;
+
+static void hid_packet(char type, const uint8_t* payload, uint16_t len, int64_t wake_us);
+
+// take the complete packets [type][len_lo][len_hi][payload][xor] at the
+// front of hid_rx and keep what is left of a partial one
+static void hid_link_parse(int64_t wake_us)
 {
-    size_t avail = 0;
-    if (uart_get_buffered_data_len(s_rx_uart, &avail) == ESP_OK) {
-        return avail >= min_bytes; 
+    int pos = 0;
+
+    while (hid_rx_len - pos >= 3) {
+        const uint8_t* p = hid_rx + pos;
+        char type = (char)p[0];
+        uint16_t len = (uint16_t)(p[1] | (p[2] << 8));
+
+        if ((type != 'M' && type != 'K') || len > HID_MAX_PAYLOAD) {
+            // not a header, look at the next byte
+            pos++;
+            hid_errors++;
+            continue;
+        }
+        if (hid_rx_len - pos < 3 + len + 1) {
+            break;
+        }
+
+        // XOR over header and payload
+        uint8_t calc = p[0] ^ p[1] ^ p[2];
+        for (uint16_t i = 0; i < len; ++i) {
+            calc ^= p[3 + i];
+        }
+        if (calc != p[3 + len]) {
+            // wrong checksum -> ignore packet
+            pos++;
+            hid_errors++;
+            continue;
+        }
+
+        hid_packet(type, p + 3, len, wake_us);
+        hid_packets++;
+        pos += 3 + len + 1;
     }
-    return false;
+
+    memmove(hid_rx, hid_rx + pos, hid_rx_len - pos);
+    hid_rx_len -= pos;
 }
 
-bool hid_link_read_packet(char *type_out, uint8_t *buf, uint16_t buf_size, uint16_t *len_out, TickType_t timeout_ticks)
+// everything buffered by the driver, packet by packet
+// take all bytes the driver has, returns how many
+static int hid_link_drain(int64_t wake_us)
 {
-    if (!type_out || !buf || !len_out) return false;
-    
-    uint8_t hdr[3];
-    int n = uart_read_bytes(s_rx_uart, hdr, 3, timeout_ticks);
-    if (n != 3) return false;
-    
-    char type = (char)hdr[0];
-    if (type != 'M' && type != 'K') {
-        // unkown type
-        return false;
-    }
-    
-    uint16_t len = (uint16_t)(hdr[1] | (hdr[2] << 8));
-    
-    if (len > buf_size) {
-        uint16_t remaining = len + 1; // +1 for checksum
-        uint8_t dump[64];
-        while (remaining) {
-            int chunk = remaining > sizeof(dump) ? sizeof(dump) : remaining;
-            int got = uart_read_bytes(s_rx_uart, dump, chunk, pdMS_TO_TICKS(10));
-            if (got <= 0) break;
-            remaining -= (uint16_t)got;
+    int total = 0;
+    int n;
+
+    do {
+        n = uart_read_bytes(s_rx_uart, hid_rx + hid_rx_len, HID_RX_BUF - hid_rx_len, 0);
+        if (n > 0) {
+            hid_rx_len += n;
+            total += n;
+            hid_link_parse(wake_us);
         }
-        return false;
-    }
-    
-    // read payload
-    int got = uart_read_bytes(s_rx_uart, buf, len, timeout_ticks);
-    if (got != len) return false;
-    
-    // read checksum
-    uint8_t rx_chk = 0;
-    got = uart_read_bytes(s_rx_uart, &rx_chk, 1, timeout_ticks);
-    if (got != 1) return false;
-    
-    // XOR over header and payload
-    uint8_t calc = hdr[0] ^ hdr[1] ^ hdr[2];
-    for (uint16_t i = 0; i < len; ++i) {
-        calc ^= buf[i];
-    }
-    
-    if (calc != rx_chk) {
-        // wrong checksum -> ignore packet
-        return false;
-    }
-    
-    *type_out = type;
-    *len_out = len;
-    return true;
+    } while (n > 0);
+
+    return total;
 }
 
 // button helper
@@ -180,126 +209,243 @@ bool keyboard_parse(const uint8_t *data, uint16_t len, int16_t *keycode, int16_t
     return true;
 }
     
+// the emulator takes events once per tick; keys and buttons wait for
+// room up to HID_PUT_TRIES ms, then they are lost
+#define HID_PUT_TRIES 50
+
+static void hid_put(ESP32INPUT_Event* ev, int64_t wake_us)
+{
+    ev->TimeUS = (uint32_t)wake_us;
+    for (int i = 0; !ESP32INPUT_Put(ev); i++) {
+        if (i == HID_PUT_TRIES) {
+            hid_errors++;
+            return;
+        }
+        ESP32POWER_Delay(1);
+    }
+}
+
+static void hid_key(int key_code, bool down, int64_t wake_us)
+{
+    ESP32INPUT_Event ev = {
+        .Type = ESP32INPUT_KEY,
+        .Code = (uint8_t)key_code,
+        .Down = down,
+    };
+
+    hid_put(&ev, wake_us);
+}
+
 static int16_t prev_keycode = 0; 
 static int16_t prev_modifier = 0;
     
-void mousekeyboard_task(void *arg)
+static void keyboard_packet(const uint8_t* payload, uint16_t len, int64_t wake_us)
 {
-    g_mouse_mutex = xSemaphoreCreateMutex();
-    if (!g_mouse_mutex) {
-        ESP_LOGE(TAG, "mouse mutex creation failed");
-        vTaskDelete(NULL);
-        return;
+    ESP_LOGI(TAG, "keyboard event");
+    dump_raw(payload, len);
+    int16_t keycode = 0;
+    int16_t modifier = 0;
+    
+    if (keyboard_parse(payload, len, &keycode, &modifier)) {
+        
+        ESP_LOGD(TAG, "Keycode: %02X, Modifier: %02X", keycode, modifier);
+    
+        // modifier are own keys
+        if (modifier == 0) {
+            if (prev_modifier > 0) {
+                hid_key(prev_modifier, false, wake_us);
+                prev_modifier = 0;
+            }
+        } else {
+            if (modifier & 0x02) {
+            
+                // left shift keydown
+                hid_key(0xE1, true, wake_us);
+                prev_modifier = 0xE1;
+            } 
+            else if (modifier & 0x20) {
+                // right shift keydown
+                hid_key(0xE5, true, wake_us);
+                prev_modifier = 0xE5;
+            }
+            else if (modifier & 0x01) {
+                // left control keydown
+                hid_key(0xE0, true, wake_us);
+                prev_modifier = 0xE0;
+            }
+            else if (modifier & 0x01) {
+                // right control keydown
+                hid_key(0xE4, true, wake_us);
+                prev_modifier = 0xE4;
+            }
+            else if (modifier & 0x04) {
+                // left option keydown (left alt)
+                hid_key(0xE2, true, wake_us);
+                prev_modifier = 0xE2;
+            }
+            else if (modifier & 0x40) {
+                // right option keydown (right alt)
+                hid_key(0xE6, true, wake_us);
+                prev_modifier = 0xE6;
+            }
+            else if (modifier & 0x08) {
+                // left command keydown (left command/gui/meta)
+                hid_key(0xE3, true, wake_us);
+                prev_modifier = 0xE3;
+            }
+            else if (modifier & 0x80) {
+                // right command keydown (right command/gui/meta)
+                hid_key(0xE7, true, wake_us);
+                prev_modifier = 0xE7;
+            }
+        }
+    
+        if (keycode == 0) {
+            if (prev_keycode > 0) {
+                hid_key(prev_keycode, false, wake_us);
+                prev_keycode = 0;
+            }
+        } else { 
+            hid_key(keycode, true, wake_us);
+            prev_keycode = keycode;
+        }
+    }
+}
+
+// mouse packets of one wake up with the same buttons, added up before they
+// go to the emulator in one go
+static int hid_pend_dx = 0;
+static int hid_pend_dy = 0;
+static uint8_t hid_pend_buttons = 0;
+static int hid_pend_count = 0;
+static int64_t hid_pend_since_us = 0;
+static bool hid_sent_button = false;
+
+static int16_t hid_clamp16(int v)
+{
+    return (v > INT16_MAX) ? INT16_MAX : (v < -INT16_MAX) ? -INT16_MAX : v;
+}
+
+// movement that does not fit the ring stays pending and is added to the
+// next; before a click or a key it waits like they do, to keep the order
+static void hid_mouse_flush(bool wait)
+{
+    int tries = 0;
+
+    while (hid_pend_dx != 0 || hid_pend_dy != 0) {
+        ESP32INPUT_Event ev = {
+            .TimeUS = (uint32_t)hid_pend_since_us,
+            .Type = ESP32INPUT_DELTA,
+            .DX = hid_clamp16(hid_pend_dx),
+            .DY = hid_clamp16(hid_pend_dy),
+        };
+
+        if (ESP32INPUT_Put(&ev)) {
+            hid_pend_dx -= ev.DX;
+            hid_pend_dy -= ev.DY;
+        } else if (wait && tries++ < HID_PUT_TRIES) {
+            ESP32POWER_Delay(1);
+        } else {
+            return;
+        }
+    }
+
+    hid_pend_count = 0;
+}
+
+static void hid_mouse_button(uint8_t buttons, int64_t wake_us)
+{
+    bool down = mouse_btn_left(buttons);
+
+    if (down != hid_sent_button) {
+        ESP32INPUT_Event ev = {
+            .Type = ESP32INPUT_BUTTON,
+            .Down = down,
+        };
+
+        hid_put(&ev, wake_us);
+        hid_sent_button = down;
+    }
+}
+
+static void hid_packet(char type, const uint8_t* payload, uint16_t len, int64_t wake_us)
+{
+    if (type == 'M') {
+        uint8_t buttons = 0;
+        int16_t dx = 0;
+        int16_t dy = 0;
+
+        dump_raw(payload, len);
+
+        if (mouse_parse_rel16_le(payload, len, &dx, &dy, &buttons)) {
+
+            ESP_LOGD(TAG, "X:%d, Y:%d, B:%d", dx, dy, buttons);
+
+            // a click goes on its own, after the movement before it
+            if (buttons != hid_pend_buttons) {
+                hid_mouse_flush(true);
+                hid_mouse_button(buttons, wake_us);
+            }
+            if (hid_pend_count == 0) {
+                hid_pend_since_us = wake_us;
+            } else {
+                hid_coalesced++;
+            }
+            hid_pend_dx += dx;
+            hid_pend_dy += dy;
+            hid_pend_buttons = buttons;
+            hid_pend_count++;
+        }
     }
+    else if (type == 'K') {
+        // keys after the mouse movement sent before them
+        hid_mouse_flush(true);
+        keyboard_packet(payload, len, wake_us);
+    }
+}
 
+// sleeps until the UART driver has bytes (rx FIFO threshold or the line
+// idle for HID_RX_TIMEOUT characters) and then takes all of them; the
+// UART_DATA events queued behind the first find nothing left to read and
+// are not counted as wake ups. Movement the ring had no room for is
+// tried again every tick, without waiting for more bytes.
+void mousekeyboard_task(void *arg)
+{
     while (1) {
+        uart_event_t event;
+        bool pending = hid_pend_dx != 0 || hid_pend_dy != 0;
 
-        if (hid_link_data_available(3)) {
-
-            char type;
-            uint16_t len = 0;
-            uint8_t payload[64];
-            uint8_t buttons = 0;
-            int16_t dx = 0;
-            int16_t dy = 0;
-
-            // non-blocking read, last argument timeout=0
-            if (hid_link_read_packet(&type, payload, sizeof(payload), &len, 0)) {
-
-                if (type == 'M') {
-                    
-                    dump_raw(payload, len); 
-                    
-                    if (mouse_parse_rel16_le(payload, len, &dx, &dy, &buttons)) {
-
-                        ESP_LOGD(TAG, "X:%d, Y:%d, B:%d", dx, dy, buttons);
-
-                        // accumulate movement
-                        if (xSemaphoreTake(g_mouse_mutex, portMAX_DELAY)) {
-                            g_mouse_dx += dx;
-                            g_mouse_dy += dy;
-                            g_mouse_buttons = buttons;
-                            xSemaphoreGive(g_mouse_mutex);
-                        }
-                    }
-                }
-                else if (type == 'K') {
-                    
-                    ESP_LOGI(TAG, "keyboard event");
-                    dump_raw(payload, len);
-                    int16_t keycode = 0;
-                    int16_t modifier = 0;
-                    
-                    if (keyboard_parse(payload, len, &keycode, &modifier)) {
-                        
-                        ESP_LOGD(TAG, "Keycode: %02X, Modifier: %02X", keycode, modifier);
-                    
-                        // modifier are own keys
-                        if (modifier == 0) {
-                            if (prev_modifier > 0) {
-                                DoKeyCode(prev_modifier, falseblnr);
-                                prev_modifier = 0;
-                            }
-                        } else {
-                            if (modifier & 0x02) {
-                            
-                                // left shift keydown
-                                DoKeyCode(0xE1, trueblnr);
-                                prev_modifier = 0xE1;
-                            } 
-                            else if (modifier & 0x20) {
-                                // right shift keydown
-                                DoKeyCode(0xE5, trueblnr);
-                                prev_modifier = 0xE5;
-                            }
-                            else if (modifier & 0x01) {
-                                // left control keydown
-                                DoKeyCode(0xE0, trueblnr);
-                                prev_modifier = 0xE0;
-                            }
-                            else if (modifier & 0x01) {
-                                // right control keydown
-                                DoKeyCode(0xE4, trueblnr);
-                                prev_modifier = 0xE4;
-                            }
-                            else if (modifier & 0x04) {
-                                // left option keydown (left alt)
-                                DoKeyCode(0xE2, trueblnr);
-                                prev_modifier = 0xE2;
-                            }
-                            else if (modifier & 0x40) {
-                                // right option keydown (right alt)
-                                DoKeyCode(0xE6, trueblnr);
-                                prev_modifier = 0xE6;
-                            }
-                            else if (modifier & 0x08) {
-                                // left command keydown (left command/gui/meta)
-                                DoKeyCode(0xE3, trueblnr);
-                                prev_modifier = 0xE3;
-                            }
-                            else if (modifier & 0x80) {
-                                // right command keydown (right command/gui/meta)
-                                DoKeyCode(0xE7, trueblnr);
-                                prev_modifier = 0xE7;
-                            }
-                        }
-                    
-                        if (keycode == 0) {
-                            if (prev_keycode > 0) {
-                                DoKeyCode(prev_keycode, falseblnr);
-                                prev_keycode = 0;
-                            }
-                        } else { 
-                            DoKeyCode(keycode, trueblnr);
-                            prev_keycode = keycode;
-                        }
-                    }
+        if (xQueueReceive(s_rx_queue, &event, pending ? 1 : portMAX_DELAY) != pdTRUE) {
+            hid_mouse_flush(false);
+            continue;
+        }
+
+        int64_t wake_us = esp_timer_get_time();
+
+        TRACE_BEGIN(TRACE_INPUT_PACKET);
+
+        switch (event.type) {
+            case UART_DATA:
+                if (hid_link_drain(wake_us) > 0) {
+                    hid_wakeups++;
                 }
-            }
+                break;
+            case UART_FIFO_OVF:
+            case UART_BUFFER_FULL:
+                // bytes are lost, start over at the next header
+                ESP_LOGW(TAG, "hid link overflow");
+                uart_flush_input(s_rx_uart);
+                xQueueReset(s_rx_queue);
+                hid_rx_len = 0;
+                hid_wakeups++;
+                hid_errors++;
+                break;
+            default:
+                break;
         }
+        hid_mouse_flush(false);
 
-        // small delay to avoid starving other tasks
-        vTaskDelay(pdMS_TO_TICKS(1));
+        TRACE_END(TRACE_INPUT_PACKET);
     }
 }
 
@@ -312,21 +458,824 @@ void mousekeyboard_task(void *arg)
 #define X_OFF (SCREEN_WIDTH - EMU_WIDTH)/2
 #define Y_OFF (SCREEN_HEIGHT - EMU_HEIGHT)/2
 
+// turned to the panel orientation while converting: LVGL runs unturned on
+// the 480 x 640 panel, and the image is EMU_HEIGHT wide, at the place the
+// turned screen would put it
+#if defined(CONFIG_MINIVMAC_TURN_CONV_90) || defined(CONFIG_MINIVMAC_TURN_CONV_270)
+#define EMU_TURNED 1
+#else
+#define EMU_TURNED 0
+#endif
+#ifdef CONFIG_MINIVMAC_TURN_CONV_270
+#define EMU_TURN_270 1
+#else
+#define EMU_TURN_270 0
+#endif
+
+// downscaled to gray levels, centered
+#if defined(CONFIG_MINIVMAC_SCALE_4_3) || defined(CONFIG_MINIVMAC_SCALE_3_2)
+#define EMU_SCALED 1
+#else
+#define EMU_SCALED 0
+#endif
+
+#if EMU_TURNED
+#define IMG_W EMU_HEIGHT
+#define IMG_H EMU_WIDTH
+#define IMG_X Y_OFF
+#define IMG_Y (EMU_TURN_270 ? X_OFF : SCREEN_WIDTH - X_OFF - EMU_WIDTH)
+#elif EMU_SCALED
+#define IMG_W ESP32SCALE_WIDTH
+#define IMG_H ESP32SCALE_HEIGHT
+#define IMG_X ((SCREEN_WIDTH - IMG_W) / 2)
+#define IMG_Y ((SCREEN_HEIGHT - IMG_H) / 2)
+#else
+#define IMG_W EMU_WIDTH
+#define IMG_H EMU_HEIGHT
+#define IMG_X X_OFF
+#define IMG_Y Y_OFF
+#endif
+
+// bits per pixel of a colour Mac screen, as log2; it can be switched to
+// 1 bit, so each snapshot carries the depth it was taken in
+#define FRAME_DEPTH vMacScreenDepth
+#if FRAME_DEPTH != 0
+#if FRAME_DEPTH > 3
+#error "only indexed colour screens, up to 8 bits per pixel"
+#endif
+#if EMU_TURNED || EMU_SCALED || defined(CONFIG_MINIVMAC_DISPLAY_INDEXED) \
+    || defined(CONFIG_MINIVMAC_DISPLAY_BOUNCE) || defined(CONFIG_MINIVMAC_DISPLAY_OFFLOAD)
+#error "colour screens only have the plain RGB565 image"
+#endif
+#endif
+
 static SemaphoreHandle_t newframe_sem = NULL;
-const uint8_t* mac_fb = NULL;
+#ifndef CONFIG_MINIVMAC_DISPLAY_BOUNCE
+#ifndef CONFIG_MINIVMAC_DISPLAY_INDEXED
 static lv_color_t *emu_buf;
+#endif
 static lv_img_dsc_t emu_img_dsc;
 static lv_obj_t *emu_img; 
+#endif
+
+// update areas: minivmac sends info about partial screen updates, one
+// band of changed rows at a time. They are kept apart until they overlap
+// or touch, or until the list is full. Right and bottom are exclusive.
+#define UPD_MAX_RECTS CONFIG_MINIVMAC_DIRTY_RECTS
+
+typedef struct {
+    int l, t, r, b;
+} upd_rect_t;
+
+typedef struct {
+    upd_rect_t rects[UPD_MAX_RECTS];
+    int count;
+} upd_list_t;
+
+static bool upd_rect_touches(const upd_rect_t* a, const upd_rect_t* b)
+{
+    return a->l <= b->r && b->l <= a->r && a->t <= b->b && b->t <= a->b;
+}
+
+static void upd_rect_union(upd_rect_t* a, const upd_rect_t* b)
+{
+    if (b->l < a->l) a->l = b->l;
+    if (b->t < a->t) a->t = b->t;
+    if (b->r > a->r) a->r = b->r;
+    if (b->b > a->b) a->b = b->b;
+}
+
+static int upd_rect_area(const upd_rect_t* a)
+{
+    return (a->r - a->l) * (a->b - a->t);
+}
+
+static void upd_rect_add(upd_list_t* list, upd_rect_t n)
+{
+    while (true) {
+        // absorb everything the new rect touches, the union may touch more
+        for (int i = 0; i < list->count; i++) {
+            if (upd_rect_touches(&list->rects[i], &n)) {
+                upd_rect_union(&n, &list->rects[i]);
+                list->rects[i] = list->rects[--list->count];
+                i = -1;
+            }
+        }
+
+        if (list->count < UPD_MAX_RECTS) {
+            list->rects[list->count++] = n;
+            return;
+        }
+
+        // list full: merge with the rect that grows the least
+        int best = 0;
+        int best_growth = INT_MAX;
+        for (int i = 0; i < list->count; i++) {
+            upd_rect_t u = list->rects[i];
+            upd_rect_union(&u, &n);
+            int growth = upd_rect_area(&u) - upd_rect_area(&list->rects[i]);
+            if (growth < best_growth) {
+                best_growth = growth;
+                best = i;
+            }
+        }
+        upd_rect_union(&n, &list->rects[best]);
+        list->rects[best] = list->rects[--list->count];
+    }
+}
+
+// frames: the emulator copies the changed rows of each frame into one of
+// three 1bpp snapshots in internal RAM and publishes it by swapping its
+// index into frame_latest. The display task swaps the newest snapshot
+// out the same way, so neither side ever waits for the other, and the
+// display task never reads guest RAM the 68k is drawing into.
+//
+// A snapshot published again before the display task took it is dropped.
+// Each snapshot lists the areas changed since the last one the display
+// task took, from a short history of the areas of each frame, so nothing
+// of a dropped frame is missed.
+//
+// With the search for changes offloaded, the emulator only copies the
+// rows the 68k wrote to and lists them, the same way. The display task
+// compares them with its own copy of what is shown.
+#define FRAME_SLOTS 3
+#define FRAME_ROW_BYTES ((EMU_WIDTH << FRAME_DEPTH) / 8)
+#define FRAME_BYTES (FRAME_ROW_BYTES * EMU_HEIGHT)
+#define FRAME_ROW_WORDS ((EMU_HEIGHT + 31) / 32)
+#define FRAME_FRESH 0x80 // in frame_latest: published, not taken yet
+#define FRAME_HISTORY 4
+
+#ifdef CONFIG_MINIVMAC_DISPLAY_INDEXED
+// LVGL draws the front snapshot itself as an indexed image, which
+// wants its palette right in front of the pixels
+#define FRAME_PALETTE_BYTES (2 * sizeof(lv_color32_t))
+#define FRAME_HEAD 16 // keeps the pixels 16 byte aligned
+#else
+#define FRAME_HEAD 0
+#endif
+
+typedef struct {
+    uint8_t* pixels;
+    upd_list_t upd;
+    uint32_t seq;
+    int64_t publish_us;
+#if FRAME_DEPTH != 0
+    int depth; // 0 or FRAME_DEPTH
+    uint32_t colors_seq; // palette it goes with
+#endif
+#ifdef CONFIG_MINIVMAC_DISPLAY_OFFLOAD
+    uint32_t rows[FRAME_ROW_WORDS]; // written to, to look for changes in
+    int lag; // EmLagTime, limits the rows looked at
+#endif
+} frame_slot_t;
+
+static frame_slot_t frame_slots[FRAME_SLOTS];
+static uint32_t frame_latest = 1;
+static uint32_t frame_consumed_seq = 0;
+
+// emulator side
+static uint32_t frame_back = 0;
+static uint32_t frame_seq = 0;
+static upd_list_t frame_changes;
+static upd_list_t frame_history[FRAME_HISTORY];
+static uint32_t frame_stale[FRAME_SLOTS][FRAME_ROW_WORDS]; // rows behind the emulator
+#if FRAME_DEPTH != 0
+static int frame_depth = 0;
+
+// the palette last set by the emulator, mapped by the display task when
+// a snapshot that goes with it comes
+static portMUX_TYPE colors_mux = portMUX_INITIALIZER_UNLOCKED;
+static uint16_t colors_reds[256];
+static uint16_t colors_greens[256];
+static uint16_t colors_blues[256];
+static int colors_depth = 0;
+static uint32_t colors_seq = 0;
+static uint32_t colors_mapped_seq = 0; // display side
+#endif
+#ifdef CONFIG_MINIVMAC_DISPLAY_OFFLOAD
+static uint32_t frame_rows[FRAME_ROW_WORDS];
+static uint32_t frame_rows_history[FRAME_HISTORY][FRAME_ROW_WORDS];
+#endif
+
+// display side
+static uint32_t frame_front = 2;
+#ifdef CONFIG_MINIVMAC_DISPLAY_OFFLOAD
+static uint8_t* frame_shown; // what the display shows, to compare with
+static uint32_t shown_check[FRAME_ROW_WORDS]; // rows not compared yet
+static int shown_next_row = 0; // where the lag limit stopped
+static uint32_t shown_expanded; // pixels converted by the last pass
+static uint32_t shown_expand_cycles; // and the cycles it took
+
+// changes found, until the emulator takes them for its idle detection
+static portMUX_TYPE found_mux = portMUX_INITIALIZER_UNLOCKED;
+static upd_rect_t found_box = { EMU_WIDTH, EMU_HEIGHT, 0, 0 };
+
+static volatile uint32_t offload_handoff_us = 0;
+static volatile uint32_t offload_find_us = 0;
+#endif
+
+// the plain image is converted while looking for the changes
+#if defined(CONFIG_MINIVMAC_DISPLAY_OFFLOAD) && !EMU_TURNED && !EMU_SCALED \
+    && !defined(CONFIG_MINIVMAC_DISPLAY_INDEXED) && !defined(CONFIG_MINIVMAC_DISPLAY_BOUNCE)
+#define FRAME_FUSED 1
+#else
+#define FRAME_FUSED 0
+#endif
+
+static volatile uint32_t frames_produced = 0;
+static volatile uint32_t frames_consumed = 0;
+static volatile uint32_t frames_dropped = 0;
+
+static bool frame_slots_init(void)
+{
+    for (int i = 0; i < FRAME_SLOTS; i++) {
+        uint8_t* p = heap_caps_aligned_alloc(16, FRAME_HEAD + FRAME_BYTES, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+        if (!p) {
+            ESP_LOGW(TAG, "no internal RAM for frame %d, using PSRAM", i);
+            p = heap_caps_aligned_alloc(16, FRAME_HEAD + FRAME_BYTES, MALLOC_CAP_DEFAULT);
+        }
+        if (!p) {
+            return false;
+        }
+        frame_slots[i].pixels = p + FRAME_HEAD;
+        memset(frame_slots[i].pixels, 0, FRAME_BYTES);
+#ifdef CONFIG_MINIVMAC_DISPLAY_INDEXED
+        // a set bit is black
+        lv_color32_t* palette = (lv_color32_t*)(frame_slots[i].pixels - FRAME_PALETTE_BYTES);
+        palette[0].full = lv_color_to32(lv_color_white());
+        palette[1].full = lv_color_to32(lv_color_black());
+#endif
+    }
+    memset(frame_stale, 0xff, sizeof(frame_stale));
+
+#ifdef CONFIG_MINIVMAC_DISPLAY_OFFLOAD
+    frame_shown = heap_caps_malloc(FRAME_BYTES, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    if (!frame_shown) {
+        return false;
+    }
+    memset(frame_shown, 0, FRAME_BYTES);
+#endif
+
+    return true;
+}
+
+// emulator side: bring the back snapshot up to date with Screen
+static void frame_copy_stale_rows(const uint8_t* Screen)
+{
+    uint32_t* stale = frame_stale[frame_back];
+    uint8_t* pixels = frame_slots[frame_back].pixels;
+#if FRAME_DEPTH != 0
+    int row_bytes = (EMU_WIDTH << frame_depth) / 8;
+#else
+    int row_bytes = FRAME_ROW_BYTES;
+#endif
+    int y = 0;
+
+    while (y < EMU_HEIGHT) {
+        if (!(stale[y >> 5] & (1u << (y & 31)))) {
+            y++;
+            continue;
+        }
+        int y0 = y;
+        while (y < EMU_HEIGHT && (stale[y >> 5] & (1u << (y & 31)))) {
+            y++;
+        }
+        memcpy(pixels + y0 * row_bytes, Screen + y0 * row_bytes,
+            (y - y0) * row_bytes);
+    }
+    memset(stale, 0, sizeof(frame_stale[0]));
+}
+
+#if FRAME_DEPTH != 0
+// display side: rebuild the map for the newest palette, the snapshots
+// that go with it have all their rows changed
+static void frame_map_colors(void)
+{
+    static uint16_t reds[256];
+    static uint16_t greens[256];
+    static uint16_t blues[256];
+    int depth;
+
+    portENTER_CRITICAL(&colors_mux);
+    memcpy(reds, colors_reds, sizeof(reds));
+    memcpy(greens, colors_greens, sizeof(greens));
+    memcpy(blues, colors_blues, sizeof(blues));
+    depth = colors_depth;
+    colors_mapped_seq = colors_seq;
+    portEXIT_CRITICAL(&colors_mux);
+
+    if (depth != 0) {
+        ESP32MAP_SetPalette(depth, reds, greens, blues);
+    }
+}
+#endif
+
+#ifdef CONFIG_MINIVMAC_DISPLAY_OFFLOAD
+
+// rows at most this far apart go into one band, as in COMOSGLU.h
+#define SHOWN_BAND_GAP 4
+
+// display side: compare the rows of the snapshot written to with what is
+// shown and bring frame_shown up to date, in one pass. Like
+// ScreenFindChanges, a lagging emulator gets fewer rows looked at per
+// frame, the rest are left for the next. The changed bands go to Found,
+// the plain image has them converted already.
+static void frame_find_changes(frame_slot_t* frame, upd_list_t* Found)
+{
+    const uint8_t* pixels = frame->pixels;
+    upd_rect_t box = { EMU_WIDTH, EMU_HEIGHT, 0, 0 };
+    upd_rect_t band = { 0, 0, 0, 0 };
+    bool in_band = false;
+    int max_rows;
+    int limit;
+    int y;
+
+    shown_expanded = 0;
+    shown_expand_cycles = 0;
+
+    if (frame->lag < 4) {
+        max_rows = EMU_HEIGHT;
+    } else if (frame->lag < 6) {
+        max_rows = EMU_HEIGHT / 2;
+    } else {
+        max_rows = EMU_HEIGHT / 4;
+    }
+
+    // areas to redraw as they are, converted with the others
+    for (int i = 0; i < frame->upd.count; i++) {
+        const upd_rect_t* r = &frame->upd.rects[i];
+        int x0 = (r->l < 0) ? 0 : r->l >> 3;
+        int x1 = (r->r > EMU_WIDTH) ? FRAME_ROW_BYTES : (r->r + 7) >> 3;
+
+        for (y = (r->t < 0) ? 0 : r->t; y < r->b && y < EMU_HEIGHT && x1 > x0; y++) {
+            memcpy(frame_shown + y * FRAME_ROW_BYTES + x0, pixels + y * FRAME_ROW_BYTES + x0, x1 - x0);
+        }
+    }
+
+    // a second pass over the same snapshot only does what is left
+    for (int w = 0; w < FRAME_ROW_WORDS; w++) {
+        shown_check[w] |= frame->rows[w];
+        frame->rows[w] = 0;
+    }
+
+    // the first row that changed, the rows before it are the same
+    for (y = shown_next_row; y < EMU_HEIGHT; y++) {
+        if (!(shown_check[y >> 5] & (1u << (y & 31)))) {
+            continue;
+        }
+        if (memcmp(pixels + y * FRAME_ROW_BYTES, frame_shown + y * FRAME_ROW_BYTES, FRAME_ROW_BYTES)) {
+            break;
+        }
+        shown_check[y >> 5] &= ~(1u << (y & 31));
+    }
+    if (y == EMU_HEIGHT) {
+        shown_next_row = 0;
+        return;
+    }
+
+    limit = y + max_rows;
+    if (limit >= EMU_HEIGHT) {
+        limit = EMU_HEIGHT;
+        shown_next_row = 0;
+    } else {
+        shown_next_row = limit;
+    }
 
-// lookup-table
-uint16_t lut[256][8]; // 256 Bytes for 8 Pixel each
+    for (; y < limit; y++) {
+        const uint8_t* p = pixels + y * FRAME_ROW_BYTES;
+        uint8_t* q = frame_shown + y * FRAME_ROW_BYTES;
+        int x0;
+        int x1;
 
-// update area: minivmac sends info about partial screen updates
-static int upd_area_l = EMU_WIDTH/2;
-static int upd_area_t = EMU_HEIGHT/2;
-static int upd_area_r = EMU_WIDTH/2;
-static int upd_area_b = EMU_HEIGHT/2;
-static int update_event_count = 0;
+        if (!(shown_check[y >> 5] & (1u << (y & 31)))) {
+            continue;
+        }
+        shown_check[y >> 5] &= ~(1u << (y & 31));
+
+        for (x0 = 0; x0 < FRAME_ROW_BYTES && p[x0] == q[x0]; x0++) {
+        }
+        if (x0 == FRAME_ROW_BYTES) {
+            continue;
+        }
+        for (x1 = FRAME_ROW_BYTES; p[x1 - 1] == q[x1 - 1]; x1--) {
+        }
+
+        memcpy(q + x0, p + x0, x1 - x0);
+#if FRAME_FUSED
+        uint32_t c = esp_cpu_get_cycle_count();
+        ESP32CONV_Expand(p + x0, (uint16_t*)&emu_buf[y * EMU_WIDTH + x0 * 8], x1 - x0);
+        shown_expand_cycles += esp_cpu_get_cycle_count() - c;
+        shown_expanded += (uint32_t)(x1 - x0) * 8;
+#endif
+
+        if (in_band && y - band.b >= SHOWN_BAND_GAP) {
+            upd_rect_add(Found, band);
+            upd_rect_union(&box, &band);
+            in_band = false;
+        }
+        if (!in_band) {
+            in_band = true;
+            band.l = x0 * 8;
+            band.r = x1 * 8;
+            band.t = y;
+        } else {
+            if (x0 * 8 < band.l) band.l = x0 * 8;
+            if (x1 * 8 > band.r) band.r = x1 * 8;
+        }
+        band.b = y + 1;
+    }
+    if (in_band) {
+        upd_rect_add(Found, band);
+        upd_rect_union(&box, &band);
+    }
+
+    if (box.r > box.l) {
+        portENTER_CRITICAL(&found_mux);
+        upd_rect_union(&found_box, &box);
+        portEXIT_CRITICAL(&found_mux);
+    }
+}
+
+static bool shown_rows_left(void)
+{
+    for (int w = 0; w < FRAME_ROW_WORDS; w++) {
+        if (shown_check[w]) {
+            return true;
+        }
+    }
+    return false;
+}
+
+#endif /* CONFIG_MINIVMAC_DISPLAY_OFFLOAD */
+
+#ifdef CONFIG_MINIVMAC_DISPLAY_BOUNCE
+
+// scanout without LVGL: the RGB panel has no framebuffer, its driver asks
+// for each chunk of lines just before they are sent, and the chunk is
+// expanded from a 1bpp copy of the Mac screen turned to the panel
+// orientation, with the border around it.
+//
+// The panel is 480 x 640 and shows the 640 x 480 screen turned the way
+// LVGL turns it for ESP_LV_ADAPTER_ROTATE_90: panel line py is screen
+// column SCREEN_WIDTH - 1 - py, pixel px of it is screen row px. So each
+// Mac column is one panel line, with the Mac rows from pixel Y_OFF on.
+// Turned by 270, line py is column py and the rows run from the right.
+//
+// There are two turned copies. The display task updates the one not
+// scanned out from the newest snapshot and hands it over, the fill
+// callback switches to it at the start of the next panel frame.
+#define PANEL_LINE_PX SCREEN_HEIGHT
+#define PANEL_LINES SCREEN_WIDTH
+#define SCAN_PX0 (Y_OFF & ~7) // first pixel expanded, 16 byte aligned
+#define SCAN_BIT0 (Y_OFF & 7) // bit of Mac row 0 in a scan line
+#define SCAN_LINE_BYTES ((((SCAN_BIT0 + EMU_HEIGHT) + 15) & ~15) / 8)
+#define SCAN_BYTES (SCAN_LINE_BYTES * EMU_WIDTH)
+
+// background colour of the LVGL screen, 148, 91, 89
+#define SCAN_BORDER 0x92CB
+
+static uint8_t* scan_bufs[2];
+static int scan_back = 0; // display side
+static int scan_front = 1; // fill callback
+static int scan_pending = -1; // handed over, not yet shown
+static upd_list_t scan_prev_upd; // of the frame before, for scan_back
+
+// the four pixels of each nibble, as two words, for the fill callback;
+// ESP32CONV_Expand may use PIE and is in flash, neither fits an interrupt
+static DRAM_ATTR uint32_t scan_nibble[16][2];
+
+static uint32_t scan_budget_us = 0;
+static volatile uint32_t scan_fills = 0;
+static volatile uint32_t scan_late_fills = 0;
+static volatile uint32_t scan_max_fill_us = 0;
+
+static bool scan_init(void)
+{
+    for (int i = 0; i < 2; i++) {
+        scan_bufs[i] = heap_caps_aligned_alloc(16, SCAN_BYTES, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+        if (!scan_bufs[i]) {
+            return false;
+        }
+        // same as the zeroed snapshots: white
+        memset(scan_bufs[i], 0, SCAN_BYTES);
+    }
+    scan_prev_upd.count = 0;
+
+    // a set bit is black, msb first, the first pixel in the low half
+    for (int n = 0; n < 16; n++) {
+        for (int i = 0; i < 2; i++) {
+            uint32_t p0 = (n & (8 >> (2 * i))) ? 0x0000 : 0xFFFF;
+            uint32_t p1 = (n & (4 >> (2 * i))) ? 0x0000 : 0xFFFF;
+
+            scan_nibble[n][i] = p0 | (p1 << 16);
+        }
+    }
+
+    return true;
+}
+
+// write the N bits at the top of Bits to Line, from bit Bit on
+static void scan_put_bits(uint8_t* Line, int Bit, uint8_t Bits, int N)
+{
+    uint8_t* d = Line + (Bit >> 3);
+    uint16_t m = (uint16_t)(0xFF00 << (8 - N)) >> (Bit & 7);
+    uint16_t v = (uint16_t)(Bits << 8) >> (Bit & 7);
+
+    d[0] = (uint8_t)((d[0] & ~(m >> 8)) | ((v & m) >> 8));
+    if (m & 0xFF) {
+        d[1] = (uint8_t)((d[1] & ~m) | (v & m));
+    }
+}
+
+// copy the area of Pixels into Scan, turned, 8 x 8 bit tiles at a time;
+// x is byte aligned
+static void scan_transpose(uint8_t* Scan, const uint8_t* Pixels, const upd_rect_t* r)
+{
+    for (int y = r->t; y < r->b; y += 8) {
+        int rows = (r->b - y < 8) ? r->b - y : 8;
+#if EMU_TURN_270
+        int bit = SCAN_BIT0 + EMU_HEIGHT - y - rows; // rows run bottom up
+#else
+        int bit = SCAN_BIT0 + y;
+#endif
+
+        for (int x = r->l; x < r->r; x += 8) {
+            uint8_t cols[8];
+
+            ESP32CONV_Transpose8(Pixels + y * FRAME_ROW_BYTES + (x >> 3), FRAME_ROW_BYTES,
+                rows, EMU_TURN_270, cols);
+            for (int i = 0; i < 8; i++) {
+                scan_put_bits(Scan + (x + i) * SCAN_LINE_BYTES, bit, cols[i], rows);
+            }
+        }
+    }
+}
+
+// bring scan_back up to date, it last got the frame before the last one
+static void scan_update(const frame_slot_t* frame)
+{
+    uint8_t* scan = scan_bufs[scan_back];
+    uint32_t pixels = 0;
+
+    for (int k = 0; k < 2; k++) {
+        const upd_list_t* upd = k ? &frame->upd : &scan_prev_upd;
+
+        for (int i = 0; i < upd->count; i++) {
+            upd_rect_t r = upd->rects[i];
+
+            r.l &= ~7;
+            r.r = (r.r + 7) & ~7;
+            if (r.t < 0) r.t = 0;
+            if (r.b > EMU_HEIGHT) r.b = EMU_HEIGHT;
+            if (r.l < 0) r.l = 0;
+            if (r.r > EMU_WIDTH) r.r = EMU_WIDTH;
+            if (r.r <= r.l || r.b <= r.t) {
+                continue;
+            }
+
+            scan_transpose(scan, frame->pixels, &r);
+            pixels += (uint32_t)(r.r - r.l) * (r.b - r.t);
+        }
+    }
+    scan_prev_upd = frame->upd;
+
+#ifdef CONFIG_MINIVMAC_PERF
+    ESP32PERF_PixelsConverted(pixels);
+#endif
+}
+
+static void IRAM_ATTR scan_fill_border(uint16_t* dst, int n)
+{
+    for (int i = 0; i < n; i++) {
+        dst[i] = SCAN_BORDER;
+    }
+}
+
+// expand one scan line, Dst 4 byte aligned
+static inline void IRAM_ATTR scan_expand(const uint8_t* Src, uint16_t* Dst, int Bytes)
+{
+    uint32_t* d = (uint32_t*)Dst;
+
+    for (int i = 0; i < Bytes; i++, d += 4) {
+        const uint32_t* hi = scan_nibble[Src[i] >> 4];
+        const uint32_t* lo = scan_nibble[Src[i] & 15];
+
+        d[0] = hi[0];
+        d[1] = hi[1];
+        d[2] = lo[0];
+        d[3] = lo[1];
+    }
+}
+
+// bounce buffer fill, in the LCD interrupt
+bool IRAM_ATTR display_bounce_fill(esp_lcd_panel_handle_t panel, void* bounce_buf, int pos_px, int len_bytes, void* user_ctx)
+{
+    int64_t start = esp_timer_get_time();
+    uint16_t* dst = (uint16_t*)bounce_buf;
+    int py = pos_px / PANEL_LINE_PX;
+    int lines = len_bytes / (PANEL_LINE_PX * sizeof(uint16_t));
+
+    if (pos_px == 0) {
+        int pending = __atomic_load_n(&scan_pending, __ATOMIC_ACQUIRE);
+        if (pending >= 0) {
+            scan_front = pending;
+            __atomic_store_n(&scan_pending, -1, __ATOMIC_RELEASE);
+        }
+    }
+
+    const uint8_t* scan = scan_bufs[scan_front];
+
+    for (int i = 0; i < lines; i++, py++, dst += PANEL_LINE_PX) {
+#if EMU_TURN_270
+        int x = py - X_OFF;
+#else
+        int x = PANEL_LINES - 1 - py - X_OFF;
+#endif
+
+        if (x < 0 || x >= EMU_WIDTH) {
+            scan_fill_border(dst, PANEL_LINE_PX);
+        } else {
+            scan_expand(scan + x * SCAN_LINE_BYTES, dst + SCAN_PX0, SCAN_LINE_BYTES);
+            scan_fill_border(dst, Y_OFF);
+            scan_fill_border(dst + Y_OFF + EMU_HEIGHT, PANEL_LINE_PX - Y_OFF - EMU_HEIGHT);
+        }
+    }
+
+    uint32_t us = (uint32_t)(esp_timer_get_time() - start);
+    scan_fills++;
+    if (us > scan_budget_us) {
+        scan_late_fills++;
+    }
+    if (us > scan_max_fill_us) {
+        scan_max_fill_us = us;
+    }
+
+    return false;
+}
+
+// the driver fills one bounce buffer while the other one is sent, so a
+// fill has to be done within the time it takes to send one
+void display_bounce_init(uint32_t BouncePx, uint32_t PclkHz)
+{
+    scan_budget_us = (uint32_t)((uint64_t)BouncePx * 1000000 / PclkHz);
+    ESP_LOGI(TAG, "bounce buffer fill budget %lu us", (unsigned long)scan_budget_us);
+}
+
+void ESP32API_GetBounceStats(uint32_t* Fills, uint32_t* LateFills, uint32_t* MaxFillUS)
+{
+    *Fills = scan_fills;
+    *LateFills = scan_late_fills;
+    *MaxFillUS = scan_max_fill_us;
+    scan_max_fill_us = 0;
+}
+
+#endif /* CONFIG_MINIVMAC_DISPLAY_BOUNCE */
+
+// time from publishing a frame until it is on the panel, moving average
+// over the last 8 frames (read by the speed governor)
+static volatile uint32_t display_latency_us = 0;
+
+#ifdef CONFIG_MINIVMAC_DISPLAY_IDLE
+
+// low rate mode: once nothing was drawn for a while the panel runs on a
+// divided pixel clock and the LVGL refresh timer is paused, the next
+// change brings both back
+#define IDLE_AFTER_US (CONFIG_MINIVMAC_DISPLAY_IDLE_MS * 1000LL)
+
+static esp_lcd_panel_handle_t idle_panel = NULL;
+static uint32_t idle_pclk_hz = 0;
+static portMUX_TYPE idle_mux = portMUX_INITIALIZER_UNLOCKED;
+static bool display_idle = false;
+static uint32_t idle_seq = 0; // state changes, under idle_mux
+static bool idle_lvgl_paused = false;
+static int64_t idle_last_draw_us = 0;
+static int64_t idle_since_us = 0;
+static volatile uint32_t idle_total_ms = 0;
+static volatile uint32_t idle_switches = 0;
+
+void display_idle_init(esp_lcd_panel_handle_t Panel, uint32_t PclkHz)
+{
+    idle_panel = Panel;
+    idle_pclk_hz = PclkHz;
+    idle_last_draw_us = esp_timer_get_time();
+}
+
+// display task: how long to wait for a frame before going idle
+static TickType_t display_idle_wait(void)
+{
+    int64_t left = idle_last_draw_us + IDLE_AFTER_US - esp_timer_get_time();
+
+    if (display_idle || !idle_panel) {
+        return portMAX_DELAY;
+    }
+    return (left > 0) ? pdMS_TO_TICKS(left / 1000) + 1 : 0;
+}
+
+// after a state change, outside idle_mux: set the pixel clock of the
+// state, again if it changed meanwhile, so the clock set last is the one
+// of the last state even when two tasks get here at once
+static void display_idle_set_pclk(void)
+{
+    uint32_t seq;
+
+    do {
+        seq = __atomic_load_n(&idle_seq, __ATOMIC_ACQUIRE);
+        // from the next vsync on
+        esp_lcd_rgb_panel_set_pclk(idle_panel, __atomic_load_n(&display_idle, __ATOMIC_RELAXED)
+            ? idle_pclk_hz / CONFIG_MINIVMAC_DISPLAY_IDLE_DIVIDER : idle_pclk_hz);
+    } while (seq != __atomic_load_n(&idle_seq, __ATOMIC_ACQUIRE));
+}
+
+// display task: go idle if nothing was drawn for long enough
+static void display_idle_check(void)
+{
+    int64_t now = esp_timer_get_time();
+    bool entered = false;
+
+    if (!idle_panel || now - idle_last_draw_us < IDLE_AFTER_US) {
+        return;
+    }
+
+    portENTER_CRITICAL(&idle_mux);
+    if (!display_idle) {
+        display_idle = true;
+        idle_since_us = now;
+        idle_seq++;
+        idle_switches++;
+        entered = true;
+    }
+    portEXIT_CRITICAL(&idle_mux);
+
+    if (entered) {
+        display_idle_set_pclk();
+    }
+
+#ifndef CONFIG_MINIVMAC_DISPLAY_BOUNCE
+    if (!idle_lvgl_paused) {
+        esp_lv_adapter_lock(-1);
+        lv_timer_pause(_lv_disp_get_refr_timer(lv_disp_get_default()));
+        esp_lv_adapter_unlock();
+        idle_lvgl_paused = true;
+    }
+#endif
+}
+
+// any task: full rate again, cheap when not idle
+static void display_idle_leave(void)
+{
+    if (!__atomic_load_n(&display_idle, __ATOMIC_RELAXED)) {
+        return;
+    }
+
+    bool left = false;
+
+    portENTER_CRITICAL(&idle_mux);
+    if (display_idle) {
+        int64_t now = esp_timer_get_time();
+
+        display_idle = false;
+        idle_seq++;
+        idle_total_ms += (uint32_t)((now - idle_since_us) / 1000);
+        left = true;
+    }
+    portEXIT_CRITICAL(&idle_mux);
+
+    if (left) {
+        display_idle_set_pclk();
+    }
+}
+
+// display task: something is drawn
+static void display_idle_drawing(void)
+{
+    display_idle_leave();
+    idle_last_draw_us = esp_timer_get_time();
+
+#ifndef CONFIG_MINIVMAC_DISPLAY_BOUNCE
+    // taken by the caller already
+    if (idle_lvgl_paused) {
+        lv_timer_resume(_lv_disp_get_refr_timer(lv_disp_get_default()));
+        idle_lvgl_paused = false;
+    }
+#endif
+}
+
+void ESP32API_GetDisplayIdle(uint32_t* IdleMS, uint32_t* Switches)
+{
+    uint32_t ms;
+
+    portENTER_CRITICAL(&idle_mux);
+    ms = idle_total_ms;
+    if (display_idle) {
+        ms += (uint32_t)((esp_timer_get_time() - idle_since_us) / 1000);
+    }
+    portEXIT_CRITICAL(&idle_mux);
+
+    *IdleMS = ms;
+    *Switches = idle_switches;
+}
+
+#endif /* CONFIG_MINIVMAC_DISPLAY_IDLE */
 
 void display_task(void* Param) {
 
@@ -334,152 +1283,271 @@ void display_task(void* Param) {
       
         ulTaskNotifyTake(pdTRUE, 0);
       
+#ifdef CONFIG_MINIVMAC_DISPLAY_IDLE
+        // wait for new frame, or until it is time to slow down
+        if (xSemaphoreTake(newframe_sem, display_idle_wait()) != pdTRUE) {
+                display_idle_check();
+                continue;
+        }
+#else
         // wait for new frame
         if (xSemaphoreTake(newframe_sem, portMAX_DELAY) != pdTRUE) {
                 ESP32API_Yield();
                 continue;
         }
+#endif
       
-        // this is for full frame update
-        /*
-        if (mac_fb) {
-        
-            lv_color_t* dst_fb = emu_buf;
-    
-            for (int y = 0; y < EMU_HEIGHT; y++) {
-        
-                const uint8_t* src = mac_fb + y * (EMU_WIDTH / 8);
-        
-                lv_color_t* dst = &dst_fb[y * EMU_WIDTH];
-        
-                for (int bx = 0; bx < EMU_WIDTH / 8; bx++) {
-        
-                    const uint8_t b = src[bx];
-                    const uint16_t* p = lut[b];    // 8  RGB565 pixel
-        
-                    dst[0].full = p[0];
-                    dst[1].full = p[1];
-                    dst[2].full = p[2];
-                    dst[3].full = p[3];
-                    dst[4].full = p[4];
-                    dst[5].full = p[5];
-                    dst[6].full = p[6];
-                    dst[7].full = p[7];
-        
-                    dst += 8;
-                }
-            }      
-            
-            esp_lv_adapter_lock(-1);
-            lv_obj_invalidate(emu_img);     
-            lv_refr_now(NULL);              
-            esp_lv_adapter_unlock();
-            
-            // wait for vsync
-            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
-        }*/
-    
-        // partial frame update
-        if (mac_fb) {
+        frame_slot_t* frame = NULL;
+        bool fresh = false;
+
+        // take the newest snapshot, if there is one
+        if (__atomic_load_n(&frame_latest, __ATOMIC_ACQUIRE) & FRAME_FRESH) {
+
+            frame_front = __atomic_exchange_n(&frame_latest, frame_front, __ATOMIC_ACQ_REL) & ~FRAME_FRESH;
 
+            frame = &frame_slots[frame_front];
+            fresh = true;
+            __atomic_store_n(&frame_consumed_seq, frame->seq, __ATOMIC_RELEASE);
+            frames_consumed++;
+        }
+
+#ifdef CONFIG_MINIVMAC_DISPLAY_OFFLOAD
+        upd_list_t found = { .count = 0 };
+
+        if (!frame && shown_rows_left()) {
+            // what the lag limit left of the snapshot shown
+            frame = &frame_slots[frame_front];
+            frame->upd.count = 0;
+        }
+        if (frame) {
+            int64_t start = esp_timer_get_time();
+
+            ESP32POWER_SetDisplayBusy(true);
+            TRACE_BEGIN(TRACE_DISPLAY_DIFF);
+            frame_find_changes(frame, &found);
+            TRACE_END(TRACE_DISPLAY_DIFF);
+            // what the emulator used to spend, the conversion was never its
+            uint32_t us = (uint32_t)(esp_timer_get_time() - start);
+            uint32_t expand_us = shown_expand_cycles / CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ;
+            offload_find_us += (us > expand_us) ? us - expand_us : 0;
+
+            if (shown_rows_left()) {
+                xSemaphoreGive(newframe_sem);
+            }
+#if !FRAME_FUSED
+            for (int i = 0; i < found.count; i++) {
+                upd_rect_add(&frame->upd, found.rects[i]);
+            }
+            found.count = 0;
+#endif
+            if (frame->upd.count == 0 && found.count == 0) {
+                // written to, but the same as before
+                ESP32POWER_SetDisplayBusy(false);
+                frame = NULL;
+            }
+        }
+#endif
+
+        if (frame) {
+
+            ESP32POWER_SetDisplayBusy(true);
+
+#ifdef CONFIG_MINIVMAC_DISPLAY_BOUNCE
+#ifdef CONFIG_MINIVMAC_DISPLAY_IDLE
+            display_idle_drawing();
+#endif
+            TRACE_BEGIN(TRACE_DISPLAY_CONVERT);
+            scan_update(frame);
+            TRACE_END(TRACE_DISPLAY_CONVERT);
+
+            ESP32POWER_SetDisplayBusy(false);
+
+            // hand it over, and wait until the panel shows it before
+            // the other copy is written
+            TRACE_BEGIN(TRACE_DISPLAY_VSYNC);
+            __atomic_store_n(&scan_pending, scan_back, __ATOMIC_RELEASE);
+            while (__atomic_load_n(&scan_pending, __ATOMIC_ACQUIRE) >= 0) {
+                ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            }
+            scan_back = 1 - scan_back;
+            TRACE_END(TRACE_DISPLAY_VSYNC);
+#else
+#ifndef CONFIG_MINIVMAC_DISPLAY_INDEXED
             lv_color_t* dst_fb = emu_buf;
-        
-            // clamp area
-            int x1 = 0;
-            int x2 = 0;
-            int y1 = 0;
-            int y2 = 0;
-            
-            if (xSemaphoreTake(upd_area_mutex, portMAX_DELAY)) {
-                y1 = upd_area_t;
-                y2 = upd_area_b;
-                x1 = upd_area_l;
-                x2 = upd_area_r;
-                update_event_count = 0;
-                xSemaphoreGive(upd_area_mutex);
+#endif
+            upd_rect_t* rects = frame->upd.rects;
+            int rect_count = frame->upd.count;
+            uint32_t pixels = 0;
+
+            TRACE_BEGIN(TRACE_DISPLAY_CONVERT);
+
+#if FRAME_DEPTH != 0
+            if (frame->depth != 0 && (int32_t)(frame->colors_seq - colors_mapped_seq) > 0) {
+                frame_map_colors();
             }
-        
-            // alignment to full bytes for x1 and x2
-            int x1_al = x1 & ~7;
-            int x2_al = (x2 + 7) & ~7;
-        
-            // save boundaries
-            if (y1 < 0) y1 = 0;
-            if (y2 >= EMU_HEIGHT) y2 = EMU_HEIGHT - 1;
-            if (x1_al < 0 ) x1_al = 0;
-            if (x2_al >= EMU_WIDTH) x2_al = EMU_WIDTH;
-                    
-            int b_max = (x2_al - x1_al) >> 3;
-            if (b_max < 0 ) b_max = 0;        
-                    
-            // convert frame buffer
-            for (int y = y1; y <= y2; y++) {
-        
-                const uint8_t* src = mac_fb + y * (EMU_WIDTH / 8) + x1_al/8;
-                lv_color_t* dst = &dst_fb[y * EMU_WIDTH + x1_al];
-        
-                for (int bx = 0; bx < b_max; bx++) {
-        
-                    const uint8_t b = src[bx];
-                    const uint16_t* p = lut[b];    // 8 RGB565 pixel
-        
-                    dst[0].full = p[0];
-                    dst[1].full = p[1];
-                    dst[2].full = p[2];
-                    dst[3].full = p[3];
-                    dst[4].full = p[4];
-                    dst[5].full = p[5];
-                    dst[6].full = p[6];
-                    dst[7].full = p[7];
-        
-                    dst += 8;
+#endif
+
+            for (int i = 0; i < rect_count; i++) {
+                // alignment to full bytes for x1 and x2
+                int x1_al = rects[i].l & ~7;
+                int x2_al = (rects[i].r + 7) & ~7;
+                int y1 = rects[i].t;
+                int y2 = rects[i].b;
+
+                // save boundaries
+                if (y1 < 0) y1 = 0;
+                if (y2 > EMU_HEIGHT) y2 = EMU_HEIGHT;
+                if (x1_al < 0 ) x1_al = 0;
+                if (x2_al > EMU_WIDTH) x2_al = EMU_WIDTH;
+
+                int b_max = (x2_al - x1_al) >> 3;
+                if (b_max <= 0 || y2 <= y1) {
+                    rects[i].r = rects[i].l; // nothing to invalidate
+                    continue;
                 }
+
+#if EMU_SCALED
+                // only the rows and columns of the groups the area touches
+                ESP32SCALE_Map(frame->pixels, (uint16_t*)dst_fb, &y1, &x1_al, &y2, &x2_al);
+#elif !defined(CONFIG_MINIVMAC_DISPLAY_INDEXED)
+#if EMU_TURNED
+                ESP32CONV_ExpandTurned(frame->pixels, EMU_WIDTH, EMU_HEIGHT,
+                    x1_al / 8, x2_al / 8, y1, y2, (uint16_t*)dst_fb, EMU_TURN_270);
+#else
+#if FRAME_DEPTH != 0
+                if (frame->depth != 0) {
+                    ESP32MAP_Map(frame->depth, frame->pixels, (uint16_t*)dst_fb, y1, x1_al, y2, x2_al);
+                } else
+#endif
+                // convert frame buffer
+                for (int y = y1; y < y2; y++) {
+
+                    const uint8_t* src = frame->pixels + y * (EMU_WIDTH / 8) + x1_al/8;
+                    lv_color_t* dst = &dst_fb[y * EMU_WIDTH + x1_al];
+
+                    ESP32CONV_Expand(src, (uint16_t*)dst, b_max);
+                }
+#endif
+#endif
+                pixels += (uint32_t)(x2_al - x1_al) * (y2 - y1);
+
+                rects[i].l = x1_al;
+                rects[i].r = x2_al;
+                rects[i].t = y1;
+                rects[i].b = y2;
             }
-        
-            // invalidate area
-            lv_area_t area;
-            area.x1 = x1_al + X_OFF;
-            area.x2 = x2_al + X_OFF -1;
-            area.y1 = y1 + Y_OFF;
-            area.y2 = y2 + Y_OFF -1;
-            
-            ESP_LOGD(TAG, "X1: %d, Y1: %d, X2: %d, Y2: %d", area.x1, area.y1, area.x2, area.y2);
-        
+
+#if FRAME_FUSED
+            // converted while comparing, only to be drawn
+            for (int i = 0; i < found.count; i++) {
+                upd_rect_add(&frame->upd, found.rects[i]);
+            }
+            rect_count = frame->upd.count;
+            pixels += shown_expanded;
+#endif
+
+            TRACE_END(TRACE_DISPLAY_CONVERT);
+#ifdef CONFIG_MINIVMAC_PERF
+            ESP32PERF_PixelsConverted(pixels);
+#endif
+
+            TRACE_BEGIN(TRACE_DISPLAY_REFRESH);
             esp_lv_adapter_lock(-1);
-            lv_obj_invalidate_area(emu_img, &area);
+#ifdef CONFIG_MINIVMAC_DISPLAY_IDLE
+            display_idle_drawing();
+#endif
+#ifdef CONFIG_MINIVMAC_DISPLAY_INDEXED
+            // LVGL reads the image data line by line while it draws, the
+            // palette is the same in every snapshot
+            emu_img_dsc.data = frame->pixels - FRAME_PALETTE_BYTES;
+#endif
+            for (int i = 0; i < rect_count; i++) {
+                if (rects[i].r <= rects[i].l) {
+                    continue;
+                }
+
+                // invalidate area
+                lv_area_t area;
+#if EMU_TURNED && EMU_TURN_270
+                area.x1 = IMG_X + EMU_HEIGHT - rects[i].b;
+                area.x2 = IMG_X + EMU_HEIGHT - 1 - rects[i].t;
+                area.y1 = IMG_Y + rects[i].l;
+                area.y2 = IMG_Y + rects[i].r - 1;
+#elif EMU_TURNED
+                area.x1 = IMG_X + rects[i].t;
+                area.x2 = IMG_X + rects[i].b - 1;
+                area.y1 = IMG_Y + EMU_WIDTH - rects[i].r;
+                area.y2 = IMG_Y + EMU_WIDTH - 1 - rects[i].l;
+#else
+                area.x1 = rects[i].l + IMG_X;
+                area.x2 = rects[i].r + IMG_X - 1;
+                area.y1 = rects[i].t + IMG_Y;
+                area.y2 = rects[i].b + IMG_Y - 1;
+#endif
+
+                ESP_LOGD(TAG, "X1: %d, Y1: %d, X2: %d, Y2: %d", area.x1, area.y1, area.x2, area.y2);
+
+                lv_obj_invalidate_area(emu_img, &area);
+            }
             lv_refr_now(NULL);
             esp_lv_adapter_unlock();
+            TRACE_END(TRACE_DISPLAY_REFRESH);
+
+            ESP32POWER_SetDisplayBusy(false);
         
             // wait for vsync
+            TRACE_BEGIN(TRACE_DISPLAY_VSYNC);
             ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            TRACE_END(TRACE_DISPLAY_VSYNC);
+#endif
+#ifdef CONFIG_MINIVMAC_PERF
+            ESP32PERF_FrameDone();
+#endif
+
+            if (fresh) {
+                uint32_t latency = (uint32_t)(esp_timer_get_time() - frame->publish_us);
+                display_latency_us = display_latency_us - (display_latency_us >> 3) + (latency >> 3);
+#ifdef CONFIG_MINIVMAC_LATENCY
+                ESP32LAT_Shown(frame->seq);
+#endif
+            }
         }
-    }
-}
-
-void create_1bpp_loopup_table() {
-    // create lookup table for mac framebuffer conversion
-    for (int byte = 0; byte < 256; byte++) {
-        for (int b = 0; b < 8; b++) {
-            // bit proof
-            lut[byte][b]  = (byte & (0x80 >> b)) ? 0x0000 : 0xFFFF;
+#ifdef CONFIG_MINIVMAC_DISPLAY_IDLE
+        else {
+            // snapshots without changes do not keep the panel fast
+            display_idle_check();
         }
+#endif
     }
 }
 
+#ifndef CONFIG_MINIVMAC_DISPLAY_BOUNCE
 void lvgl_emubuffer_init()
 {
-    emu_buf = (lv_color_t *)malloc(EMU_WIDTH * EMU_HEIGHT * sizeof(lv_color_t));
-    memset(emu_buf, 0xff, EMU_WIDTH * EMU_HEIGHT * sizeof(lv_color_t));
+#ifdef CONFIG_MINIVMAC_DISPLAY_INDEXED
+    // straight from the front snapshot, two colour palette in front
+    emu_img_dsc.header.always_zero = 0;
+    emu_img_dsc.header.w = EMU_WIDTH;
+    emu_img_dsc.header.h = EMU_HEIGHT;
+    emu_img_dsc.header.cf = LV_IMG_CF_INDEXED_1BIT;
+    emu_img_dsc.data = frame_slots[frame_front].pixels - FRAME_PALETTE_BYTES;
+    emu_img_dsc.data_size = FRAME_PALETTE_BYTES + FRAME_BYTES;
+#else
+    // 16 byte aligned rows for the vector stores of ESP32CONV
+    emu_buf = (lv_color_t *)heap_caps_aligned_alloc(16, IMG_W * IMG_H * sizeof(lv_color_t), MALLOC_CAP_DEFAULT);
 
     if (!emu_buf)
         ESP_LOGE(TAG, "could not initialize emu buffer");
+    else
+        memset(emu_buf, 0xff, IMG_W * IMG_H * sizeof(lv_color_t));
 
     emu_img_dsc.header.always_zero = 0;
-    emu_img_dsc.header.w = EMU_WIDTH;
-    emu_img_dsc.header.h = EMU_HEIGHT;
+    emu_img_dsc.header.w = IMG_W;
+    emu_img_dsc.header.h = IMG_H;
     emu_img_dsc.header.cf = LV_IMG_CF_TRUE_COLOR;          // RGB565
     emu_img_dsc.data = (const uint8_t *)emu_buf;
-    emu_img_dsc.data_size = EMU_WIDTH * EMU_HEIGHT * sizeof(lv_color_t);
+    emu_img_dsc.data_size = IMG_W * IMG_H * sizeof(lv_color_t);
+#endif
 
     emu_img = lv_img_create(lv_scr_act());
     if (!emu_img)
@@ -487,8 +1555,9 @@ void lvgl_emubuffer_init()
         
     lv_img_set_src(emu_img, &emu_img_dsc);
     lv_obj_set_style_opa(emu_img, LV_OPA_COVER, 0);
-    lv_obj_set_pos(emu_img, X_OFF, Y_OFF);       
+    lv_obj_set_pos(emu_img, IMG_X, IMG_Y);       
 }
+#endif
 
 void init_vmacmini_esp32() {
 
@@ -514,61 +1583,93 @@ void init_vmacmini_esp32() {
         ESP_LOGW(TAG, "SPIFFS info failed: %s", esp_err_to_name(ret));
     }
 
+    // cpu frequency scaling driven by the emulator load
+    ESP32POWER_Init();
+
+#ifdef CONFIG_MINIVMAC_TRACE
+    // timeline tracer, before any task that records events is started
+    ESP32TRACE_Init();
+#endif
+#ifdef CONFIG_MINIVMAC_LATENCY
+    ESP32LAT_Init();
+#endif
+
     // create conversion lookup table for monochrome mac framebuffer
-    create_1bpp_loopup_table();
+    ESP32CONV_Init();
+#if EMU_SCALED
+    ESP32SCALE_Init(CONFIG_MINIVMAC_SCALE_LEVELS);
+#endif
+#ifdef CONFIG_MINIVMAC_CONV_BENCH
+    ESP32CONV_Benchmark();
+#endif
+#if (FRAME_DEPTH != 0) || defined(CONFIG_MINIVMAC_MAP_BENCH)
+    // colour screens, mapped through a palette
+    ESP32MAP_Init();
+#endif
+#ifdef CONFIG_MINIVMAC_MAP_BENCH
+    ESP32MAP_Benchmark();
+#endif
+#ifdef CONFIG_MINIVMAC_DIFF_CHECK
+    ESP32DIFF_SelfCheck();
+#endif
+#ifdef CONFIG_MINIVMAC_DIFF_BENCH
+    ESP32DIFF_Benchmark();
+#endif
     
+#ifdef CONFIG_MINIVMAC_DISPLAY_BOUNCE
+    // turned copies for the bounce buffer scanout
+    if (!scan_init())
+        ESP_LOGE(TAG, "could not allocate scan buffers");
+#endif
+
+    // snapshots handed from the emulator to the display task
+    if (!frame_slots_init())
+        ESP_LOGE(TAG, "could not allocate frame snapshots");
+
+#ifndef CONFIG_MINIVMAC_DISPLAY_BOUNCE
     // init lvgl canvas
     lvgl_emubuffer_init();
+#endif
   
     // new frame semaphore
     newframe_sem = xSemaphoreCreateBinary();
     
-    // update area mutex
-    upd_area_mutex = xSemaphoreCreateMutex();
-    
     // init uart to receive keyboard and mouse data
     ESP_LOGI(TAG, "initializing bluetooth mouse and keyboard");
     hid_link_uart_init_rx(UART_NUM_1, GPIO_NUM_43, GPIO_NUM_44, 921600);
     
     // start mouse and keyboard task
     xTaskCreate(mousekeyboard_task, "mousekeyboard_task", 4096, NULL, 10, NULL);
- }
-
-void ESP32API_GetMouseDelta(int* dx, int* dy) {
-
-    *dx = 0;
-    *dy = 0;
-
-    if (xSemaphoreTake(g_mouse_mutex, portMAX_DELAY)) {
-        *dx = g_mouse_dx;
-        *dy = g_mouse_dy;
 
-        // reset after reading
-        g_mouse_dx = 0;
-        g_mouse_dy = 0;
-
-        // button state
-        mouse_btn_state = mouse_btn_left(g_mouse_buttons);
+#ifdef CONFIG_MINIVMAC_RFB
+    // VNC clients, once the WiFi is up
+    if (!ESP32RFB_WiFiStart() || !ESP32RFB_Start(NULL, CONFIG_MINIVMAC_RFB_PORT))
+        ESP_LOGE(TAG, "could not start the VNC server");
+#endif
+ }
 
-        xSemaphoreGive(g_mouse_mutex);
-    }      
+void ESP32API_GetInputStats(uint32_t* Wakeups, uint32_t* Packets, uint32_t* Coalesced, uint32_t* Errors)
+{
+    *Wakeups = hid_wakeups;
+    *Packets = hid_packets;
+    *Coalesced = hid_coalesced;
+    *Errors = hid_errors;
 }
 
 void ESP32API_GiveEmulatedMouseToESP32(int* EmMouseX, int* EmMouseY) {
   // not used
 }
 
-int ESP32API_GetMouseButton(void) {
-    int current_val = mouse_btn_state ? 1 : 0;
-    
-    return current_val;
-}
-
 uint64_t ESP32API_GetTimeMS(void)
 {
     return 1591551981844ULL + (esp_timer_get_time() / 1000ULL);
 }
 
+uint64_t ESP32API_GetTimeUS(void)
+{
+    return esp_timer_get_time();
+}
+
 void ESP32API_Yield(void)
 {
     taskYIELD();
@@ -611,6 +1712,55 @@ size_t ESP32API_write(const void* Buffer, size_t Size, size_t Nmemb, ESP32File H
     return BytesWritten;
 }
 
+static QueueHandle_t write_queue = NULL;
+
+static void write_task(void* Param)
+{
+    ESP32Write* w;
+
+    while (true) {
+        xQueueReceive(write_queue, &w, portMAX_DELAY);
+        w->Failed = ESP32API_write(w->Buffer, 1, w->Size, w->Handle) != w->Size;
+        __atomic_store_n(&w->Busy, false, __ATOMIC_RELEASE);
+    }
+}
+
+void ESP32API_WriteStart(ESP32Write* Write, ESP32File Handle, const void* Buffer, size_t Size)
+{
+    Write->Handle = Handle;
+    Write->Buffer = Buffer;
+    Write->Size = Size;
+    Write->Failed = false;
+    Write->Busy = true;
+
+    if (!write_queue) {
+        write_queue = xQueueCreate(4, sizeof(ESP32Write*));
+        if (write_queue && xTaskCreate(write_task, "write_task", 3072, NULL, 1, NULL) != pdPASS) {
+            vQueueDelete(write_queue);
+            write_queue = NULL;
+        }
+        if (!write_queue) {
+            ESP_LOGW(TAG, "no writer task, writing right away");
+        }
+    }
+
+    if (write_queue) {
+        xQueueSend(write_queue, &Write, portMAX_DELAY);
+    } else {
+        Write->Failed = ESP32API_write(Buffer, 1, Size, Handle) != Size;
+        Write->Busy = false;
+    }
+}
+
+bool ESP32API_WriteWait(ESP32Write* Write)
+{
+    while (__atomic_load_n(&Write->Busy, __ATOMIC_ACQUIRE)) {
+        vTaskDelay(1);
+    }
+
+    return !Write->Failed;
+}
+
 long ESP32API_tell(ESP32File Handle)
 {
     long Offset = 0; // maybe -1
@@ -655,37 +1805,167 @@ void ESP32API_CheckForEvents( void ) {
 static bool Changed = false;
 
 void ESP32API_ScreenChanged(int top, int left, int bottom, int right) {
-   if (xSemaphoreTake(upd_area_mutex, portMAX_DELAY)) {
-        
-        if (update_event_count == 0) {
-       
-            update_event_count++; 
-            upd_area_t = top;
-            upd_area_l = left;
-            upd_area_r = right;
-            upd_area_b = bottom;
-            
-        } else {
-        
-            // screen not updated in time, expand events
-            if (left < upd_area_l) upd_area_l = left;
-            if (top < upd_area_t) upd_area_t = top;
-            if (right > upd_area_r) upd_area_r = right;
-            if (bottom > upd_area_b) upd_area_b = bottom;
-       }
-       
-       Changed = true;
-       xSemaphoreGive(upd_area_mutex);
+    if (top < 0) top = 0;
+    if (bottom > EMU_HEIGHT) bottom = EMU_HEIGHT;
+
+    // every snapshot is behind on these rows now
+    for (int y = top; y < bottom; y++) {
+        for (int i = 0; i < FRAME_SLOTS; i++) {
+            frame_stale[i][y >> 5] |= 1u << (y & 31);
+        }
     }
+
+    upd_rect_t n = { left, top, right, bottom };
+    upd_rect_add(&frame_changes, n);
+    Changed = true;
+
+#ifdef CONFIG_MINIVMAC_DISPLAY_IDLE
+    // the panel is at full rate before the frame is published
+    display_idle_leave();
+#endif
         
     ESP_LOGD(TAG, "T: %d, L: %d, B: %d, R: %d", top, left, bottom, right);
 }
 
+#if FRAME_DEPTH != 0
+void ESP32API_SetScreenColors(int Depth, const uint16_t* Reds, const uint16_t* Greens, const uint16_t* Blues) {
+    int n = (Depth != 0) ? 1 << (1 << Depth) : 0;
+
+    portENTER_CRITICAL(&colors_mux);
+    memcpy(colors_reds, Reds, n * sizeof(uint16_t));
+    memcpy(colors_greens, Greens, n * sizeof(uint16_t));
+    memcpy(colors_blues, Blues, n * sizeof(uint16_t));
+    colors_depth = Depth;
+    colors_seq++;
+    portEXIT_CRITICAL(&colors_mux);
+
+    // all rows again, in the new depth
+    frame_depth = Depth;
+    ESP32API_ScreenChanged(0, 0, EMU_HEIGHT, EMU_WIDTH);
+}
+#endif
+
+// emulator side: hand the back snapshot over, with Screen copied in
+static void frame_publish(const uint8_t* Screen, int Lag) {
+    frame_slot_t* frame = &frame_slots[frame_back];
+    uint32_t consumed = __atomic_load_n(&frame_consumed_seq, __ATOMIC_ACQUIRE);
+
+    Changed = false;
+    frame_seq++;
+
+    frame_copy_stale_rows(Screen);
+#if FRAME_DEPTH != 0
+    frame->depth = frame_depth;
+    frame->colors_seq = colors_seq;
+#endif
+
+    // everything changed since the last frame the display task took
+    frame->upd = frame_changes;
+    if (frame_seq - consumed - 1 >= FRAME_HISTORY) {
+        upd_rect_t all = { 0, 0, EMU_WIDTH, EMU_HEIGHT };
+        upd_rect_add(&frame->upd, all);
+    } else {
+        for (uint32_t s = consumed + 1; s != frame_seq; s++) {
+            upd_list_t* h = &frame_history[s % FRAME_HISTORY];
+            for (int i = 0; i < h->count; i++) {
+                upd_rect_add(&frame->upd, h->rects[i]);
+            }
+        }
+    }
+    frame_history[frame_seq % FRAME_HISTORY] = frame_changes;
+    frame_changes.count = 0;
+
+#ifdef CONFIG_MINIVMAC_DISPLAY_OFFLOAD
+    // the same for the rows to look for changes in
+    memcpy(frame->rows, frame_rows, sizeof(frame_rows));
+    if (frame_seq - consumed - 1 >= FRAME_HISTORY) {
+        for (int y = 0; y < EMU_HEIGHT; y++) {
+            frame->rows[y >> 5] |= 1u << (y & 31);
+        }
+    } else {
+        for (uint32_t s = consumed + 1; s != frame_seq; s++) {
+            for (int w = 0; w < FRAME_ROW_WORDS; w++) {
+                frame->rows[w] |= frame_rows_history[s % FRAME_HISTORY][w];
+            }
+        }
+    }
+    memcpy(frame_rows_history[frame_seq % FRAME_HISTORY], frame_rows, sizeof(frame_rows));
+    memset(frame_rows, 0, sizeof(frame_rows));
+    frame->lag = Lag;
+#endif
+
+    frame->seq = frame_seq;
+    frame->publish_us = esp_timer_get_time();
+
+    uint32_t prev = __atomic_exchange_n(&frame_latest, frame_back | FRAME_FRESH, __ATOMIC_ACQ_REL);
+    frame_back = prev & ~FRAME_FRESH;
+    frames_produced++;
+    if (prev & FRAME_FRESH) {
+        frames_dropped++;
+    }
+
+    xSemaphoreGive(newframe_sem);
+}
+
+uint32_t ESP32API_GetNextFrame(void) {
+    return frame_seq + 1;
+}
+
 void ESP32API_DrawScreen(const uint8_t* new_fb) {
     if (Changed) {
-        mac_fb = new_fb;
-        Changed = false;
+        frame_publish(new_fb, 0);
+    }
+}
 
-        xSemaphoreGive(newframe_sem);
+#ifdef CONFIG_MINIVMAC_DISPLAY_OFFLOAD
+void ESP32API_ScreenSnapshot(const uint8_t* Screen, const uint32_t* Rows, int Lag) {
+    int64_t start = esp_timer_get_time();
+    uint32_t written = 0;
+
+    for (int w = 0; w < FRAME_ROW_WORDS; w++) {
+        written |= Rows[w];
+        frame_rows[w] |= Rows[w];
+        for (int i = 0; i < FRAME_SLOTS; i++) {
+            frame_stale[i][w] |= Rows[w];
+        }
     }
-}
\ No newline at end of file
+    if (written || Changed) {
+        frame_publish(Screen, Lag);
+    }
+
+    offload_handoff_us += (uint32_t)(esp_timer_get_time() - start);
+}
+
+bool ESP32API_TakeScreenChanges(int* Top, int* Left, int* Bottom, int* Right) {
+    bool changed;
+
+    portENTER_CRITICAL(&found_mux);
+    changed = found_box.r > found_box.l;
+    *Top = found_box.t;
+    *Left = found_box.l;
+    *Bottom = found_box.b;
+    *Right = found_box.r;
+    found_box.l = EMU_WIDTH;
+    found_box.t = EMU_HEIGHT;
+    found_box.r = 0;
+    found_box.b = 0;
+    portEXIT_CRITICAL(&found_mux);
+
+    return changed;
+}
+
+void ESP32API_GetDiffTimes(uint32_t* HandoffUS, uint32_t* FindUS) {
+    *HandoffUS = offload_handoff_us;
+    *FindUS = offload_find_us;
+}
+#endif
+
+void ESP32API_GetFrameCounts(uint32_t* Produced, uint32_t* Consumed, uint32_t* Dropped) {
+    *Produced = frames_produced;
+    *Consumed = frames_consumed;
+    *Dropped = frames_dropped;
+}
+
+uint32_t ESP32API_GetDisplayLatencyUS(void) {
+    return display_latency_us;
+}
@@ -3,6 +3,7 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include <stdbool.h>
 
 typedef void* ESP32File;
 
@@ -18,11 +19,14 @@ enum {
 
 void init_vmacmini_esp32();
 
-void ESP32API_GetMouseDelta( int* OutXDeltaPtr, int* OutYDeltaPtr );
+// mouse and keyboard events come through ESP32INPUT
 void ESP32API_GiveEmulatedMouseToESP32( int* EmMouseX, int* EmMouseY );
-int ESP32API_GetMouseButton( void );
+// input link since start: task wake ups, packets taken, mouse packets
+// merged into the one before, and bytes skipped or events lost
+void ESP32API_GetInputStats( uint32_t* Wakeups, uint32_t* Packets, uint32_t* Coalesced, uint32_t* Errors );
 
 uint64_t ESP32API_GetTimeMS( void );
+uint64_t ESP32API_GetTimeUS( void );
 void ESP32API_Yield( void );
 void ESP32API_Delay( uint32_t MSToDelay );
 
@@ -34,6 +38,22 @@ long ESP32API_tell( ESP32File Handle );
 long ESP32API_seek( ESP32File Handle, long Offset, int Whence );
 int ESP32API_eof( ESP32File Handle );
 
+// write in the background, in order, on a low priority task, so the
+// flash does not stall the caller; Handle and Buffer stay as they are
+// until ESP32API_WriteWait returns. A zeroed Write counts as done and
+// good.
+typedef struct {
+    ESP32File Handle;
+    const void* Buffer;
+    size_t Size;
+    volatile bool Busy;
+    bool Failed;
+} ESP32Write;
+
+void ESP32API_WriteStart( ESP32Write* Write, ESP32File Handle, const void* Buffer, size_t Size );
+// wait until Write is done, true if all of it was written
+bool ESP32API_WriteWait( ESP32Write* Write );
+
 void* ESP32API_malloc( size_t Size );
 void* ESP32API_calloc( size_t Nmemb, size_t Size );
 void ESP32API_free( void* Memory );
@@ -41,8 +61,30 @@ void ESP32API_free( void* Memory );
 void ESP32API_CheckForEvents( void );
 
 void ESP32API_ScreenChanged( int Top, int Left, int Bottom, int Right );
+// sequence number of the frame the changes so far go out with
+uint32_t ESP32API_GetNextFrame( void );
+// colour screens: the depth (log2 of the bits per pixel, 0 for black and
+// white) and the palette, 16 bit per channel, of the screens drawn from now
+void ESP32API_SetScreenColors( int Depth, const uint16_t* Reds, const uint16_t* Greens, const uint16_t* Blues );
 void ESP32API_DrawScreen( const uint8_t* Screen );
 void ESP32API_GiveScreenBufferToArduino( const uint8_t* ScreenPtr );
+uint32_t ESP32API_GetDisplayLatencyUS( void );
+// frames published by the emulator, taken by the display task, and
+// replaced by a newer one before the display task took them
+void ESP32API_GetFrameCounts( uint32_t* Produced, uint32_t* Consumed, uint32_t* Dropped );
+// bounce buffer scanout: fills since start, fills that took longer than
+// sending a bounce buffer, and the longest fill since the last call
+void ESP32API_GetBounceStats( uint32_t* Fills, uint32_t* LateFills, uint32_t* MaxFillUS );
+// low rate panel mode: milliseconds spent in it and times it was
+// entered since start
+void ESP32API_GetDisplayIdle( uint32_t* IdleMS, uint32_t* Switches );
+// changes looked for by the display task: hand the screen over with the
+// rows written to since the last call, take the bounding box of the
+// changes found since the last call, and the microseconds spent since
+// start handing over (emulator) and looking (display task)
+void ESP32API_ScreenSnapshot( const uint8_t* Screen, const uint32_t* Rows, int Lag );
+bool ESP32API_TakeScreenChanges( int* Top, int* Left, int* Bottom, int* Right );
+void ESP32API_GetDiffTimes( uint32_t* HandoffUS, uint32_t* FindUS );
 
 int minivmac_main(int argc, char** argv);
 
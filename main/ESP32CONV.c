@@ -0,0 +1,343 @@
+/*
+ Copyright (C) 2025  <uliuc@gmx.net >
+
+ This program is free software; you can redistribute it and/or modify it
+ under the terms of the GNU General Public License as published by the
+ Free Software Foundation; either version 3 of the License, or (at your
+ option) any later version.
+
+ This program is distributed in the hope that it will be useful, but
+ WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ for more details.
+
+ For the complete text of the GNU General Public License see
+ http://www.gnu.org/licenses/.
+
+*/
+
+#include <string.h>
+#include <stdlib.h>
+
+#include "ESP32CONV.h"
+
+// lookup-table
+static uint16_t lut[256][8]; // 256 Bytes for 8 Pixel each
+
+#ifdef CONFIG_MINIVMAC_CONV_PIE
+
+void esp32conv_expand_pie(const uint8_t* src, uint16_t* dst, uint32_t pairs, const uint16_t* masks);
+
+// bit of each pixel in a little endian 16 bit load of two source bytes
+static const uint16_t pie_masks[16] __attribute__((aligned(16))) = {
+    0x0080, 0x0040, 0x0020, 0x0010, 0x0008, 0x0004, 0x0002, 0x0001,
+    0x8000, 0x4000, 0x2000, 0x1000, 0x0800, 0x0400, 0x0200, 0x0100
+};
+
+#endif
+
+void ESP32CONV_Init(void)
+{
+    // create lookup table for mac framebuffer conversion
+    for (int byte = 0; byte < 256; byte++) {
+        for (int b = 0; b < 8; b++) {
+            // bit proof
+            lut[byte][b]  = (byte & (0x80 >> b)) ? 0x0000 : 0xFFFF;
+        }
+    }
+}
+
+void ESP32CONV_ExpandScalar(const uint8_t* src, uint16_t* dst, int bytes)
+{
+    for (int bx = 0; bx < bytes; bx++) {
+
+        const uint8_t b = src[bx];
+        const uint16_t* p = lut[b];    // 8 RGB565 pixel
+
+        dst[0] = p[0];
+        dst[1] = p[1];
+        dst[2] = p[2];
+        dst[3] = p[3];
+        dst[4] = p[4];
+        dst[5] = p[5];
+        dst[6] = p[6];
+        dst[7] = p[7];
+
+        dst += 8;
+    }
+}
+
+void ESP32CONV_Expand(const uint8_t* src, uint16_t* dst, int bytes)
+{
+#ifdef CONFIG_MINIVMAC_CONV_PIE
+    // one byte is 16 destination bytes, so only the source side can be odd
+    if (((uintptr_t)dst & 15) == 0 && bytes > 0) {
+        if ((uintptr_t)src & 1) {
+            ESP32CONV_ExpandScalar(src, dst, 1);
+            src++;
+            dst += 8;
+            bytes--;
+        }
+        if (bytes >= 2) {
+            esp32conv_expand_pie(src, dst, bytes >> 1, pie_masks);
+            src += bytes & ~1;
+            dst += (bytes & ~1) * 8;
+            bytes &= 1;
+        }
+    }
+#endif
+    ESP32CONV_ExpandScalar(src, dst, bytes);
+}
+
+void ESP32CONV_Transpose8(const uint8_t* Src, int Stride, int Rows, bool Reverse, uint8_t* Out)
+{
+    uint8_t a[8] = { 0 };
+
+    for (int i = 0; i < Rows; i++) {
+        a[Reverse ? Rows - 1 - i : i] = Src[i * Stride];
+    }
+
+    // three rounds of swapping 1, 2 and 4 bit blocks, two rows per byte
+    uint32_t x = ((uint32_t)a[0] << 24) | ((uint32_t)a[1] << 16) | ((uint32_t)a[2] << 8) | a[3];
+    uint32_t y = ((uint32_t)a[4] << 24) | ((uint32_t)a[5] << 16) | ((uint32_t)a[6] << 8) | a[7];
+    uint32_t t;
+
+    t = (x ^ (x >> 7)) & 0x00AA00AA;
+    x = x ^ t ^ (t << 7);
+    t = (y ^ (y >> 7)) & 0x00AA00AA;
+    y = y ^ t ^ (t << 7);
+
+    t = (x ^ (x >> 14)) & 0x0000CCCC;
+    x = x ^ t ^ (t << 14);
+    t = (y ^ (y >> 14)) & 0x0000CCCC;
+    y = y ^ t ^ (t << 14);
+
+    t = (x & 0xF0F0F0F0) | ((y >> 4) & 0x0F0F0F0F);
+    y = ((x << 4) & 0xF0F0F0F0) | (y & 0x0F0F0F0F);
+    x = t;
+
+    Out[0] = x >> 24;
+    Out[1] = x >> 16;
+    Out[2] = x >> 8;
+    Out[3] = x;
+    Out[4] = y >> 24;
+    Out[5] = y >> 16;
+    Out[6] = y >> 8;
+    Out[7] = y;
+}
+
+void ESP32CONV_ExpandTurned(const uint8_t* Src, int Width, int Height,
+    int Bx1, int Bx2, int Y1, int Y2, uint16_t* Dst, bool Turn270)
+{
+    int stride = Width / 8;
+
+    for (int y = Y1; y < Y2; y += 8) {
+        int rows = (Y2 - y < 8) ? Y2 - y : 8;
+
+        for (int bx = Bx1; bx < Bx2; bx++) {
+            uint8_t cols[8];
+            uint16_t* d;
+            int step;
+
+            ESP32CONV_Transpose8(Src + y * stride + bx, stride, rows, Turn270, cols);
+
+            // source column x is destination row Width - 1 - x, or x
+            if (Turn270) {
+                d = Dst + bx * 8 * Height + (Height - y - rows);
+                step = Height;
+            } else {
+                d = Dst + (Width - 1 - bx * 8) * Height + y;
+                step = -Height;
+            }
+
+            for (int i = 0; i < 8; i++, d += step) {
+                memcpy(d, lut[cols[i]], rows * sizeof(uint16_t));
+            }
+        }
+    }
+}
+
+#define CHECK_WIDTH 512
+#define CHECK_HEIGHT 342
+#define CHECK_ROW_BYTES (CHECK_WIDTH / 8)
+
+static uint32_t check_turned_area(const uint8_t* src, uint16_t* dst,
+    int bx1, int bx2, int y1, int y2, bool turn270)
+{
+    uint32_t wrong = 0;
+
+    memset(dst, 0x55, CHECK_WIDTH * CHECK_HEIGHT * sizeof(uint16_t));
+    ESP32CONV_ExpandTurned(src, CHECK_WIDTH, CHECK_HEIGHT, bx1, bx2, y1, y2, dst, turn270);
+
+    for (int y = 0; y < CHECK_HEIGHT; y++) {
+        for (int x = 0; x < CHECK_WIDTH; x++) {
+            bool inside = y >= y1 && y < y2 && x >= bx1 * 8 && x < bx2 * 8;
+            uint16_t want = 0x5555;
+            uint16_t got;
+
+            if (inside) {
+                want = (src[y * CHECK_ROW_BYTES + x / 8] & (0x80 >> (x & 7))) ? 0x0000 : 0xFFFF;
+            }
+            if (turn270) {
+                got = dst[x * CHECK_HEIGHT + (CHECK_HEIGHT - 1 - y)];
+            } else {
+                got = dst[(CHECK_WIDTH - 1 - x) * CHECK_HEIGHT + y];
+            }
+            if (got != want) {
+                wrong++;
+            }
+        }
+    }
+
+    return wrong;
+}
+
+uint32_t ESP32CONV_CheckTurned(void)
+{
+    uint8_t* src = malloc(CHECK_ROW_BYTES * CHECK_HEIGHT);
+    uint16_t* dst = malloc(CHECK_WIDTH * CHECK_HEIGHT * sizeof(uint16_t));
+    uint32_t wrong = 0;
+
+    if (!src || !dst) {
+        free(src);
+        free(dst);
+        return UINT32_MAX;
+    }
+
+    srand(1);
+    for (int n = 0; n < 8; n++) {
+        for (int i = 0; i < CHECK_ROW_BYTES * CHECK_HEIGHT; i++) {
+            src[i] = (uint8_t)rand();
+        }
+        for (int turn270 = 0; turn270 < 2; turn270++) {
+            int bx1 = rand() % CHECK_ROW_BYTES;
+            int bx2 = bx1 + 1 + rand() % (CHECK_ROW_BYTES - bx1);
+            int y1 = rand() % CHECK_HEIGHT;
+            int y2 = y1 + 1 + rand() % (CHECK_HEIGHT - y1);
+
+            wrong += check_turned_area(src, dst, 0, CHECK_ROW_BYTES, 0, CHECK_HEIGHT, turn270);
+            wrong += check_turned_area(src, dst, bx1, bx2, y1, y2, turn270);
+        }
+    }
+
+    free(src);
+    free(dst);
+
+    return wrong;
+}
+
+#define CHECK_SPAN_BYTES 96
+#define CHECK_GUARD 16
+
+uint32_t ESP32CONV_CheckExpand(void)
+{
+    // 16 byte aligned, so both the aligned and the other cases come up
+    static uint8_t src[CHECK_SPAN_BYTES + 2];
+    static uint16_t dst[(CHECK_SPAN_BYTES + 2) * 8 + 2 * CHECK_GUARD] __attribute__((aligned(16)));
+    uint32_t wrong = 0;
+
+    srand(2);
+    for (int n = 0; n < 4096; n++) {
+        int so = rand() & 1;
+        int dof = rand() & 7; // destination offset in pixels, 0 is aligned
+        int bytes = rand() % (CHECK_SPAN_BYTES + 1);
+        uint16_t* d = dst + CHECK_GUARD + dof;
+
+        for (int i = 0; i < (int)sizeof(src); i++) {
+            src[i] = (uint8_t)rand();
+        }
+        memset(dst, 0x55, sizeof(dst));
+
+        ESP32CONV_Expand(src + so, d, bytes);
+
+        for (int i = 0; i < (int)(sizeof(dst) / sizeof(dst[0])); i++) {
+            int x = i - CHECK_GUARD - dof;
+            uint16_t want = 0x5555;
+
+            if (x >= 0 && x < bytes * 8) {
+                want = (src[so + x / 8] & (0x80 >> (x & 7))) ? 0x0000 : 0xFFFF;
+            }
+            if (dst[i] != want) {
+                wrong++;
+            }
+        }
+    }
+
+    return wrong;
+}
+
+#ifdef CONFIG_MINIVMAC_CONV_BENCH
+
+#include "esp_cpu.h"
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+
+static const char* TAG = "ESP32CONV";
+
+#define BENCH_WIDTH 512
+#define BENCH_HEIGHT 342
+#define BENCH_ROW_BYTES (BENCH_WIDTH / 8)
+
+// convert rows y1..y2 and bytes bx1..bx2-1 of each, as display_task does
+static uint32_t bench_frame(void (*expand)(const uint8_t*, uint16_t*, int),
+    const uint8_t* src, uint16_t* dst, int bx1, int bx2, int y1, int y2)
+{
+    uint32_t start = esp_cpu_get_cycle_count();
+
+    for (int y = y1; y <= y2; y++) {
+        expand(src + y * BENCH_ROW_BYTES + bx1, dst + y * BENCH_WIDTH + bx1 * 8, bx2 - bx1);
+    }
+
+    return esp_cpu_get_cycle_count() - start;
+}
+
+static void bench_area(const char* name, const uint8_t* src, uint16_t* dst_ref,
+    uint16_t* dst, int bx1, int bx2, int y1, int y2)
+{
+    uint32_t ref_cycles = bench_frame(ESP32CONV_ExpandScalar, src, dst_ref, bx1, bx2, y1, y2);
+    uint32_t cycles = bench_frame(ESP32CONV_Expand, src, dst, bx1, bx2, y1, y2);
+    bool same = memcmp(dst_ref, dst, BENCH_WIDTH * BENCH_HEIGHT * sizeof(uint16_t)) == 0;
+
+    ESP_LOGI(TAG, "%s: table %lu cycles, expand %lu cycles, %s", name,
+        (unsigned long)ref_cycles, (unsigned long)cycles, same ? "identical" : "MISMATCH");
+}
+
+void ESP32CONV_Benchmark(void)
+{
+    size_t fb_size = BENCH_WIDTH * BENCH_HEIGHT * sizeof(uint16_t);
+    uint8_t* src = heap_caps_malloc(BENCH_ROW_BYTES * BENCH_HEIGHT, MALLOC_CAP_DEFAULT);
+    uint16_t* dst_ref = heap_caps_aligned_alloc(16, fb_size, MALLOC_CAP_DEFAULT);
+    uint16_t* dst = heap_caps_aligned_alloc(16, fb_size, MALLOC_CAP_DEFAULT);
+
+    if (src && dst_ref && dst) {
+        // every byte value, in all positions
+        for (int i = 0; i < BENCH_ROW_BYTES * BENCH_HEIGHT; i++) {
+            src[i] = (uint8_t)(i * 7 + (i >> 8));
+        }
+        memset(dst_ref, 0x55, fb_size);
+        memset(dst, 0x55, fb_size);
+
+        bench_area("full frame", src, dst_ref, dst, 0, BENCH_ROW_BYTES, 0, BENCH_HEIGHT - 1);
+        // a menu, odd first byte
+        bench_area("partial 200x120", src, dst_ref, dst, 3, 28, 20, 139);
+        // a text caret
+        bench_area("partial 8x16", src, dst_ref, dst, 17, 18, 100, 115);
+
+        // the same frame, turned to the panel orientation
+        uint32_t start = esp_cpu_get_cycle_count();
+        ESP32CONV_ExpandTurned(src, BENCH_WIDTH, BENCH_HEIGHT, 0, BENCH_ROW_BYTES, 0, BENCH_HEIGHT, dst, false);
+        uint32_t turned = esp_cpu_get_cycle_count() - start;
+        uint32_t wrong = ESP32CONV_CheckTurned();
+        ESP_LOGI(TAG, "full frame turned: %lu cycles, %lu wrong pixels",
+            (unsigned long)turned, (unsigned long)wrong);
+        ESP_LOGI(TAG, "random spans: %lu wrong pixels", (unsigned long)ESP32CONV_CheckExpand());
+    } else {
+        ESP_LOGE(TAG, "no memory for the benchmark");
+    }
+
+    heap_caps_free(src);
+    heap_caps_free(dst_ref);
+    heap_caps_free(dst);
+}
+
+#endif /* CONFIG_MINIVMAC_CONV_BENCH */
@@ -0,0 +1,53 @@
+#ifndef _ESP32CONV_H_
+#define _ESP32CONV_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "sdkconfig.h"
+
+// 1bpp Mac framebuffer to RGB565 conversion
+//
+// A set bit is a black pixel (0x0000), a clear bit a white one (0xFFFF),
+// msb first. The scalar version goes through a 256 x 8 lookup table and
+// builds anywhere, it is also the reference for the PIE version.
+//
+// With CONFIG_MINIVMAC_CONV_PIE the ESP32-S3 SIMD unit expands two
+// source bytes per 128 bit vector pair: broadcast, and with the bit masks
+// of the 16 pixels, compare with zero, store. Spans that are not 16 byte
+// aligned on the destination side fall back to the table.
+
+void ESP32CONV_Init( void );
+
+// expand Bytes source bytes into 8 * Bytes pixels
+void ESP32CONV_Expand( const uint8_t* Src, uint16_t* Dst, int Bytes );
+void ESP32CONV_ExpandScalar( const uint8_t* Src, uint16_t* Dst, int Bytes );
+
+// 8 x 8 bit tile: Rows (up to 8) source bytes Stride apart in, column i
+// of the tile as Out[i] out, first row in the msb, or the last row with
+// Reverse. Missing rows are zero, after the valid bits.
+void ESP32CONV_Transpose8( const uint8_t* Src, int Stride, int Rows, bool Reverse, uint8_t* Out );
+
+// expand bytes Bx1..Bx2-1 of rows Y1..Y2-1 of the Width x Height 1bpp
+// image Src into the Height x Width image Dst, turned the way LVGL turns
+// the screen for ESP_LV_ADAPTER_ROTATE_90, or _270 with Turn270. Works on
+// 8 x 8 tiles, so it costs about the same as the plain table expansion.
+void ESP32CONV_ExpandTurned( const uint8_t* Src, int Width, int Height,
+    int Bx1, int Bx2, int Y1, int Y2, uint16_t* Dst, bool Turn270 );
+
+// turn random images both ways, in full and in random areas, and compare
+// with turning them pixel by pixel; returns the number of wrong pixels,
+// after ESP32CONV_Init
+uint32_t ESP32CONV_CheckTurned( void );
+
+// expand random spans at every source and destination alignment and
+// compare pixel by pixel, including the pixels around each span; returns
+// the number of wrong pixels, after ESP32CONV_Init
+uint32_t ESP32CONV_CheckExpand( void );
+
+#ifdef CONFIG_MINIVMAC_CONV_BENCH
+// compare PIE and table byte by byte and log cycles per full and partial
+// frame, for both
+void ESP32CONV_Benchmark( void );
+#endif
+
+#endif
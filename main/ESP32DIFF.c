@@ -0,0 +1,419 @@
+/*
+ Copyright (C) 2025  <uliuc@gmx.net >
+
+ This program is free software; you can redistribute it and/or modify it
+ under the terms of the GNU General Public License as published by the
+ Free Software Foundation; either version 3 of the License, or (at your
+ option) any later version.
+
+ This program is distributed in the hope that it will be useful, but
+ WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ for more details.
+
+ For the complete text of the GNU General Public License see
+ http://www.gnu.org/licenses/.
+
+*/
+
+#include <string.h>
+#include <stdlib.h>
+
+#include "ESP32DIFF.h"
+
+#ifdef CONFIG_MINIVMAC_DIFF_PIE
+
+// 64 byte steps, pointers 16 byte aligned; index of the first or last
+// step with a difference, Steps if there is none. The last version gets
+// the end of the buffers and counts the steps from their start.
+uint32_t esp32diff_first_pie(const uint32_t* p1, const uint32_t* p2, uint32_t steps);
+uint32_t esp32diff_last_pie(const uint32_t* p1_end, const uint32_t* p2_end, uint32_t steps);
+
+#define DIFF_STEP_WORDS 16
+
+#endif
+
+uint32_t ESP32DIFF_FindFirstScalar(const uint32_t* P1, const uint32_t* P2, uint32_t Words)
+{
+    for (uint32_t i = 0; i < Words; i++) {
+        if (P1[i] != P2[i]) {
+            return i;
+        }
+    }
+    return Words;
+}
+
+uint32_t ESP32DIFF_FindLastScalar(const uint32_t* P1, const uint32_t* P2, uint32_t Words)
+{
+    for (uint32_t i = Words; i != 0; ) {
+        i--;
+        if (P1[i] != P2[i]) {
+            return i;
+        }
+    }
+    return Words;
+}
+
+uint32_t ESP32DIFF_FindFirst(const uint32_t* P1, const uint32_t* P2, uint32_t Words)
+{
+#ifdef CONFIG_MINIVMAC_DIFF_PIE
+    // both buffers must reach a 16 byte boundary at the same word
+    if ((((uintptr_t)P1 ^ (uintptr_t)P2) & 15) == 0) {
+        uint32_t i = 0;
+        uint32_t steps;
+
+        while (i < Words && ((uintptr_t)(P1 + i) & 15) != 0) {
+            if (P1[i] != P2[i]) {
+                return i;
+            }
+            i++;
+        }
+
+        steps = (Words - i) / DIFF_STEP_WORDS;
+        if (steps != 0) {
+            uint32_t s = esp32diff_first_pie(P1 + i, P2 + i, steps);
+            if (s < steps) {
+                i += s * DIFF_STEP_WORDS;
+                return i + ESP32DIFF_FindFirstScalar(P1 + i, P2 + i, DIFF_STEP_WORDS);
+            }
+            i += steps * DIFF_STEP_WORDS;
+        }
+
+        return i + ESP32DIFF_FindFirstScalar(P1 + i, P2 + i, Words - i);
+    }
+#endif
+    return ESP32DIFF_FindFirstScalar(P1, P2, Words);
+}
+
+uint32_t ESP32DIFF_FindLast(const uint32_t* P1, const uint32_t* P2, uint32_t Words)
+{
+#ifdef CONFIG_MINIVMAC_DIFF_PIE
+    if ((((uintptr_t)P1 ^ (uintptr_t)P2) & 15) == 0) {
+        uint32_t end = Words;
+        uint32_t steps;
+        uint32_t i;
+
+        while (end != 0 && ((uintptr_t)(P1 + end) & 15) != 0) {
+            end--;
+            if (P1[end] != P2[end]) {
+                return end;
+            }
+        }
+
+        steps = end / DIFF_STEP_WORDS;
+        if (steps != 0) {
+            uint32_t s = esp32diff_last_pie(P1 + end, P2 + end, steps);
+            end -= steps * DIFF_STEP_WORDS;
+            if (s < steps) {
+                end += s * DIFF_STEP_WORDS;
+                return end + ESP32DIFF_FindLastScalar(P1 + end, P2 + end, DIFF_STEP_WORDS);
+            }
+        }
+
+        i = ESP32DIFF_FindLastScalar(P1, P2, end);
+        return (i < end) ? i : Words;
+    }
+#endif
+    return ESP32DIFF_FindLastScalar(P1, P2, Words);
+}
+
+uint32_t ESP32DIFF_RowSig(const uint32_t* Row, uint32_t Words)
+{
+    uint32_t h = 0;
+
+    for (uint32_t i = 0; i < Words; i++) {
+        h = (h ^ Row[i]) * 0x9E3779B1u;
+        h ^= h >> 16;
+    }
+    return h;
+}
+
+// one 512 x 342 screen, plus room to move the start around
+#define CHECK_WORDS (512 * 342 / 32)
+#define CHECK_SLACK 8
+#define CHECK_TRIALS 2000
+
+// both buffers in one block, the same distance from a 16 byte boundary
+#define CHECK_SIDE_WORDS ((CHECK_WORDS + CHECK_SLACK + 3) & ~3)
+
+uint32_t ESP32DIFF_Check(void)
+{
+    uint32_t* a = malloc(2 * CHECK_SIDE_WORDS * sizeof(uint32_t));
+    uint32_t* b = a + CHECK_SIDE_WORDS;
+    uint32_t mismatches = 0;
+
+    if (!a) {
+        return UINT32_MAX;
+    }
+
+    srand(3);
+    for (uint32_t i = 0; i < CHECK_SIDE_WORDS; i++) {
+        a[i] = ((uint32_t)rand() << 16) ^ (uint32_t)rand();
+    }
+    memcpy(b, a, CHECK_SIDE_WORDS * sizeof(uint32_t));
+
+    for (uint32_t t = 0; t < CHECK_TRIALS; t++) {
+        // any start and length, zero to two changed bits
+        uint32_t start = rand() % CHECK_SLACK;
+        uint32_t words = rand() % (CHECK_WORDS + 1);
+        uint32_t changes = words ? rand() % 3 : 0;
+        uint32_t pos[2];
+        uint32_t first = words;
+        uint32_t last = words;
+
+        for (uint32_t c = 0; c < changes; c++) {
+            pos[c] = start + rand() % words;
+            b[pos[c]] ^= 1u << (rand() % 32);
+        }
+        // the same bit twice is no change
+        for (uint32_t c = 0; c < changes; c++) {
+            uint32_t i = pos[c] - start;
+
+            if (a[pos[c]] != b[pos[c]]) {
+                if (first == words || i < first) {
+                    first = i;
+                }
+                if (last == words || i > last) {
+                    last = i;
+                }
+            }
+        }
+
+        if (ESP32DIFF_FindFirst(a + start, b + start, words) != first
+            || ESP32DIFF_FindFirstScalar(a + start, b + start, words) != first
+            || ESP32DIFF_FindLast(a + start, b + start, words) != last
+            || ESP32DIFF_FindLastScalar(a + start, b + start, words) != last) {
+            mismatches++;
+        }
+
+        for (uint32_t c = 0; c < changes; c++) {
+            b[pos[c]] = a[pos[c]];
+        }
+    }
+
+    free(a);
+
+    return mismatches;
+}
+
+#ifdef CONFIG_MINIVMAC_DIFF_CHECK
+
+#include "esp_cpu.h"
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+
+static const char* TAG = "ESP32DIFF";
+
+void ESP32DIFF_SelfCheck(void)
+{
+    size_t size = CHECK_WORDS * sizeof(uint32_t);
+    uint32_t* a = heap_caps_aligned_alloc(16, size, MALLOC_CAP_DEFAULT);
+    uint32_t* b = heap_caps_aligned_alloc(16, size, MALLOC_CAP_DEFAULT);
+    uint32_t mismatches = ESP32DIFF_Check();
+
+    if (a && b) {
+        memset(a, 0x5A, size);
+        memcpy(b, a, size);
+
+        uint32_t start = esp_cpu_get_cycle_count();
+        (void)ESP32DIFF_FindFirstScalar(a, b, CHECK_WORDS);
+        uint32_t scalar_cycles = esp_cpu_get_cycle_count() - start;
+        start = esp_cpu_get_cycle_count();
+        (void)ESP32DIFF_FindFirst(a, b, CHECK_WORDS);
+        uint32_t cycles = esp_cpu_get_cycle_count() - start;
+
+        ESP_LOGI(TAG, "%d trials, %lu mismatches; unchanged screen: scalar %lu cycles, find %lu cycles",
+            CHECK_TRIALS, (unsigned long)mismatches,
+            (unsigned long)scalar_cycles, (unsigned long)cycles);
+    } else {
+        ESP_LOGE(TAG, "no memory for the check");
+    }
+
+    heap_caps_free(a);
+    heap_caps_free(b);
+}
+
+#endif /* CONFIG_MINIVMAC_DIFF_CHECK */
+
+#ifdef CONFIG_MINIVMAC_DIFF_BENCH
+
+#include <stdbool.h>
+#include "esp_cpu.h"
+#include "esp_log.h"
+#include "esp_random.h"
+#include "esp_heap_caps.h"
+
+static const char* BENCH_TAG = "ESP32DIFF";
+
+#define BENCH_WIDTH 512
+#define BENCH_HEIGHT 342
+#define BENCH_ROW_BYTES (BENCH_WIDTH / 8)
+#define BENCH_ROW_WORDS (BENCH_ROW_BYTES / 4)
+#define BENCH_WORDS (BENCH_ROW_WORDS * BENCH_HEIGHT)
+#define BENCH_TICKS 240
+
+typedef enum {
+    WORKLOAD_IDLE,
+    WORKLOAD_TYPING,
+    WORKLOAD_DRAG,
+    WORKLOAD_GAME,
+    WORKLOAD_COUNT
+} workload_t;
+
+static const char* workload_names[WORKLOAD_COUNT] = {
+    "idle Finder", "typing", "window drag", "full screen game"
+};
+
+// signatures stay in internal RAM, as in COMOSGLU.h
+static uint32_t bench_sigs[BENCH_HEIGHT];
+
+static void bench_xor_box(uint8_t* screen, int x, int y, int w, int h, bool filled)
+{
+    for (int j = y; j < y + h; j++) {
+        for (int i = x; i < x + w; i++) {
+            if (filled || j == y || j == y + h - 1 || i == x || i == x + w - 1) {
+                screen[j * BENCH_ROW_BYTES + i / 8] ^= 0x80 >> (i & 7);
+            }
+        }
+    }
+}
+
+// what the 68k draws in one tick
+static void bench_step(workload_t workload, uint32_t tick, uint8_t* screen)
+{
+    switch (workload) {
+        case WORKLOAD_IDLE:
+            // a blinking caret, twice a second
+            if (tick % 30 == 0) {
+                bench_xor_box(screen, 200, 100, 1, 12, true);
+            }
+            break;
+        case WORKLOAD_TYPING:
+            // a 7 x 12 glyph every third tick, along a line
+            if (tick % 3 == 0) {
+                int x = 20 + (tick / 3 % 64) * 7;
+                for (int j = 0; j < 12; j++) {
+                    for (int i = 0; i < 7; i++) {
+                        if (esp_random() & 1) {
+                            bench_xor_box(screen, x + i, 150 + j, 1, 1, true);
+                        }
+                    }
+                }
+            }
+            break;
+        case WORKLOAD_DRAG: {
+            // the xor outline of a window, erased and drawn 3 pixels on
+            int x = 40 + (tick % 80) * 3;
+            int y = 30 + (tick % 80);
+            if (tick != 0) {
+                int px = 40 + ((tick - 1) % 80) * 3;
+                int py = 30 + ((tick - 1) % 80);
+                bench_xor_box(screen, px, py, 200, 150, false);
+            }
+            bench_xor_box(screen, x, y, 200, 150, false);
+            break;
+        }
+        default:
+            // every pixel, every tick
+            for (int i = 0; i < BENCH_ROW_BYTES * BENCH_HEIGHT; i += 4) {
+                *(uint32_t*)(screen + i) = esp_random();
+            }
+            break;
+    }
+}
+
+// find the changed rows and bring the compare buffer up to date
+static void bench_compare(const uint32_t* cur, uint32_t* cmp)
+{
+    uint32_t first = ESP32DIFF_FindFirst(cur, cmp, BENCH_WORDS);
+
+    if (first < BENCH_WORDS) {
+        uint32_t last = ESP32DIFF_FindLast(cur, cmp, BENCH_WORDS);
+        uint32_t y0 = first / BENCH_ROW_WORDS;
+        uint32_t y1 = last / BENCH_ROW_WORDS + 1;
+
+        memcpy(cmp + y0 * BENCH_ROW_WORDS, cur + y0 * BENCH_ROW_WORDS,
+            (y1 - y0) * BENCH_ROW_BYTES);
+    }
+}
+
+static void bench_signatures(const uint32_t* cur, uint32_t* cmp)
+{
+    for (uint32_t y = 0; y < BENCH_HEIGHT; y++) {
+        const uint32_t* p = cur + y * BENCH_ROW_WORDS;
+        uint32_t sig = ESP32DIFF_RowSig(p, BENCH_ROW_WORDS);
+
+        if (sig != bench_sigs[y]) {
+            uint32_t* q = cmp + y * BENCH_ROW_WORDS;
+
+            if (ESP32DIFF_FindFirst(p, q, BENCH_ROW_WORDS) < BENCH_ROW_WORDS) {
+                memcpy(q, p, BENCH_ROW_BYTES);
+            }
+            bench_sigs[y] = sig;
+        }
+    }
+}
+
+static uint32_t bench_run(workload_t workload, bool signatures,
+    uint8_t* screen, uint32_t* cmp, uint32_t* missed)
+{
+    uint64_t cycles = 0;
+
+    // the same pseudo random desktop for every run
+    for (uint32_t i = 0; i < BENCH_ROW_BYTES * BENCH_HEIGHT; i++) {
+        screen[i] = (i / BENCH_ROW_BYTES) & 1 ? 0x55 : 0xAA;
+    }
+    memcpy(cmp, screen, BENCH_ROW_BYTES * BENCH_HEIGHT);
+    for (uint32_t y = 0; y < BENCH_HEIGHT; y++) {
+        bench_sigs[y] = ESP32DIFF_RowSig((const uint32_t*)screen + y * BENCH_ROW_WORDS,
+            BENCH_ROW_WORDS);
+    }
+
+    *missed = 0;
+    for (uint32_t tick = 0; tick < BENCH_TICKS; tick++) {
+        bench_step(workload, tick, screen);
+
+        uint32_t start = esp_cpu_get_cycle_count();
+        if (signatures) {
+            bench_signatures((const uint32_t*)screen, cmp);
+        } else {
+            bench_compare((const uint32_t*)screen, cmp);
+        }
+        cycles += esp_cpu_get_cycle_count() - start;
+
+        if (memcmp(screen, cmp, BENCH_ROW_BYTES * BENCH_HEIGHT) != 0) {
+            (*missed)++;
+            memcpy(cmp, screen, BENCH_ROW_BYTES * BENCH_HEIGHT);
+        }
+    }
+
+    return (uint32_t)(cycles / BENCH_TICKS);
+}
+
+void ESP32DIFF_Benchmark(void)
+{
+    size_t size = BENCH_ROW_BYTES * BENCH_HEIGHT;
+    uint8_t* screen = heap_caps_aligned_alloc(16, size, MALLOC_CAP_DEFAULT);
+    uint32_t* cmp = heap_caps_aligned_alloc(16, size, MALLOC_CAP_SPIRAM);
+
+    if (screen && cmp) {
+        for (int w = 0; w < WORKLOAD_COUNT; w++) {
+            uint32_t compare_missed;
+            uint32_t sig_missed;
+            uint32_t compare = bench_run(w, false, screen, cmp, &compare_missed);
+            uint32_t sig = bench_run(w, true, screen, cmp, &sig_missed);
+
+            ESP_LOGI(BENCH_TAG, "%s: compare %lu cycles/tick, signatures %lu cycles/tick, "
+                "%lu and %lu ticks missed", workload_names[w],
+                (unsigned long)compare, (unsigned long)sig,
+                (unsigned long)compare_missed, (unsigned long)sig_missed);
+        }
+    } else {
+        ESP_LOGE(BENCH_TAG, "no memory for the benchmark");
+    }
+
+    heap_caps_free(screen);
+    heap_caps_free(cmp);
+}
+
+#endif /* CONFIG_MINIVMAC_DIFF_BENCH */
@@ -0,0 +1,49 @@
+#ifndef _ESP32DIFF_H_
+#define _ESP32DIFF_H_
+
+#include <stdint.h>
+#include "sdkconfig.h"
+
+// screen compare for ScreenFindChanges in COMOSGLU.h
+//
+// Finds the first or last 32 bit word that differs between the Mac
+// screen and the compare buffer. The scalar versions are the loops of
+// COMOSGLU.h and the reference for the PIE versions.
+//
+// With CONFIG_MINIVMAC_DIFF_PIE the ESP32-S3 SIMD unit compares 64 bytes
+// per step: four 128 bit loads from each side, xor, or them together
+// and test the result once. Words before the first 16 byte boundary and
+// after the last whole step go through the scalar loop, so does the
+// step with the difference, to find the word within it.
+
+// index of the first differing word, Words if there is none
+uint32_t ESP32DIFF_FindFirst( const uint32_t* P1, const uint32_t* P2, uint32_t Words );
+uint32_t ESP32DIFF_FindFirstScalar( const uint32_t* P1, const uint32_t* P2, uint32_t Words );
+
+// index of the last differing word, Words if there is none
+uint32_t ESP32DIFF_FindLast( const uint32_t* P1, const uint32_t* P2, uint32_t Words );
+uint32_t ESP32DIFF_FindLastScalar( const uint32_t* P1, const uint32_t* P2, uint32_t Words );
+
+// signature of one screen row, the ScreenRowSig of COMOSGLU.h and of
+// the benchmark: a multiply-xor hash of its words, 0 for a row of zeros
+uint32_t ESP32DIFF_RowSig( const uint32_t* Row, uint32_t Words );
+
+// find random differences, zero to two changed bits at any start and
+// length, with both the scalar and the PIE versions; returns the number
+// of trials where one of them got the first or last word wrong
+uint32_t ESP32DIFF_Check( void );
+
+#ifdef CONFIG_MINIVMAC_DIFF_CHECK
+// log ESP32DIFF_Check and the cycles for a full screen without changes,
+// for both versions
+void ESP32DIFF_SelfCheck( void );
+#endif
+
+#ifdef CONFIG_MINIVMAC_DIFF_BENCH
+// replay synthetic idle, typing, dragging and game screens against a
+// compare buffer in PSRAM and log the cycles per tick of the full
+// compare and of the row signatures, and the changes each missed
+void ESP32DIFF_Benchmark( void );
+#endif
+
+#endif
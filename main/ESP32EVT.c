@@ -0,0 +1,312 @@
+/*
+ Copyright (C) 2025  <uliuc@gmx.net >
+
+ This program is free software; you can redistribute it and/or modify it
+ under the terms of the GNU General Public License as published by the
+ Free Software Foundation; either version 3 of the License, or (at your
+ option) any later version.
+
+ This program is distributed in the hope that it will be useful, but
+ WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ for more details.
+
+ For the complete text of the GNU General Public License see
+ http://www.gnu.org/licenses/.
+
+*/
+
+#include <string.h>
+
+#include "esp_log.h"
+
+#include "ESP32EVT.h"
+
+static const char* TAG = "ESP32EVT";
+
+enum {
+    EVT_IDLE,
+    EVT_RECORD,
+    EVT_REPLAY,
+    EVT_DONE
+};
+
+static int evt_state = EVT_IDLE;
+static ESP32File evt_file = NULL;
+
+// records not yet written, or read but not yet taken; when recording,
+// one buffer fills while the writer task writes the other
+#define EVT_BUF_RECORDS 256
+static uint8_t evt_bufs[2][EVT_BUF_RECORDS * ESP32EVT_RECORD_SIZE];
+static uint8_t* evt_buf = evt_bufs[0];
+static int evt_cur = 0;
+static uint32_t evt_buf_used = 0;
+static uint32_t evt_buf_pos = 0;
+static ESP32Write evt_write;
+
+// written at least this often, so a reset loses little
+#define EVT_FLUSH_GAPS 60
+static uint32_t evt_flush_gap = 0;
+
+static uint32_t evt_records = 0;
+static uint32_t evt_diverged_gap = 0;
+static bool evt_have_end = false;
+static uint32_t evt_end_hash = 0;
+static uint32_t evt_hash = 0;
+static bool evt_have_hash = false;
+
+static void put16(uint8_t* p, uint32_t v)
+{
+    p[0] = v;
+    p[1] = v >> 8;
+}
+
+static void put32(uint8_t* p, uint32_t v)
+{
+    put16(p, v);
+    put16(p + 2, v >> 16);
+}
+
+static uint32_t get16(const uint8_t* p)
+{
+    return p[0] | ((uint32_t)p[1] << 8);
+}
+
+static uint32_t get32(const uint8_t* p)
+{
+    return get16(p) | (get16(p + 2) << 16);
+}
+
+// hand the buffer to the writer task and go on with the other one, once
+// that is written; false if that failed
+static bool evt_flush(void)
+{
+    if (!ESP32API_WriteWait(&evt_write)) {
+        return false;
+    }
+
+    ESP32API_WriteStart(&evt_write, evt_file, evt_buf, evt_buf_used);
+    evt_cur ^= 1;
+    evt_buf = evt_bufs[evt_cur];
+    evt_buf_used = 0;
+
+    return true;
+}
+
+// refill the buffer once it is used up, false at the end of the file
+static bool evt_fill(void)
+{
+    if (evt_buf_pos + ESP32EVT_RECORD_SIZE <= evt_buf_used) {
+        return true;
+    }
+    evt_buf_used = ESP32API_read(evt_buf, ESP32EVT_RECORD_SIZE, EVT_BUF_RECORDS, evt_file)
+        * ESP32EVT_RECORD_SIZE;
+    evt_buf_pos = 0;
+
+    return evt_buf_used != 0;
+}
+
+static void evt_close(void)
+{
+    ESP32API_close(evt_file);
+    evt_file = NULL;
+    evt_buf_used = 0;
+    evt_buf_pos = 0;
+}
+
+static void evt_start(ESP32File File)
+{
+    evt_file = File;
+    memset(&evt_write, 0, sizeof(evt_write));
+    evt_cur = 0;
+    evt_buf = evt_bufs[0];
+    evt_buf_used = 0;
+    evt_buf_pos = 0;
+    evt_flush_gap = 0;
+    evt_records = 0;
+    evt_diverged_gap = 0;
+    evt_have_end = false;
+    evt_have_hash = false;
+}
+
+bool ESP32EVT_StartRecord(ESP32File Out, int Width, int Height)
+{
+    if (!Out || evt_state != EVT_IDLE) {
+        return false;
+    }
+
+    evt_start(Out);
+    memcpy(evt_buf, ESP32EVT_MAGIC, 4);
+    put16(evt_buf + 4, Width);
+    put16(evt_buf + 6, Height);
+    evt_buf_used = ESP32EVT_HEADER_SIZE;
+    evt_state = EVT_RECORD;
+
+    return true;
+}
+
+bool ESP32EVT_StartReplay(ESP32File In, int Width, int Height)
+{
+    uint8_t header[ESP32EVT_HEADER_SIZE];
+
+    if (!In || evt_state != EVT_IDLE) {
+        return false;
+    }
+
+    if (ESP32API_read(header, 1, sizeof(header), In) != sizeof(header)
+            || memcmp(header, ESP32EVT_MAGIC, 4) != 0) {
+        ESP_LOGE(TAG, "not an event recording");
+        ESP32API_close(In);
+        return false;
+    }
+    if ((int)get16(header + 4) != Width || (int)get16(header + 6) != Height) {
+        ESP_LOGE(TAG, "recorded with a %dx%d screen", (int)get16(header + 4), (int)get16(header + 6));
+        ESP32API_close(In);
+        return false;
+    }
+
+    evt_start(In);
+    evt_state = EVT_REPLAY;
+
+    return true;
+}
+
+bool ESP32EVT_IsRecording(void)
+{
+    return evt_state == EVT_RECORD;
+}
+
+bool ESP32EVT_IsReplaying(void)
+{
+    return evt_state == EVT_REPLAY;
+}
+
+void ESP32EVT_Put(const ESP32EVT_Record* Rec)
+{
+    uint8_t* p;
+
+    if (evt_state != EVT_RECORD) {
+        return;
+    }
+
+    if (evt_buf_used + ESP32EVT_RECORD_SIZE > sizeof(evt_bufs[0])
+            || Rec->Gap - evt_flush_gap >= EVT_FLUSH_GAPS) {
+        evt_flush_gap = Rec->Gap;
+        if (!evt_flush()) {
+            ESP_LOGE(TAG, "write failed, recording stopped");
+            evt_close();
+            evt_state = EVT_DONE;
+            return;
+        }
+    }
+
+    p = evt_buf + evt_buf_used;
+    put32(p, Rec->Gap);
+    put32(p + 4, Rec->Cycles);
+    p[8] = Rec->Kind;
+    p[9] = 0;
+    put16(p + 10, Rec->A);
+    put32(p + 12, Rec->B);
+    evt_buf_used += ESP32EVT_RECORD_SIZE;
+    evt_records++;
+}
+
+bool ESP32EVT_Peek(ESP32EVT_Record* Rec)
+{
+    const uint8_t* p;
+
+    if (evt_state != EVT_REPLAY || !evt_fill()) {
+        return false;
+    }
+
+    p = evt_buf + evt_buf_pos;
+    Rec->Gap = get32(p);
+    Rec->Cycles = get32(p + 4);
+    Rec->Kind = p[8];
+    Rec->A = get16(p + 10);
+    Rec->B = get32(p + 12);
+
+    return true;
+}
+
+void ESP32EVT_Skip(void)
+{
+    if (evt_state == EVT_REPLAY && evt_fill()) {
+        evt_buf_pos += ESP32EVT_RECORD_SIZE;
+        evt_records++;
+    }
+}
+
+void ESP32EVT_Diverged(uint32_t Gap)
+{
+    if (evt_diverged_gap == 0) {
+        evt_diverged_gap = Gap;
+        ESP_LOGW(TAG, "replay no longer follows the recording at gap %lu", (unsigned long)Gap);
+    }
+}
+
+void ESP32EVT_Stop(uint32_t Gap, uint32_t ScreenHash)
+{
+    ESP32EVT_Record end;
+
+    if (evt_state == EVT_RECORD) {
+        end.Gap = Gap;
+        end.Cycles = 0;
+        end.Kind = ESP32EVT_END;
+        end.A = 0;
+        end.B = ScreenHash;
+        ESP32EVT_Put(&end);
+        // the last buffer, and wait for it before the file goes
+        if (evt_state == EVT_RECORD && (!evt_flush() || !ESP32API_WriteWait(&evt_write))) {
+            ESP_LOGE(TAG, "write failed");
+        }
+        evt_close();
+        ESP_LOGI(TAG, "%lu records up to gap %lu, screen %08lx",
+            (unsigned long)evt_records, (unsigned long)Gap, (unsigned long)ScreenHash);
+    } else if (evt_state == EVT_REPLAY) {
+        if (ESP32EVT_Peek(&end) && end.Kind == ESP32EVT_END && end.Gap == Gap) {
+            ESP32EVT_Skip();
+            evt_have_end = true;
+            evt_end_hash = end.B;
+        }
+        evt_close();
+        if (!evt_have_end) {
+            ESP_LOGI(TAG, "%lu records replayed up to gap %lu, screen %08lx",
+                (unsigned long)evt_records, (unsigned long)Gap, (unsigned long)ScreenHash);
+        } else {
+            ESP_LOGI(TAG, "%lu records replayed up to gap %lu, screen %08lx, recorded %08lx: %s",
+                (unsigned long)evt_records, (unsigned long)Gap, (unsigned long)ScreenHash,
+                (unsigned long)evt_end_hash, (ScreenHash == evt_end_hash) ? "same" : "DIFFERENT");
+        }
+    } else {
+        return;
+    }
+
+    evt_hash = ScreenHash;
+    evt_have_hash = true;
+    evt_state = EVT_DONE;
+}
+
+bool ESP32EVT_Done(void)
+{
+    return evt_state == EVT_DONE;
+}
+
+bool ESP32EVT_GetResult(uint32_t* ScreenHash)
+{
+    *ScreenHash = evt_hash;
+
+    return evt_have_hash && evt_diverged_gap == 0
+        && (!evt_have_end || evt_hash == evt_end_hash);
+}
+
+uint32_t ESP32EVT_Hash(const uint8_t* Data, uint32_t Size)
+{
+    uint32_t h = 2166136261u;
+
+    while (Size--) {
+        h = (h ^ *Data++) * 16777619u;
+    }
+
+    return h;
+}
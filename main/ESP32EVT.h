@@ -0,0 +1,97 @@
+#ifndef _ESP32EVT_H_
+#define _ESP32EVT_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "sdkconfig.h"
+#include "ESP32API.h"
+
+// recording and replay of the input of the emulated machine
+//
+// The emulated machine only sees its input between two runs of the
+// emulator, in WaitForNextTick. Such a gap is numbered from 1, gap 0 is
+// the start. Each record carries the number of its gap and the emulated
+// cycle count there (EmCycleCount, the same for the whole gap), which
+// the replay compares to notice when it no longer follows the recording.
+//
+// File layout, all numbers little endian:
+//
+//   header   "MVE1", u16 width, u16 height
+//   record   u32 gap, u32 cycles, u8 kind, u8 0, u16 a, u32 b
+//
+// by kind:
+//
+//   KEY       a = Mac key code, b = down
+//   BUTTON    b = down
+//   POSITION  a = h, b = v
+//   DELTA     a = dh, b = dv, both signed 16 bit
+//   DISK      a = i of diski.dsk
+//   DATE      b = seconds since 1904; gap 0 has the start
+//   TICK      b = the tick this gap starts, when it is not the last + 1
+//   RUN       the emulator ran to the cycles of this record before the
+//             gap, not just one tick
+//   END       b = hash of the screen at this gap (ESP32EVT_Hash)
+//
+// Records are collected in memory and handed to a low priority writer
+// task when the buffer fills, about once a second and at the end, while
+// the next ones go to a second buffer. A recording without an END record
+// still replays up to its last record.
+
+#define ESP32EVT_MAGIC "MVE1"
+#define ESP32EVT_HEADER_SIZE 8
+#define ESP32EVT_RECORD_SIZE 16
+
+typedef enum {
+    ESP32EVT_KEY,
+    ESP32EVT_BUTTON,
+    ESP32EVT_POSITION,
+    ESP32EVT_DELTA,
+    ESP32EVT_DISK,
+    ESP32EVT_DATE,
+    ESP32EVT_TICK,
+    ESP32EVT_RUN,
+    ESP32EVT_END
+} ESP32EVT_Kind;
+
+typedef struct {
+    uint32_t Gap;
+    uint32_t Cycles;
+    uint8_t Kind;
+    uint16_t A;
+    uint32_t B;
+} ESP32EVT_Record;
+
+// start recording into Out, which stays open until ESP32EVT_Stop
+bool ESP32EVT_StartRecord( ESP32File Out, int Width, int Height );
+
+// start replaying In, false if it is no recording of this screen size
+bool ESP32EVT_StartReplay( ESP32File In, int Width, int Height );
+
+bool ESP32EVT_IsRecording( void );
+bool ESP32EVT_IsReplaying( void );
+
+// recording: add a record; does nothing while not recording
+void ESP32EVT_Put( const ESP32EVT_Record* Rec );
+
+// replay: the next record, false once there are no more
+bool ESP32EVT_Peek( ESP32EVT_Record* Rec );
+void ESP32EVT_Skip( void );
+
+// replay: the cycles of Gap differ from the recording, the first is kept
+void ESP32EVT_Diverged( uint32_t Gap );
+
+// end at Gap with the screen hashed to ScreenHash: a recording writes its
+// END record, a replay compares with it; then the file is closed
+void ESP32EVT_Stop( uint32_t Gap, uint32_t ScreenHash );
+
+// a replay has come to its end
+bool ESP32EVT_Done( void );
+
+// screen hash at the end of a replay or recording; false if a replay
+// diverged or its screen differs from the recording
+bool ESP32EVT_GetResult( uint32_t* ScreenHash );
+
+// FNV-1a
+uint32_t ESP32EVT_Hash( const uint8_t* Data, uint32_t Size );
+
+#endif
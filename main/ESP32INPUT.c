@@ -0,0 +1,54 @@
+/*
+ Copyright (C) 2025  <uliuc@gmx.net >
+
+ This program is free software; you can redistribute it and/or modify it
+ under the terms of the GNU General Public License as published by the
+ Free Software Foundation; either version 3 of the License, or (at your
+ option) any later version.
+
+ This program is distributed in the hope that it will be useful, but
+ WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ for more details.
+
+ For the complete text of the GNU General Public License see
+ http://www.gnu.org/licenses/.
+
+*/
+
+#include "ESP32INPUT.h"
+
+#define INPUT_RING_SIZE (1 << CONFIG_MINIVMAC_INPUT_RING_LG2)
+
+// one producer (input task) and one consumer (emulator task): each index
+// is written by one side only and read by the other with acquire, so an
+// entry is complete before the other side sees it
+static ESP32INPUT_Event input_ring[INPUT_RING_SIZE];
+static uint32_t input_in = 0;
+static uint32_t input_out = 0;
+
+bool ESP32INPUT_Put(const ESP32INPUT_Event* Event)
+{
+    uint32_t in = input_in;
+
+    if (in - __atomic_load_n(&input_out, __ATOMIC_ACQUIRE) >= INPUT_RING_SIZE) {
+        return false;
+    }
+    input_ring[in % INPUT_RING_SIZE] = *Event;
+    __atomic_store_n(&input_in, in + 1, __ATOMIC_RELEASE);
+
+    return true;
+}
+
+bool ESP32INPUT_Get(ESP32INPUT_Event* Event)
+{
+    uint32_t out = input_out;
+
+    if (out == __atomic_load_n(&input_in, __ATOMIC_ACQUIRE)) {
+        return false;
+    }
+    *Event = input_ring[out % INPUT_RING_SIZE];
+    __atomic_store_n(&input_out, out + 1, __ATOMIC_RELEASE);
+
+    return true;
+}
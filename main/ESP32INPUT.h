@@ -0,0 +1,41 @@
+#ifndef _ESP32INPUT_H_
+#define _ESP32INPUT_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "sdkconfig.h"
+
+// input events from the HID link to the emulator
+//
+// A lock-free ring of 1 << CONFIG_MINIVMAC_INPUT_RING_LG2 events with
+// one producer, the input task, and one consumer, the emulator task,
+// which takes them at the start of each tick. Neither side ever waits
+// for the other: Put fails when the ring is full and Get when it is
+// empty.
+//
+// Each event carries the time (ESP32API_GetTimeUS, low 32 bits) its
+// bytes arrived, so the emulator can tell how long input took.
+
+typedef enum {
+    ESP32INPUT_KEY,     // HID usage Code going Down or up
+    ESP32INPUT_BUTTON,  // left mouse button Down or up
+    ESP32INPUT_DELTA,   // mouse moved by DX, DY
+    ESP32INPUT_POSITION // pointer at DX, DY on the Mac screen (touch)
+} ESP32INPUT_EventType;
+
+typedef struct {
+    uint32_t TimeUS;
+    int16_t DX;
+    int16_t DY;
+    uint8_t Type;
+    uint8_t Code;
+    uint8_t Down;
+} ESP32INPUT_Event;
+
+// producer
+bool ESP32INPUT_Put( const ESP32INPUT_Event* Event );
+
+// consumer
+bool ESP32INPUT_Get( ESP32INPUT_Event* Event );
+
+#endif
@@ -0,0 +1,224 @@
+/*
+ Copyright (C) 2025  <uliuc@gmx.net >
+
+ This program is free software; you can redistribute it and/or modify it
+ under the terms of the GNU General Public License as published by the
+ Free Software Foundation; either version 3 of the License, or (at your
+ option) any later version.
+
+ This program is distributed in the hope that it will be useful, but
+ WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ for more details.
+
+ For the complete text of the GNU General Public License see
+ http://www.gnu.org/licenses/.
+
+*/
+
+#include "ESP32LAT.h"
+
+#ifdef CONFIG_MINIVMAC_LATENCY
+
+#include <stdio.h>
+#include <string.h>
+#include "esp_timer.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+static const char* TAG = "ESP32LAT";
+
+#define LAT_PATH "/spiffs/latency.csv"
+
+// a probe older than this is given up for a new one
+#define LAT_TIMEOUT_US 1000000
+
+// what the probe waits for
+enum {
+    LAT_IDLE,
+    LAT_WAIT_APPLIED,
+    LAT_WAIT_DRAWN,
+    LAT_WAIT_SHOWN
+};
+
+static uint32_t lat_state = LAT_IDLE;
+static uint32_t lat_arrival_us;
+static uint32_t lat_last_us; // end of the last stage reached
+static uint32_t lat_frame;
+static uint32_t lat_lost = 0;
+
+// LINK to DRAW are written by the emulator task, DISPLAY and TOTAL by the
+// display task
+static ESP32LAT_Hist lat_hist[ESP32LAT_NUM_STAGES];
+
+static TaskHandle_t lat_task_hdl = NULL;
+
+static uint32_t lat_now(void)
+{
+    return (uint32_t)esp_timer_get_time();
+}
+
+static void lat_record(int stage, uint32_t us)
+{
+    ESP32LAT_Hist* h = &lat_hist[stage];
+    int b = 0;
+
+    while (b < ESP32LAT_BUCKETS - 1 && us >= ((uint32_t)ESP32LAT_FIRST_BUCKET_US << b)) {
+        b++;
+    }
+    h->Buckets[b]++;
+    h->SumUS += us;
+    if (us > h->MaxUS) {
+        h->MaxUS = us;
+    }
+    h->Count++;
+}
+
+bool ESP32LAT_Start(uint32_t ArrivalUS)
+{
+    uint32_t now = lat_now();
+    uint32_t state = __atomic_load_n(&lat_state, __ATOMIC_ACQUIRE);
+
+    if (state != LAT_IDLE) {
+        if (now - lat_arrival_us < LAT_TIMEOUT_US) {
+            return false;
+        }
+        // the display task may just be taking it
+        if (!__atomic_compare_exchange_n(&lat_state, &state, LAT_IDLE, false,
+                __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            return false;
+        }
+        lat_lost++;
+    }
+
+    lat_record(ESP32LAT_LINK, now - ArrivalUS);
+    lat_arrival_us = ArrivalUS;
+    lat_last_us = now;
+    __atomic_store_n(&lat_state, LAT_WAIT_APPLIED, __ATOMIC_RELEASE);
+
+    return true;
+}
+
+void ESP32LAT_Applied(void)
+{
+    if (lat_state == LAT_WAIT_APPLIED) {
+        uint32_t now = lat_now();
+
+        lat_record(ESP32LAT_QUEUE, now - lat_last_us);
+        lat_last_us = now;
+        lat_state = LAT_WAIT_DRAWN;
+    }
+}
+
+void ESP32LAT_Drawn(uint32_t Frame)
+{
+    if (lat_state == LAT_WAIT_DRAWN) {
+        uint32_t now = lat_now();
+
+        lat_record(ESP32LAT_DRAW, now - lat_last_us);
+        lat_last_us = now;
+        lat_frame = Frame;
+        __atomic_store_n(&lat_state, LAT_WAIT_SHOWN, __ATOMIC_RELEASE);
+    }
+}
+
+void ESP32LAT_Shown(uint32_t Frame)
+{
+    uint32_t state = __atomic_load_n(&lat_state, __ATOMIC_ACQUIRE);
+
+    if (state != LAT_WAIT_SHOWN || (int32_t)(Frame - lat_frame) < 0) {
+        return;
+    }
+
+    // read before letting the emulator start the next probe
+    uint32_t arrival = lat_arrival_us;
+    uint32_t drawn = lat_last_us;
+    uint32_t now = lat_now();
+
+    if (__atomic_compare_exchange_n(&lat_state, &state, LAT_IDLE, false,
+            __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        lat_record(ESP32LAT_DISPLAY, now - drawn);
+        lat_record(ESP32LAT_TOTAL, now - arrival);
+    }
+}
+
+void ESP32LAT_GetHist(int Stage, ESP32LAT_Hist* Hist)
+{
+    *Hist = lat_hist[Stage];
+}
+
+const char* ESP32LAT_StageName(int Stage)
+{
+    static const char* names[ESP32LAT_NUM_STAGES] = {
+        "link", "queue", "draw", "display", "total"
+    };
+
+    return (Stage >= 0 && Stage < ESP32LAT_NUM_STAGES) ? names[Stage] : "?";
+}
+
+uint32_t ESP32LAT_GetLost(void)
+{
+    return lat_lost;
+}
+
+static void lat_dump(FILE* f)
+{
+    fprintf(f, "stage,count,mean_us,max_us");
+    for (int b = 0; b < ESP32LAT_BUCKETS - 1; b++) {
+        fprintf(f, ",below_%lu_us", (unsigned long)ESP32LAT_FIRST_BUCKET_US << b);
+    }
+    fprintf(f, ",more\n");
+
+    for (int i = 0; i < ESP32LAT_NUM_STAGES; i++) {
+        ESP32LAT_Hist h;
+
+        ESP32LAT_GetHist(i, &h);
+        fprintf(f, "%s,%lu,%lu,%lu", ESP32LAT_StageName(i),
+            (unsigned long)h.Count,
+            (unsigned long)(h.Count ? h.SumUS / h.Count : 0),
+            (unsigned long)h.MaxUS);
+        for (int b = 0; b < ESP32LAT_BUCKETS; b++) {
+            fprintf(f, ",%lu", (unsigned long)h.Buckets[b]);
+        }
+        fprintf(f, "\n");
+    }
+}
+
+static void lat_task(void* Param)
+{
+    while (true) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+#ifdef CONFIG_MINIVMAC_LATENCY_TO_SPIFFS
+        FILE* f = fopen(LAT_PATH, "w");
+        if (f) {
+            ESP_LOGI(TAG, "writing %s", LAT_PATH);
+            lat_dump(f);
+            fclose(f);
+        } else {
+            ESP_LOGE(TAG, "could not open %s", LAT_PATH);
+        }
+#else
+        ESP_LOGI(TAG, "latency follows, save it as latency.csv");
+        lat_dump(stdout);
+        fflush(stdout);
+#endif
+        ESP_LOGI(TAG, "%lu probes given up", (unsigned long)lat_lost);
+    }
+}
+
+void ESP32LAT_RequestDump(void)
+{
+    if (lat_task_hdl) {
+        xTaskNotifyGive(lat_task_hdl);
+    }
+}
+
+void ESP32LAT_Init(void)
+{
+    memset(lat_hist, 0, sizeof(lat_hist));
+    xTaskCreate(lat_task, "lat_task", 3072, NULL, 1, &lat_task_hdl);
+}
+
+#endif /* CONFIG_MINIVMAC_LATENCY */
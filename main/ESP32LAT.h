@@ -0,0 +1,62 @@
+#ifndef _ESP32LAT_H_
+#define _ESP32LAT_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "sdkconfig.h"
+
+// input to screen latency probes
+//
+// One mouse movement at a time is followed through the stages below, each
+// timed from the end of the one before. A probe that does not reach the
+// screen within a second (the cursor is hidden, the Mac is busy) is given
+// up when the next one starts. Every stage keeps a histogram with log2
+// buckets from 125 us up to 128 ms and more, and count, mean and maximum.
+//
+// Start, Applied and Drawn are called from the emulator task, Shown from
+// the display task.
+
+#ifdef CONFIG_MINIVMAC_LATENCY
+
+typedef enum {
+    ESP32LAT_LINK,      // bytes arrived on the HID link -> emulator took it
+    ESP32LAT_QUEUE,     // emulator took it -> Mouse_Update gave it to the Mac
+    ESP32LAT_DRAW,      // -> screen change at the new cursor position
+    ESP32LAT_DISPLAY,   // -> vsync of the frame with that change
+    ESP32LAT_TOTAL,     // bytes arrived -> vsync
+
+    ESP32LAT_NUM_STAGES
+} ESP32LAT_Stage;
+
+#define ESP32LAT_BUCKETS 12
+#define ESP32LAT_FIRST_BUCKET_US 125 // upper end of bucket 0, doubling
+
+typedef struct {
+    uint32_t Count;
+    uint32_t MaxUS;
+    uint64_t SumUS;
+    uint32_t Buckets[ESP32LAT_BUCKETS];
+} ESP32LAT_Hist;
+
+void ESP32LAT_Init( void );
+
+// a new probe for an event whose bytes arrived at ArrivalUS (low 32 bits
+// of esp_timer_get_time), false while another one is under way
+bool ESP32LAT_Start( uint32_t ArrivalUS );
+void ESP32LAT_Applied( void );
+// the change goes out with the frame of sequence number Frame
+void ESP32LAT_Drawn( uint32_t Frame );
+// display task: the frame Frame is on the panel
+void ESP32LAT_Shown( uint32_t Frame );
+
+void ESP32LAT_GetHist( int Stage, ESP32LAT_Hist* Hist );
+const char* ESP32LAT_StageName( int Stage );
+// probes given up since start
+uint32_t ESP32LAT_GetLost( void );
+
+// write the histograms as CSV from a low priority task
+void ESP32LAT_RequestDump( void );
+
+#endif
+
+#endif
@@ -0,0 +1,297 @@
+/*
+ Copyright (C) 2025  <uliuc@gmx.net >
+
+ This program is free software; you can redistribute it and/or modify it
+ under the terms of the GNU General Public License as published by the
+ Free Software Foundation; either version 3 of the License, or (at your
+ option) any later version.
+
+ This program is distributed in the hope that it will be useful, but
+ WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ for more details.
+
+ For the complete text of the GNU General Public License see
+ http://www.gnu.org/licenses/.
+
+*/
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include "ESP32MAP.h"
+
+#include "SYSDEPNS.h"
+
+#if (vMacScreenWidth != ESP32MAP_WIDTH) || (vMacScreenHeight != ESP32MAP_HEIGHT)
+#error "ESP32MAP is made for the 512 x 342 screen"
+#endif
+
+// RGB565 pixels of each source byte value, per depth; the template reads
+// them in 32 bit pieces, down to 16 bit for 8 bits per pixel
+static uint16_t map_1[256 * 8] __attribute__((aligned(4)));
+static uint16_t map_2[256 * 4] __attribute__((aligned(4)));
+static uint16_t map_4[256 * 2] __attribute__((aligned(4)));
+static uint16_t map_8[256 * 1] __attribute__((aligned(4)));
+
+static uint16_t* const maps[4] = { map_1, map_2, map_4, map_8 };
+
+// template arguments, set before each call
+static const uint8_t* map_src;
+static uint16_t* map_dst;
+
+#define ScrnMapr_DoMap ScrnMapr_1
+#define ScrnMapr_Src map_src
+#define ScrnMapr_Dst map_dst
+#define ScrnMapr_SrcDepth 0
+#define ScrnMapr_DstDepth 4
+#define ScrnMapr_Map map_1
+#include "SCRNMAPR.h"
+
+#define ScrnMapr_DoMap ScrnMapr_2
+#define ScrnMapr_Src map_src
+#define ScrnMapr_Dst map_dst
+#define ScrnMapr_SrcDepth 1
+#define ScrnMapr_DstDepth 4
+#define ScrnMapr_Map map_2
+#include "SCRNMAPR.h"
+
+#define ScrnMapr_DoMap ScrnMapr_4
+#define ScrnMapr_Src map_src
+#define ScrnMapr_Dst map_dst
+#define ScrnMapr_SrcDepth 2
+#define ScrnMapr_DstDepth 4
+#define ScrnMapr_Map map_4
+#include "SCRNMAPR.h"
+
+#define ScrnMapr_DoMap ScrnMapr_8
+#define ScrnMapr_Src map_src
+#define ScrnMapr_Dst map_dst
+#define ScrnMapr_SrcDepth 3
+#define ScrnMapr_DstDepth 4
+#define ScrnMapr_Map map_8
+#include "SCRNMAPR.h"
+
+static uint16_t rgb565(uint16_t r, uint16_t g, uint16_t b)
+{
+    return (r & 0xF800) | ((g >> 5) & 0x07E0) | (b >> 11);
+}
+
+void ESP32MAP_SetPalette(int Depth, const uint16_t* Reds, const uint16_t* Greens, const uint16_t* Blues)
+{
+    int bits = 1 << Depth;
+    int pixels = 8 >> Depth;
+    uint16_t colors[256];
+    uint16_t* p = maps[Depth];
+
+    for (int i = 0; i < (1 << bits); i++) {
+        colors[i] = rgb565(Reds[i], Greens[i], Blues[i]);
+    }
+
+    // first pixel in the high bits
+    for (int byte = 0; byte < 256; byte++) {
+        for (int k = 0; k < pixels; k++) {
+            *p++ = colors[(byte >> (8 - bits - k * bits)) & ((1 << bits) - 1)];
+        }
+    }
+}
+
+void ESP32MAP_Init(void)
+{
+    uint16_t ramp[256];
+
+    for (int depth = 0; depth < 4; depth++) {
+        int n = 1 << (1 << depth);
+
+        for (int i = 0; i < n; i++) {
+            ramp[i] = 0xFFFF - (uint16_t)((uint32_t)i * 0xFFFF / (n - 1));
+        }
+        ESP32MAP_SetPalette(depth, ramp, ramp, ramp);
+    }
+}
+
+void ESP32MAP_Map(int Depth, const uint8_t* Src, uint16_t* Dst, int Top, int Left, int Bottom, int Right)
+{
+    map_src = Src;
+    map_dst = Dst;
+    switch (Depth) {
+        case 0:
+            ScrnMapr_1(Top, Left, Bottom, Right);
+            break;
+        case 1:
+            ScrnMapr_2(Top, Left, Bottom, Right);
+            break;
+        case 2:
+            ScrnMapr_4(Top, Left, Bottom, Right);
+            break;
+        case 3:
+            ScrnMapr_8(Top, Left, Bottom, Right);
+            break;
+    }
+}
+
+// the pixel at (x, y) looked up in the palette by itself
+static uint16_t check_pixel(const uint8_t* src, int depth, const uint16_t* palette, int x, int y)
+{
+    int bits = 1 << depth;
+    uint32_t bit = (uint32_t)x * bits;
+    uint8_t byte = src[y * ((ESP32MAP_WIDTH * bits) / 8) + bit / 8];
+
+    return palette[(byte >> (8 - bits - bit % 8)) & ((1 << bits) - 1)];
+}
+
+static uint32_t check_area(const uint8_t* src, uint16_t* dst, int depth, const uint16_t* palette,
+    int top, int left, int bottom, int right)
+{
+    // whole source bytes
+    int per_byte = 8 >> depth;
+    int left_al = left / per_byte * per_byte;
+    int right_al = (right + per_byte - 1) / per_byte * per_byte;
+    uint32_t wrong = 0;
+
+    memset(dst, 0xAA, ESP32MAP_WIDTH * ESP32MAP_HEIGHT * sizeof(uint16_t));
+    ESP32MAP_Map(depth, src, dst, top, left, bottom, right);
+
+    for (int y = 0; y < ESP32MAP_HEIGHT; y++) {
+        for (int x = 0; x < ESP32MAP_WIDTH; x++) {
+            bool inside = y >= top && y < bottom && x >= left_al && x < right_al;
+            uint16_t want = inside ? check_pixel(src, depth, palette, x, y) : 0xAAAA;
+
+            if (dst[y * ESP32MAP_WIDTH + x] != want) {
+                wrong++;
+            }
+        }
+    }
+
+    return wrong;
+}
+
+uint32_t ESP32MAP_Check(void)
+{
+    size_t src_size = ESP32MAP_WIDTH * ESP32MAP_HEIGHT; // 8 bits per pixel
+    uint8_t* src = malloc(src_size);
+    uint16_t* dst = malloc(ESP32MAP_WIDTH * ESP32MAP_HEIGHT * sizeof(uint16_t));
+    uint16_t* saved = malloc(sizeof(map_1) + sizeof(map_2) + sizeof(map_4) + sizeof(map_8));
+    uint32_t wrong = 0;
+
+    if (!src || !dst || !saved) {
+        free(src);
+        free(dst);
+        free(saved);
+        return UINT32_MAX;
+    }
+
+    // the palettes set by now stay
+    memcpy(saved, map_1, sizeof(map_1));
+    memcpy(saved + 256 * 8, map_2, sizeof(map_2));
+    memcpy(saved + 256 * 12, map_4, sizeof(map_4));
+    memcpy(saved + 256 * 14, map_8, sizeof(map_8));
+
+    srand(1);
+    for (int depth = 0; depth < 4; depth++) {
+        for (int n = 0; n < 4; n++) {
+            uint16_t reds[256];
+            uint16_t greens[256];
+            uint16_t blues[256];
+            uint16_t palette[256];
+
+            for (int i = 0; i < 256; i++) {
+                reds[i] = (uint16_t)rand();
+                greens[i] = (uint16_t)rand();
+                blues[i] = (uint16_t)rand();
+                palette[i] = rgb565(reds[i], greens[i], blues[i]);
+            }
+            ESP32MAP_SetPalette(depth, reds, greens, blues);
+            for (size_t i = 0; i < src_size; i++) {
+                src[i] = (uint8_t)rand();
+            }
+
+            int left = rand() % ESP32MAP_WIDTH;
+            int right = left + 1 + rand() % (ESP32MAP_WIDTH - left);
+            int top = rand() % ESP32MAP_HEIGHT;
+            int bottom = top + 1 + rand() % (ESP32MAP_HEIGHT - top);
+
+            wrong += check_area(src, dst, depth, palette, 0, 0, ESP32MAP_HEIGHT, ESP32MAP_WIDTH);
+            wrong += check_area(src, dst, depth, palette, top, left, bottom, right);
+        }
+    }
+
+    memcpy(map_1, saved, sizeof(map_1));
+    memcpy(map_2, saved + 256 * 8, sizeof(map_2));
+    memcpy(map_4, saved + 256 * 12, sizeof(map_4));
+    memcpy(map_8, saved + 256 * 14, sizeof(map_8));
+
+    free(src);
+    free(dst);
+    free(saved);
+
+    return wrong;
+}
+
+#ifdef CONFIG_MINIVMAC_MAP_BENCH
+
+#include "esp_cpu.h"
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+
+#include "ESP32CONV.h"
+
+static const char* TAG = "ESP32MAP";
+
+static void bench_area(const char* name, const uint8_t* src, uint16_t* dst,
+    int top, int left, int bottom, int right)
+{
+    uint32_t pixels = (uint32_t)(bottom - top) * (right - left);
+
+    for (int depth = 0; depth < 4; depth++) {
+        uint32_t start = esp_cpu_get_cycle_count();
+        ESP32MAP_Map(depth, src, dst, top, left, bottom, right);
+        uint32_t cycles = esp_cpu_get_cycle_count() - start;
+
+        ESP_LOGI(TAG, "%s, %d bpp: %lu cycles, %lu kpixels/s", name, 1 << depth,
+            (unsigned long)cycles,
+            (unsigned long)((uint64_t)pixels * CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ * 1000 / (cycles ? cycles : 1)));
+    }
+
+    // what the 1 bit display path uses instead
+    uint32_t start = esp_cpu_get_cycle_count();
+    for (int y = top; y < bottom; y++) {
+        ESP32CONV_Expand(src + y * (ESP32MAP_WIDTH / 8) + left / 8,
+            dst + y * ESP32MAP_WIDTH + left / 8 * 8, (right - left) / 8);
+    }
+    uint32_t cycles = esp_cpu_get_cycle_count() - start;
+
+    ESP_LOGI(TAG, "%s, 1 bpp expand: %lu cycles, %lu kpixels/s", name,
+        (unsigned long)cycles,
+        (unsigned long)((uint64_t)pixels * CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ * 1000 / (cycles ? cycles : 1)));
+}
+
+void ESP32MAP_Benchmark(void)
+{
+    size_t src_size = ESP32MAP_WIDTH * ESP32MAP_HEIGHT;
+    uint8_t* src = heap_caps_malloc(src_size, MALLOC_CAP_DEFAULT);
+    uint16_t* dst = heap_caps_aligned_alloc(16, ESP32MAP_WIDTH * ESP32MAP_HEIGHT * sizeof(uint16_t), MALLOC_CAP_DEFAULT);
+
+    if (src && dst) {
+        for (size_t i = 0; i < src_size; i++) {
+            src[i] = (uint8_t)(i * 7 + (i >> 8));
+        }
+
+        bench_area("full frame", src, dst, 0, 0, ESP32MAP_HEIGHT, ESP32MAP_WIDTH);
+        // a menu
+        bench_area("partial 200x120", src, dst, 20, 24, 140, 224);
+        // a text caret
+        bench_area("partial 8x16", src, dst, 100, 136, 116, 144);
+
+        uint32_t wrong = ESP32MAP_Check();
+        ESP_LOGI(TAG, "all depths against the palette: %lu wrong pixels", (unsigned long)wrong);
+    } else {
+        ESP_LOGE(TAG, "no memory for the benchmark");
+    }
+
+    heap_caps_free(src);
+    heap_caps_free(dst);
+}
+
+#endif /* CONFIG_MINIVMAC_MAP_BENCH */
@@ -0,0 +1,43 @@
+#ifndef _ESP32MAP_H_
+#define _ESP32MAP_H_
+
+#include <stdint.h>
+#include "sdkconfig.h"
+
+// Mac screen of any indexed depth to RGB565
+//
+// The SCRNMAPR.h template made into one procedure per source depth, 1, 2,
+// 4 and 8 bits per pixel: each source byte indexes a map with the RGB565
+// pixels it stands for, copied in 16 or 32 bit pieces. A map is rebuilt
+// only when the palette of its depth changes. Only the area asked for is
+// mapped, widened to whole source bytes.
+//
+// Depth 0 starts black and white (a set bit is black), the others start
+// as gray ramps from white at index 0, as the Mac does.
+
+#define ESP32MAP_WIDTH 512
+#define ESP32MAP_HEIGHT 342
+
+void ESP32MAP_Init( void );
+
+// new palette for Depth (0 to 3), 1 << (1 << Depth) entries of 16 bit
+// per channel, as in CLUT_reds and friends
+void ESP32MAP_SetPalette( int Depth, const uint16_t* Reds, const uint16_t* Greens, const uint16_t* Blues );
+
+// map rows Top..Bottom-1 and pixels Left..Right-1 of the ESP32MAP_WIDTH x
+// ESP32MAP_HEIGHT screen Src of Depth into the RGB565 image Dst of the
+// same size
+void ESP32MAP_Map( int Depth, const uint8_t* Src, uint16_t* Dst, int Top, int Left, int Bottom, int Right );
+
+// map random screens of each depth with random palettes, in full and in
+// random areas, and compare with looking up each pixel; returns the number
+// of wrong pixels
+uint32_t ESP32MAP_Check( void );
+
+#ifdef CONFIG_MINIVMAC_MAP_BENCH
+// log cycles and pixels per second for a full frame and two partial ones
+// of each depth, and of the 1bpp PIE/table expansion next to them
+void ESP32MAP_Benchmark( void );
+#endif
+
+#endif
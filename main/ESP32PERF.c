@@ -0,0 +1,147 @@
+/*
+ Copyright (C) 2025  <uliuc@gmx.net >
+
+ This program is free software; you can redistribute it and/or modify it
+ under the terms of the GNU General Public License as published by the
+ Free Software Foundation; either version 3 of the License, or (at your
+ option) any later version.
+
+ This program is distributed in the hope that it will be useful, but
+ WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ for more details.
+
+ For the complete text of the GNU General Public License see
+ http://www.gnu.org/licenses/.
+
+*/
+
+#include "ESP32PERF.h"
+
+#ifdef CONFIG_MINIVMAC_PERF
+
+#include "ESP32TRACE.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+// Time rather than CCOUNT cycles: with frequency scaling (ESP32POWER) a
+// cycle is not always the same time.
+//
+// The counters only ever grow and wrap around. Each core only writes its
+// own row, and the snapshot works on differences, so no locking is needed.
+// A begin for an id that is already open on the same core, for example
+// a task preempted inside the same part, only counts as nested; the time
+// goes to the outer part.
+static uint32_t perf_start[2][TRACE_NUM_IDS];
+static uint8_t perf_depth[2][TRACE_NUM_IDS];
+static uint32_t perf_us[2][TRACE_NUM_IDS];
+static uint32_t perf_last[2][TRACE_NUM_IDS];
+static uint32_t perf_rate[TRACE_NUM_IDS];
+static uint32_t perf_nested[2];
+static uint32_t perf_nested_last = 0;
+static uint32_t perf_nested_rate = 0;
+static uint32_t perf_window_start = 0;
+static uint32_t perf_window_us = 0;
+
+static volatile uint32_t frames = 0;
+static uint32_t frames_last = 0;
+static uint32_t fps = 0;
+
+static volatile uint32_t pixels = 0;
+static uint32_t pixels_last = 0;
+static uint32_t pixel_rate = 0;
+
+void ESP32PERF_Begin(uint8_t id)
+{
+    int core = xPortGetCoreID();
+
+    if (perf_depth[core][id]++ == 0) {
+        perf_start[core][id] = (uint32_t)esp_timer_get_time();
+    } else {
+        perf_nested[core]++;
+    }
+}
+
+void ESP32PERF_End(uint8_t id)
+{
+    int core = xPortGetCoreID();
+
+    // an end without a begin, or the end of a nested begin
+    if (perf_depth[core][id] == 0 || --perf_depth[core][id] != 0) {
+        return;
+    }
+    perf_us[core][id] += (uint32_t)esp_timer_get_time() - perf_start[core][id];
+}
+
+void ESP32PERF_FrameDone(void)
+{
+    frames++;
+}
+
+void ESP32PERF_PixelsConverted(uint32_t n)
+{
+    pixels += n;
+}
+
+void ESP32PERF_SecondNotify(void)
+{
+    uint32_t now = (uint32_t)esp_timer_get_time();
+
+    perf_window_us = now - perf_window_start;
+    perf_window_start = now;
+
+    for (int id = 0; id < TRACE_NUM_IDS; id++) {
+        uint32_t sum = 0;
+
+        for (int core = 0; core < 2; core++) {
+            uint32_t c = perf_us[core][id];
+
+            sum += c - perf_last[core][id];
+            perf_last[core][id] = c;
+        }
+        perf_rate[id] = sum;
+    }
+
+    uint32_t n = perf_nested[0] + perf_nested[1];
+    perf_nested_rate = n - perf_nested_last;
+    perf_nested_last = n;
+
+    uint32_t f = frames;
+    fps = f - frames_last;
+    frames_last = f;
+
+    uint32_t p = pixels;
+    pixel_rate = p - pixels_last;
+    pixels_last = p;
+}
+
+uint32_t ESP32PERF_GetTimeUS(uint8_t id)
+{
+    return (id < TRACE_NUM_IDS) ? perf_rate[id] : 0;
+}
+
+uint32_t ESP32PERF_GetPct(uint8_t id)
+{
+    if (id >= TRACE_NUM_IDS || perf_window_us == 0) {
+        return 0;
+    }
+    return (uint32_t)(((uint64_t)perf_rate[id] * 100) / perf_window_us);
+}
+
+uint32_t ESP32PERF_GetNested(void)
+{
+    return perf_nested_rate;
+}
+
+uint32_t ESP32PERF_GetFPS(void)
+{
+    return fps;
+}
+
+uint32_t ESP32PERF_GetPixels(void)
+{
+    return pixel_rate;
+}
+
+#endif /* CONFIG_MINIVMAC_PERF */
@@ -0,0 +1,47 @@
+#ifndef _ESP32PERF_H_
+#define _ESP32PERF_H_
+
+#include <stdint.h>
+#include "sdkconfig.h"
+
+// host time accounting per part of the pipeline
+//
+// Uses the same ids as ESP32TRACE.h. Begin/end read esp_timer and add the
+// difference to a per core counter; the CPU frequency may change under
+// ESP32POWER, so cycles would not compare. Nested begins of the same id
+// on the same core are counted and their time goes to the outer one.
+// Once per second the counters are turned into time per second for the
+// HUD.
+
+#ifdef CONFIG_MINIVMAC_PERF
+
+void ESP32PERF_Begin( uint8_t Id );
+void ESP32PERF_End( uint8_t Id );
+
+// display task: one frame is on the panel
+void ESP32PERF_FrameDone( void );
+
+// display task: pixels converted to RGB565 for a frame
+void ESP32PERF_PixelsConverted( uint32_t Pixels );
+
+// take the per second snapshot, called from the emulator task
+void ESP32PERF_SecondNotify( void );
+
+// values of the last snapshot
+uint32_t ESP32PERF_GetTimeUS( uint8_t Id ); // both cores, per second
+uint32_t ESP32PERF_GetPct( uint8_t Id ); // of the time that passed
+uint32_t ESP32PERF_GetNested( void ); // nested begins, per second
+uint32_t ESP32PERF_GetFPS( void );
+uint32_t ESP32PERF_GetPixels( void ); // per second
+
+#define PERF_BEGIN(id) ESP32PERF_Begin(id)
+#define PERF_END(id) ESP32PERF_End(id)
+
+#else
+
+#define PERF_BEGIN(id)
+#define PERF_END(id)
+
+#endif
+
+#endif
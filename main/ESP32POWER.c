@@ -0,0 +1,213 @@
+/*
+ Copyright (C) 2025  <uliuc@gmx.net >
+
+ This program is free software; you can redistribute it and/or modify it
+ under the terms of the GNU General Public License as published by the
+ Free Software Foundation; either version 3 of the License, or (at your
+ option) any later version.
+
+ This program is distributed in the hope that it will be useful, but
+ WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ for more details.
+
+ For the complete text of the GNU General Public License see
+ http://www.gnu.org/licenses/.
+
+*/
+
+#include "ESP32POWER.h"
+#include "esp_pm.h"
+#include "esp_timer.h"
+#include "esp_err.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "soc/rtc.h"
+
+static const char* TAG = "ESP32POWER";
+
+static esp_pm_lock_handle_t emu_lock = NULL;
+static esp_pm_lock_handle_t disp_lock = NULL;
+static bool emu_busy = false;
+static bool disp_busy = false;
+
+// energy proxy metrics: time spent at each cpu frequency, sampled
+// whenever one of our locks changes, and blocking waits per second
+#define FREQ_SLOTS 5
+static const uint32_t freq_slot_mhz[FREQ_SLOTS] = { 240, 160, 80, 40, 0 };
+static int64_t freq_time_us[FREQ_SLOTS];
+static int64_t freq_since_us = 0;
+static int freq_slot = 0;
+static int64_t emu_busy_us = 0;
+static int64_t emu_busy_since_us = 0;
+static uint32_t wakeups = 0;
+#ifdef CONFIG_PM_PROFILING
+static uint32_t seconds = 0;
+#endif
+
+static portMUX_TYPE stats_mux = portMUX_INITIALIZER_UNLOCKED;
+
+static int current_freq_slot(void)
+{
+    rtc_cpu_freq_config_t cfg;
+    rtc_clk_cpu_freq_get_config(&cfg);
+
+    int slot = 0;
+    while (slot < FREQ_SLOTS - 1 && freq_slot_mhz[slot] != cfg.freq_mhz) {
+        slot++;
+    }
+    return slot;
+}
+
+// call with stats_mux held
+static void account_freq(void)
+{
+    int64_t now = esp_timer_get_time();
+
+    freq_time_us[freq_slot] += now - freq_since_us;
+    freq_since_us = now;
+    freq_slot = current_freq_slot();
+}
+
+void ESP32POWER_Init(void)
+{
+#ifdef CONFIG_MINIVMAC_PM
+    esp_pm_config_t pm_config = {
+        .max_freq_mhz = CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ,
+        .min_freq_mhz = CONFIG_MINIVMAC_PM_MIN_FREQ_MHZ,
+#ifdef CONFIG_MINIVMAC_PM_LIGHT_SLEEP
+        .light_sleep_enable = true,
+#else
+        .light_sleep_enable = false,
+#endif
+    };
+
+    esp_err_t ret = esp_pm_configure(&pm_config);
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "power management not available: %s", esp_err_to_name(ret));
+        return;
+    }
+
+    if (esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, "emulator", &emu_lock) != ESP_OK) {
+        emu_lock = NULL;
+    }
+    if (esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, "display", &disp_lock) != ESP_OK) {
+        disp_lock = NULL;
+    }
+
+    // start at full speed, the emulator drops the lock once it knows better
+    if (emu_lock) {
+        esp_pm_lock_acquire(emu_lock);
+        emu_busy = true;
+    }
+
+    freq_since_us = esp_timer_get_time();
+    emu_busy_since_us = freq_since_us;
+    freq_slot = current_freq_slot();
+
+    ESP_LOGI(TAG, "cpu %d..%d MHz, light sleep %s", pm_config.min_freq_mhz,
+        pm_config.max_freq_mhz, pm_config.light_sleep_enable ? "on" : "off");
+#endif
+}
+
+void ESP32POWER_SetEmulatorBusy(bool busy)
+{
+    if (!emu_lock || busy == emu_busy) {
+        return;
+    }
+
+    // only the emulator task touches emu_lock
+    if (busy) {
+        esp_pm_lock_acquire(emu_lock);
+    } else {
+        esp_pm_lock_release(emu_lock);
+    }
+
+    portENTER_CRITICAL(&stats_mux);
+    int64_t now = esp_timer_get_time();
+    if (emu_busy) {
+        emu_busy_us += now - emu_busy_since_us;
+    }
+    emu_busy_since_us = now;
+    emu_busy = busy;
+    account_freq();
+    portEXIT_CRITICAL(&stats_mux);
+}
+
+void ESP32POWER_SetDisplayBusy(bool busy)
+{
+    if (!disp_lock || busy == disp_busy) {
+        return;
+    }
+
+    if (busy) {
+        esp_pm_lock_acquire(disp_lock);
+    } else {
+        esp_pm_lock_release(disp_lock);
+    }
+    disp_busy = busy;
+
+    portENTER_CRITICAL(&stats_mux);
+    account_freq();
+    portEXIT_CRITICAL(&stats_mux);
+}
+
+void ESP32POWER_Delay(uint32_t MSToDelay)
+{
+    vTaskDelay(pdMS_TO_TICKS(MSToDelay));
+
+    portENTER_CRITICAL(&stats_mux);
+    wakeups++;
+    portEXIT_CRITICAL(&stats_mux);
+}
+
+void ESP32POWER_SecondNotify(void)
+{
+    int64_t t[FREQ_SLOTS];
+    int64_t busy_us;
+    uint32_t wk;
+
+    if (!emu_lock) {
+        return;
+    }
+
+    portENTER_CRITICAL(&stats_mux);
+    account_freq();
+    int64_t now = freq_since_us;
+    if (emu_busy) {
+        emu_busy_us += now - emu_busy_since_us;
+        emu_busy_since_us = now;
+    }
+    for (int i = 0; i < FREQ_SLOTS; i++) {
+        t[i] = freq_time_us[i];
+        freq_time_us[i] = 0;
+    }
+    busy_us = emu_busy_us;
+    emu_busy_us = 0;
+    wk = wakeups;
+    wakeups = 0;
+    portEXIT_CRITICAL(&stats_mux);
+
+    // shares of the time that really passed, at whatever frequency
+    int64_t total = 0;
+    for (int i = 0; i < FREQ_SLOTS; i++) {
+        total += t[i];
+    }
+    if (total <= 0) {
+        total = 1;
+    }
+
+    ESP_LOGI(TAG, "emulator busy %lld ms, time at MHz 240:%d%% 160:%d%% 80:%d%% 40:%d%% other:%d%%"
+        " of %lld ms, wake-ups %lu/s",
+        busy_us / 1000,
+        (int)(t[0] * 100 / total), (int)(t[1] * 100 / total), (int)(t[2] * 100 / total),
+        (int)(t[3] * 100 / total), (int)(t[4] * 100 / total),
+        total / 1000, (unsigned long)wk);
+
+#ifdef CONFIG_PM_PROFILING
+    if (++seconds % 10 == 0) {
+        esp_pm_dump_locks(stdout);
+    }
+#endif
+}
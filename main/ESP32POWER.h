@@ -0,0 +1,25 @@
+#ifndef _ESP32POWER_H_
+#define _ESP32POWER_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// power management driven by the emulator load
+//
+// The emulator holds a CPU_FREQ_MAX lock while it has work to do and
+// releases it while it waits for the next tick, is stopped or the guest
+// has been idle for a few ticks. The display task does the same while it converts a frame.
+// Without CONFIG_MINIVMAC_PM all of this is a no-op.
+
+void ESP32POWER_Init( void );
+
+void ESP32POWER_SetEmulatorBusy( bool Busy );
+void ESP32POWER_SetDisplayBusy( bool Busy );
+
+// blocking delay that is counted as a wake-up
+void ESP32POWER_Delay( uint32_t MSToDelay );
+
+// log time at each cpu frequency and wake-ups, once per second
+void ESP32POWER_SecondNotify( void );
+
+#endif
@@ -0,0 +1,247 @@
+/*
+ Copyright (C) 2025  <uliuc@gmx.net >
+
+ This program is free software; you can redistribute it and/or modify it
+ under the terms of the GNU General Public License as published by the
+ Free Software Foundation; either version 3 of the License, or (at your
+ option) any later version.
+
+ This program is distributed in the hope that it will be useful, but
+ WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ for more details.
+
+ For the complete text of the GNU General Public License see
+ http://www.gnu.org/licenses/.
+
+*/
+
+#include <string.h>
+
+#include "esp_log.h"
+
+#include "ESP32REC.h"
+#include "ESP32TRACE.h"
+
+static const char* TAG = "ESP32REC";
+
+static ESP32File rec_file = NULL;
+static int rec_row_bytes = 0;
+
+// the frame as last recorded
+static uint8_t* rec_prev = NULL;
+
+// records not yet written; one buffer fills while the writer task
+// writes the other
+static uint8_t* rec_bufs[2] = { NULL, NULL };
+static uint8_t* rec_buf = NULL;
+static int rec_cur = 0;
+static uint32_t rec_buf_size = 0;
+static uint32_t rec_buf_used = 0;
+static ESP32Write rec_write;
+
+// written at least this often, so a reset loses little
+#define REC_FLUSH_TICKS 60
+static uint32_t rec_flush_tick = 0;
+
+static uint32_t rec_records = 0;
+static uint32_t rec_bytes = 0;
+
+// longest coding of n bytes: a control byte per 128 literals, at worst
+// one more where a full literal run meets a lone zero
+static uint32_t rle_worst(uint32_t n)
+{
+    return n + n / 64 + 2;
+}
+
+typedef struct {
+    uint8_t* out;
+    uint8_t* lit;   // control byte of the open literal run, or NULL
+    uint32_t zeros; // zero bytes not yet written
+} rle_t;
+
+static void rle_byte(rle_t* r, uint8_t b)
+{
+    if (b == 0) {
+        if (++r->zeros == 128) {
+            *r->out++ = 127;
+            r->zeros = 0;
+            r->lit = NULL;
+        }
+        return;
+    }
+
+    if (r->zeros == 1 && r->lit && *r->lit <= 253) {
+        // a lone zero costs less inside the literal run
+        *r->out++ = 0;
+        (*r->lit)++;
+    } else {
+        if (r->zeros != 0) {
+            *r->out++ = r->zeros - 1;
+            r->lit = NULL;
+        }
+        if (!r->lit || *r->lit == 255) {
+            r->lit = r->out++;
+            *r->lit = 127;
+        }
+    }
+    r->zeros = 0;
+    *r->out++ = b;
+    (*r->lit)++;
+}
+
+static void rle_end(rle_t* r)
+{
+    if (r->zeros != 0) {
+        *r->out++ = r->zeros - 1;
+    }
+}
+
+static void put16(uint8_t* p, uint32_t v)
+{
+    p[0] = v;
+    p[1] = v >> 8;
+}
+
+static void put32(uint8_t* p, uint32_t v)
+{
+    put16(p, v);
+    put16(p + 2, v >> 16);
+}
+
+// hand the buffer to the writer task and go on with the other one, once
+// that is written; false if that failed
+static bool rec_flush(void)
+{
+    if (!ESP32API_WriteWait(&rec_write)) {
+        return false;
+    }
+
+    ESP32API_WriteStart(&rec_write, rec_file, rec_buf, rec_buf_used);
+    rec_bytes += rec_buf_used;
+    rec_cur ^= 1;
+    rec_buf = rec_bufs[rec_cur];
+    rec_buf_used = 0;
+
+    return true;
+}
+
+static void rec_free(void)
+{
+    ESP32API_free(rec_prev);
+    ESP32API_free(rec_bufs[0]);
+    ESP32API_free(rec_bufs[1]);
+    rec_prev = NULL;
+    rec_bufs[0] = NULL;
+    rec_bufs[1] = NULL;
+    rec_buf = NULL;
+    rec_buf_used = 0;
+}
+
+bool ESP32REC_Start(ESP32File Out, int Width, int Height)
+{
+    uint8_t header[ESP32REC_HEADER_SIZE];
+    uint32_t frame_bytes = (Width / 8) * Height;
+
+    if (!Out) {
+        return false;
+    }
+
+    rec_row_bytes = Width / 8;
+    rec_buf_size = ESP32REC_RECORD_SIZE + rle_worst(frame_bytes);
+    rec_prev = ESP32API_calloc(1, frame_bytes);
+    rec_bufs[0] = ESP32API_malloc(rec_buf_size);
+    rec_bufs[1] = ESP32API_malloc(rec_buf_size);
+    if (!rec_prev || !rec_bufs[0] || !rec_bufs[1]) {
+        ESP_LOGE(TAG, "no memory for recording");
+        rec_free();
+        ESP32API_close(Out);
+        return false;
+    }
+
+    memset(&rec_write, 0, sizeof(rec_write));
+    rec_cur = 0;
+    rec_buf = rec_bufs[0];
+
+    memcpy(header, ESP32REC_MAGIC, 4);
+    put16(header + 4, Width);
+    put16(header + 6, Height);
+    memcpy(rec_buf, header, sizeof(header));
+    rec_buf_used = sizeof(header);
+    rec_flush_tick = 0;
+    rec_records = 0;
+    rec_bytes = 0;
+    rec_file = Out;
+
+    return true;
+}
+
+void ESP32REC_Frame(uint32_t Tick, const uint8_t* Screen, int Top, int Left, int Bottom, int Right)
+{
+    if (!rec_file) {
+        return;
+    }
+
+    TRACE_BEGIN(TRACE_SCREEN_RECORD);
+
+    int bx1 = Left / 8;
+    int bx2 = (Right + 7) / 8;
+    uint32_t width = bx2 - bx1;
+    bool ok = true;
+
+    if (rec_buf_used + ESP32REC_RECORD_SIZE + rle_worst(width * (Bottom - Top)) > rec_buf_size
+            || Tick - rec_flush_tick >= REC_FLUSH_TICKS) {
+        rec_flush_tick = Tick;
+        ok = rec_flush();
+    }
+
+    if (!ok) {
+        ESP_LOGE(TAG, "write failed, recording stopped");
+        ESP32REC_Stop();
+    } else {
+        uint8_t* rec = rec_buf + rec_buf_used;
+        rle_t r = { rec + ESP32REC_RECORD_SIZE, NULL, 0 };
+
+        for (int y = Top; y < Bottom; y++) {
+            const uint8_t* p = Screen + y * rec_row_bytes + bx1;
+            uint8_t* q = rec_prev + y * rec_row_bytes + bx1;
+
+            for (uint32_t i = 0; i < width; i++) {
+                rle_byte(&r, p[i] ^ q[i]);
+                q[i] = p[i];
+            }
+        }
+        rle_end(&r);
+
+        put32(rec, Tick);
+        put16(rec + 4, Top);
+        put16(rec + 6, bx1 * 8);
+        put16(rec + 8, Bottom);
+        put16(rec + 10, bx2 * 8);
+        put32(rec + 12, r.out - rec - ESP32REC_RECORD_SIZE);
+        rec_buf_used = r.out - rec_buf;
+        rec_records++;
+    }
+
+    TRACE_END(TRACE_SCREEN_RECORD);
+}
+
+void ESP32REC_Stop(void)
+{
+    ESP32File f = rec_file;
+
+    if (!f) {
+        return;
+    }
+
+    // the last buffer, and wait for it before the file goes
+    if (!rec_flush() || !ESP32API_WriteWait(&rec_write)) {
+        ESP_LOGE(TAG, "write failed");
+    }
+    rec_file = NULL;
+    ESP32API_close(f);
+    ESP_LOGI(TAG, "%lu frames, %lu bytes recorded",
+        (unsigned long)rec_records, (unsigned long)rec_bytes);
+
+    rec_free();
+}
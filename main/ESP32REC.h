@@ -0,0 +1,48 @@
+#ifndef _ESP32REC_H_
+#define _ESP32REC_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "sdkconfig.h"
+#include "ESP32API.h"
+
+// recording of the screen output
+//
+// Each frame handed out by Screen_OutputFrame becomes one record with
+// the tick, the changed rectangle and the changed rows xor the frame
+// before, run length coded. Only the rectangle is read, so the cost
+// follows the size of the change. Records are collected in memory and
+// handed to the writer task of ESP32API_WriteStart when the buffer
+// fills, once a second and at the end; the next records go to a second
+// buffer meanwhile.
+//
+// File layout, all numbers little endian:
+//
+//   header   "MVR1", u16 width, u16 height
+//   record   u32 tick, u16 top, u16 left, u16 bottom, u16 right,
+//            u32 length, then length bytes of data
+//
+// left and right are widened to multiples of 8, bottom and right are
+// exclusive. The data are the (bottom - top) rows of (right - left) / 8
+// bytes each, one after the other, xor the last frame (all zero at
+// the start), coded as:
+//
+//   n = 0 .. 127     n + 1 zero bytes
+//   n = 128 .. 255   n - 127 bytes follow as they are
+//
+// host/RECREAD.c reads it back.
+
+#define ESP32REC_MAGIC "MVR1"
+#define ESP32REC_HEADER_SIZE 8
+#define ESP32REC_RECORD_SIZE 16
+
+// start recording into Out, which stays open until ESP32REC_Stop
+bool ESP32REC_Start( ESP32File Out, int Width, int Height );
+
+// one frame out of Screen_OutputFrame; does nothing while not started
+void ESP32REC_Frame( uint32_t Tick, const uint8_t* Screen, int Top, int Left, int Bottom, int Right );
+
+// write what is left and close the file
+void ESP32REC_Stop( void );
+
+#endif
@@ -0,0 +1,828 @@
+/*
+ Copyright (C) 2025  <uliuc@gmx.net >
+
+ This program is free software; you can redistribute it and/or modify it
+ under the terms of the GNU General Public License as published by the
+ Free Software Foundation; either version 3 of the License, or (at your
+ option) any later version.
+
+ This program is distributed in the hope that it will be useful, but
+ WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ for more details.
+
+ For the complete text of the GNU General Public License see
+ http://www.gnu.org/licenses/.
+
+*/
+
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include "esp_log.h"
+
+#include "ESP32RFB.h"
+
+#ifdef ESP_PLATFORM
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_wifi.h"
+#include "esp_event.h"
+#include "esp_netif.h"
+#include "nvs_flash.h"
+
+static portMUX_TYPE rfb_mux = portMUX_INITIALIZER_UNLOCKED;
+#define RFB_LOCK() portENTER_CRITICAL(&rfb_mux)
+#define RFB_UNLOCK() portEXIT_CRITICAL(&rfb_mux)
+
+#else
+
+#include <pthread.h>
+#include <sys/un.h>
+
+static pthread_mutex_t rfb_mutex = PTHREAD_MUTEX_INITIALIZER;
+#define RFB_LOCK() pthread_mutex_lock(&rfb_mutex)
+#define RFB_UNLOCK() pthread_mutex_unlock(&rfb_mutex)
+
+#endif
+
+static const char* TAG = "ESP32RFB";
+
+#define RFB_WIDTH 512
+#define RFB_HEIGHT 342
+#define RFB_ROW_BYTES (RFB_WIDTH / 8)
+
+#ifndef CONFIG_MINIVMAC_RFB_FPS
+#define CONFIG_MINIVMAC_RFB_FPS 30
+#endif
+
+#define RFB_ENC_RAW 0
+#define RFB_ENC_HEXTILE 5
+
+#define HEXTILE_RAW 1
+#define HEXTILE_BACKGROUND 2
+#define HEXTILE_FOREGROUND 4
+#define HEXTILE_SUBRECTS 8
+#define HEXTILE_MAX_SUBRECTS 255
+
+// shared with the emulator task
+static const uint8_t* rfb_screen = NULL;
+static int rfb_dirty_top = RFB_HEIGHT;
+static int rfb_dirty_left = RFB_WIDTH;
+static int rfb_dirty_bottom = 0;
+static int rfb_dirty_right = 0;
+
+// client events for the emulator, one producer and one consumer
+#define RFB_EVENTS 64
+static ESP32RFB_Event rfb_events[RFB_EVENTS];
+static uint32_t rfb_events_in = 0;
+static uint32_t rfb_events_out = 0;
+
+static int rfb_listen_fd = -1;
+
+// the client, only used by the server task
+typedef struct {
+    int fd;
+    bool hextile;
+    uint8_t bpp;         // bytes per pixel
+    bool big_endian;
+    uint32_t black;      // the two pixel values in the client format
+    uint32_t white;
+    bool update_wanted;
+    bool full_wanted;    // not incremental, send the whole screen
+    uint8_t buf[8192];   // update being sent
+    uint32_t used;
+    bool failed;
+} rfb_client_t;
+
+// screen rows read for the update
+static uint8_t rfb_shadow[RFB_ROW_BYTES * RFB_HEIGHT];
+
+void ESP32RFB_SetScreen(const uint8_t* Screen)
+{
+    __atomic_store_n(&rfb_screen, Screen, __ATOMIC_RELEASE);
+}
+
+void ESP32RFB_ScreenChanged(int Top, int Left, int Bottom, int Right)
+{
+    RFB_LOCK();
+    if (Top < rfb_dirty_top) rfb_dirty_top = Top;
+    if (Left < rfb_dirty_left) rfb_dirty_left = Left;
+    if (Bottom > rfb_dirty_bottom) rfb_dirty_bottom = Bottom;
+    if (Right > rfb_dirty_right) rfb_dirty_right = Right;
+    RFB_UNLOCK();
+}
+
+bool ESP32RFB_GetEvent(ESP32RFB_Event* Event)
+{
+    uint32_t out = rfb_events_out;
+
+    if (out == __atomic_load_n(&rfb_events_in, __ATOMIC_ACQUIRE)) {
+        return false;
+    }
+    *Event = rfb_events[out % RFB_EVENTS];
+    __atomic_store_n(&rfb_events_out, out + 1, __ATOMIC_RELEASE);
+
+    return true;
+}
+
+static void rfb_put_event(const ESP32RFB_Event* Event)
+{
+    uint32_t in = rfb_events_in;
+
+    // a full queue drops the event, the emulator is not waited for
+    if (in - __atomic_load_n(&rfb_events_out, __ATOMIC_ACQUIRE) >= RFB_EVENTS) {
+        return;
+    }
+    rfb_events[in % RFB_EVENTS] = *Event;
+    __atomic_store_n(&rfb_events_in, in + 1, __ATOMIC_RELEASE);
+}
+
+// --- socket helpers, the server task may block in them ---
+
+static bool rfb_recv(rfb_client_t* c, void* Buffer, size_t Size)
+{
+    uint8_t* p = Buffer;
+
+    while (Size != 0) {
+        ssize_t n = recv(c->fd, p, Size, 0);
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        p += n;
+        Size -= n;
+    }
+    return true;
+}
+
+static bool rfb_send(rfb_client_t* c, const void* Buffer, size_t Size)
+{
+    const uint8_t* p = Buffer;
+
+    while (Size != 0) {
+        ssize_t n = send(c->fd, p, Size, 0);
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        p += n;
+        Size -= n;
+    }
+    return true;
+}
+
+static bool rfb_skip(rfb_client_t* c, uint32_t Size)
+{
+    uint8_t dump[64];
+
+    while (Size != 0) {
+        uint32_t n = Size < sizeof(dump) ? Size : sizeof(dump);
+        if (!rfb_recv(c, dump, n)) {
+            return false;
+        }
+        Size -= n;
+    }
+    return true;
+}
+
+static uint32_t get16(const uint8_t* p)
+{
+    return ((uint32_t)p[0] << 8) | p[1];
+}
+
+static uint32_t get32(const uint8_t* p)
+{
+    return (get16(p) << 16) | get16(p + 2);
+}
+
+static void put16(uint8_t* p, uint32_t v)
+{
+    p[0] = v >> 8;
+    p[1] = v;
+}
+
+static void put32(uint8_t* p, uint32_t v)
+{
+    put16(p, v >> 16);
+    put16(p + 2, v);
+}
+
+// --- output buffer ---
+
+static void out_flush(rfb_client_t* c)
+{
+    if (c->used != 0 && !c->failed) {
+        c->failed = !rfb_send(c, c->buf, c->used);
+    }
+    c->used = 0;
+}
+
+// make room for Size bytes
+static uint8_t* out_reserve(rfb_client_t* c, uint32_t Size)
+{
+    if (c->used + Size > sizeof(c->buf)) {
+        out_flush(c);
+    }
+    uint8_t* p = c->buf + c->used;
+    c->used += Size;
+    return p;
+}
+
+static void out_pixel(rfb_client_t* c, bool Black)
+{
+    uint32_t v = Black ? c->black : c->white;
+    uint8_t* p = out_reserve(c, c->bpp);
+
+    for (int i = 0; i < c->bpp; i++) {
+        p[c->big_endian ? c->bpp - 1 - i : i] = v >> (8 * i);
+    }
+}
+
+static inline bool pixel(int x, int y)
+{
+    return (rfb_shadow[y * RFB_ROW_BYTES + (x >> 3)] >> (7 - (x & 7))) & 1;
+}
+
+// --- pixel format ---
+
+static void rfb_set_format(rfb_client_t* c, const uint8_t* pf)
+{
+    uint32_t max_r = get16(pf + 4);
+    uint32_t max_g = get16(pf + 6);
+    uint32_t max_b = get16(pf + 8);
+
+    c->bpp = pf[0] / 8;
+    if (c->bpp != 1 && c->bpp != 2 && c->bpp != 4) {
+        c->bpp = 4;
+    }
+    c->big_endian = pf[2] != 0;
+    c->black = 0;
+    if (pf[3]) {
+        // true colour, white is all channels at their maximum
+        c->white = (max_r << pf[10]) | (max_g << pf[11]) | (max_b << pf[12]);
+    } else {
+        // colour map, entry 0 black and 1 white
+        uint8_t msg[6 + 2 * 6] = { 1, 0, 0, 0, 0, 2 };
+        memset(msg + 12, 0xff, 6);
+        c->white = 1;
+        if (!rfb_send(c, msg, sizeof(msg))) {
+            c->failed = true;
+        }
+    }
+}
+
+// --- encoding ---
+
+static void encode_raw(rfb_client_t* c, int x0, int y0, int w, int h)
+{
+    for (int y = y0; y < y0 + h; y++) {
+        for (int x = x0; x < x0 + w; x++) {
+            out_pixel(c, pixel(x, y));
+        }
+    }
+}
+
+// one hextile tile, Bg and Fg are the colours the client still knows,
+// -1 if it knows none
+static void encode_tile(rfb_client_t* c, int x0, int y0, int w, int h, int* Bg, int* Fg)
+{
+    uint8_t rects[HEXTILE_MAX_SUBRECTS][4];
+    int n = 0;
+    int black = 0;
+
+    for (int y = y0; y < y0 + h; y++) {
+        for (int x = x0; x < x0 + w; x++) {
+            black += pixel(x, y);
+        }
+    }
+
+    // the background is the colour most of the tile has
+    int bg = (black * 2 > w * h) ? 1 : 0;
+    int fg = !bg;
+    bool raw = false;
+
+    if (black != 0 && black != w * h) {
+        // runs of the other colour in each row, grown down where the
+        // row below has the same run
+        int prev[8];
+        int nprev = 0;
+
+        for (int y = 0; y < h && !raw; y++) {
+            int cur[8];
+            int ncur = 0;
+            int x = 0;
+
+            while (x < w) {
+                while (x < w && pixel(x0 + x, y0 + y) != fg) {
+                    x++;
+                }
+                if (x == w) {
+                    break;
+                }
+                int start = x;
+                while (x < w && pixel(x0 + x, y0 + y) == fg) {
+                    x++;
+                }
+
+                int r = -1;
+                for (int i = 0; i < nprev; i++) {
+                    if (rects[prev[i]][0] == start && rects[prev[i]][2] == x - start) {
+                        r = prev[i];
+                        rects[r][3]++;
+                        break;
+                    }
+                }
+                if (r < 0) {
+                    if (n == HEXTILE_MAX_SUBRECTS) {
+                        raw = true;
+                        break;
+                    }
+                    r = n++;
+                    rects[r][0] = start;
+                    rects[r][1] = y;
+                    rects[r][2] = x - start;
+                    rects[r][3] = 1;
+                }
+                cur[ncur++] = r;
+            }
+            memcpy(prev, cur, ncur * sizeof(int));
+            nprev = ncur;
+        }
+        if (1 + 2 * c->bpp + 1 + 2 * n >= w * h * c->bpp) {
+            raw = true;
+        }
+    }
+
+    if (raw) {
+        *out_reserve(c, 1) = HEXTILE_RAW;
+        encode_raw(c, x0, y0, w, h);
+        // nothing is carried over a raw tile
+        *Bg = -1;
+        *Fg = -1;
+        return;
+    }
+
+    uint8_t sub = 0;
+    if (bg != *Bg) {
+        sub |= HEXTILE_BACKGROUND;
+    }
+    if (n != 0) {
+        sub |= HEXTILE_SUBRECTS;
+        if (fg != *Fg) {
+            sub |= HEXTILE_FOREGROUND;
+        }
+    }
+    *out_reserve(c, 1) = sub;
+    if (sub & HEXTILE_BACKGROUND) {
+        out_pixel(c, bg);
+        *Bg = bg;
+    }
+    if (sub & HEXTILE_FOREGROUND) {
+        out_pixel(c, fg);
+        *Fg = fg;
+    }
+    if (n != 0) {
+        uint8_t* p = out_reserve(c, 1 + 2 * n);
+        *p++ = n;
+        for (int i = 0; i < n; i++) {
+            *p++ = (rects[i][0] << 4) | rects[i][1];
+            *p++ = ((rects[i][2] - 1) << 4) | (rects[i][3] - 1);
+        }
+    }
+}
+
+static void encode_hextile(rfb_client_t* c, int x0, int y0, int w, int h)
+{
+    int bg = -1;
+    int fg = -1;
+
+    for (int ty = y0; ty < y0 + h; ty += 16) {
+        int th = (y0 + h - ty < 16) ? y0 + h - ty : 16;
+        for (int tx = x0; tx < x0 + w; tx += 16) {
+            int tw = (x0 + w - tx < 16) ? x0 + w - tx : 16;
+            encode_tile(c, tx, ty, tw, th, &bg, &fg);
+        }
+    }
+}
+
+static void rfb_send_update(rfb_client_t* c)
+{
+    int top;
+    int left;
+    int bottom;
+    int right;
+    const uint8_t* screen = __atomic_load_n(&rfb_screen, __ATOMIC_ACQUIRE);
+
+    if (!screen) {
+        return;
+    }
+
+    RFB_LOCK();
+    top = rfb_dirty_top;
+    left = rfb_dirty_left;
+    bottom = rfb_dirty_bottom;
+    right = rfb_dirty_right;
+    rfb_dirty_top = RFB_HEIGHT;
+    rfb_dirty_left = RFB_WIDTH;
+    rfb_dirty_bottom = 0;
+    rfb_dirty_right = 0;
+    RFB_UNLOCK();
+
+    if (c->full_wanted) {
+        top = 0;
+        left = 0;
+        bottom = RFB_HEIGHT;
+        right = RFB_WIDTH;
+    }
+    if (top < 0) top = 0;
+    if (left < 0) left = 0;
+    if (bottom > RFB_HEIGHT) bottom = RFB_HEIGHT;
+    if (right > RFB_WIDTH) right = RFB_WIDTH;
+    if (top >= bottom || left >= right) {
+        return;
+    }
+
+    // a copy, the emulator goes on drawing; what it draws meanwhile
+    // comes again with the next change
+    memcpy(rfb_shadow + top * RFB_ROW_BYTES, screen + top * RFB_ROW_BYTES,
+        (bottom - top) * RFB_ROW_BYTES);
+
+    uint8_t* p = out_reserve(c, 4 + 12);
+    p[0] = 0;
+    p[1] = 0;
+    put16(p + 2, 1);
+    put16(p + 4, left);
+    put16(p + 6, top);
+    put16(p + 8, right - left);
+    put16(p + 10, bottom - top);
+    put32(p + 12, c->hextile ? RFB_ENC_HEXTILE : RFB_ENC_RAW);
+
+    if (c->hextile) {
+        encode_hextile(c, left, top, right - left, bottom - top);
+    } else {
+        encode_raw(c, left, top, right - left, bottom - top);
+    }
+    out_flush(c);
+
+    c->update_wanted = false;
+    c->full_wanted = false;
+}
+
+// --- protocol ---
+
+static bool rfb_handshake(rfb_client_t* c)
+{
+    static const char version[] = "RFB 003.008\n";
+    char client_version[12];
+    uint8_t b[24];
+    int minor;
+
+    if (!rfb_send(c, version, 12) || !rfb_recv(c, client_version, 12)) {
+        return false;
+    }
+    minor = atoi(client_version + 8);
+
+    if (minor < 7) {
+        // 3.3: the server picks, no result
+        put32(b, 1);
+        if (!rfb_send(c, b, 4)) {
+            return false;
+        }
+    } else {
+        b[0] = 1;
+        b[1] = 1;  // none
+        if (!rfb_send(c, b, 2) || !rfb_recv(c, b, 1) || b[0] != 1) {
+            return false;
+        }
+        if (minor >= 8) {
+            put32(b, 0);
+            if (!rfb_send(c, b, 4)) {
+                return false;
+            }
+        }
+    }
+
+    // ClientInit, shared or not is all the same here
+    if (!rfb_recv(c, b, 1)) {
+        return false;
+    }
+
+    // ServerInit: 32 bit true colour, 8 bits per channel
+    static const char name[] = "Mini vMac";
+    uint8_t init[24 + sizeof(name) - 1] = { 0 };
+    put16(init, RFB_WIDTH);
+    put16(init + 2, RFB_HEIGHT);
+    init[4] = 32;
+    init[5] = 24;
+    init[6] = 0;
+    init[7] = 1;
+    put16(init + 8, 255);
+    put16(init + 10, 255);
+    put16(init + 12, 255);
+    init[14] = 16;
+    init[15] = 8;
+    init[16] = 0;
+    put32(init + 20, sizeof(name) - 1);
+    memcpy(init + 24, name, sizeof(name) - 1);
+    rfb_set_format(c, init + 4);
+
+    return rfb_send(c, init, sizeof(init));
+}
+
+static bool rfb_message(rfb_client_t* c)
+{
+    uint8_t b[20];
+    ESP32RFB_Event ev = { 0 };
+
+    if (!rfb_recv(c, b, 1)) {
+        return false;
+    }
+
+    switch (b[0]) {
+        case 0: // SetPixelFormat
+            if (!rfb_recv(c, b, 19)) {
+                return false;
+            }
+            rfb_set_format(c, b + 3);
+            c->full_wanted = true;
+            break;
+        case 2: { // SetEncodings
+            if (!rfb_recv(c, b, 3)) {
+                return false;
+            }
+            uint32_t n = get16(b + 1);
+            c->hextile = false;
+            while (n--) {
+                if (!rfb_recv(c, b, 4)) {
+                    return false;
+                }
+                if ((int32_t)get32(b) == RFB_ENC_HEXTILE) {
+                    c->hextile = true;
+                }
+            }
+            break;
+        }
+        case 3: // FramebufferUpdateRequest
+            if (!rfb_recv(c, b, 9)) {
+                return false;
+            }
+            c->update_wanted = true;
+            if (!b[0]) {
+                c->full_wanted = true;
+            }
+            break;
+        case 4: // KeyEvent
+            if (!rfb_recv(c, b, 7)) {
+                return false;
+            }
+            ev.Type = ESP32RFB_EVENT_KEY;
+            ev.Down = b[0];
+            ev.KeySym = get32(b + 3);
+            rfb_put_event(&ev);
+            break;
+        case 5: // PointerEvent
+            if (!rfb_recv(c, b, 5)) {
+                return false;
+            }
+            ev.Type = ESP32RFB_EVENT_POINTER;
+            ev.Buttons = b[0];
+            ev.X = get16(b + 1);
+            ev.Y = get16(b + 3);
+            rfb_put_event(&ev);
+            break;
+        case 6: // ClientCutText
+            if (!rfb_recv(c, b, 7)) {
+                return false;
+            }
+            return rfb_skip(c, get32(b + 3));
+        default:
+            ESP_LOGW(TAG, "unknown message %d", b[0]);
+            return false;
+    }
+
+    return !c->failed;
+}
+
+static void rfb_serve(int fd)
+{
+    rfb_client_t* c = calloc(1, sizeof(rfb_client_t));
+    int one = 1;
+
+    if (!c) {
+        return;
+    }
+    c->fd = fd;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    if (rfb_handshake(c)) {
+        ESP_LOGI(TAG, "client connected");
+        while (!c->failed) {
+            struct timeval tv = { 0, 1000000 / CONFIG_MINIVMAC_RFB_FPS };
+            fd_set rd;
+
+            FD_ZERO(&rd);
+            FD_SET(fd, &rd);
+            int r = select(fd + 1, &rd, NULL, NULL, &tv);
+            if (r < 0 && errno != EINTR) {
+                break;
+            }
+            if (r > 0 && !rfb_message(c)) {
+                break;
+            }
+            if (c->update_wanted) {
+                rfb_send_update(c);
+            }
+        }
+        ESP_LOGI(TAG, "client gone");
+    }
+
+    free(c);
+}
+
+static void* rfb_task(void* arg)
+{
+    (void)arg;
+
+    for (;;) {
+        int fd = accept(rfb_listen_fd, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        // the new client sees the whole screen
+        ESP32RFB_ScreenChanged(0, 0, RFB_HEIGHT, RFB_WIDTH);
+        rfb_serve(fd);
+        close(fd);
+    }
+    ESP_LOGE(TAG, "accept failed, server stopped");
+
+    return NULL;
+}
+
+#ifdef ESP_PLATFORM
+
+static void rfb_task_entry(void* arg)
+{
+    (void)arg;
+
+    rfb_task(NULL);
+    vTaskDelete(NULL);
+}
+
+#endif
+
+bool ESP32RFB_Start(const char* Path, int Port)
+{
+    int fd;
+
+    if (Path) {
+#ifdef ESP_PLATFORM
+        return false;
+#else
+        struct sockaddr_un sun = { 0 };
+
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        sun.sun_family = AF_UNIX;
+        strncpy(sun.sun_path, Path, sizeof(sun.sun_path) - 1);
+        unlink(Path);
+        if (fd < 0 || bind(fd, (struct sockaddr*)&sun, sizeof(sun)) != 0) {
+            ESP_LOGE(TAG, "could not bind %s", Path);
+            if (fd >= 0) {
+                close(fd);
+            }
+            return false;
+        }
+#endif
+    } else {
+        struct sockaddr_in sin = { 0 };
+        int one = 1;
+
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        sin.sin_family = AF_INET;
+        sin.sin_port = htons(Port);
+#ifdef ESP_PLATFORM
+        sin.sin_addr.s_addr = htonl(INADDR_ANY);
+#else
+        // the host build is for testing, stay on loopback
+        sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+#endif
+        if (fd >= 0) {
+            setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        }
+        if (fd < 0 || bind(fd, (struct sockaddr*)&sin, sizeof(sin)) != 0) {
+            ESP_LOGE(TAG, "could not bind port %d", Port);
+            if (fd >= 0) {
+                close(fd);
+            }
+            return false;
+        }
+    }
+
+    if (listen(fd, 1) != 0) {
+        close(fd);
+        return false;
+    }
+    rfb_listen_fd = fd;
+
+#ifdef ESP_PLATFORM
+    // on the display core, below the display task
+    xTaskCreatePinnedToCore(rfb_task_entry, "rfb_task", 6144, NULL, 3, NULL, 1);
+#else
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, rfb_task, NULL) != 0) {
+        close(fd);
+        rfb_listen_fd = -1;
+        return false;
+    }
+    pthread_detach(thread);
+#endif
+
+    if (Path) {
+        ESP_LOGI(TAG, "listening on %s", Path);
+    } else {
+        ESP_LOGI(TAG, "listening on port %d", Port);
+    }
+    return true;
+}
+
+#ifdef ESP_PLATFORM
+
+static void rfb_wifi_event(void* arg, esp_event_base_t base, int32_t id, void* data)
+{
+    (void)arg;
+
+    if (base == WIFI_EVENT && (id == WIFI_EVENT_STA_START || id == WIFI_EVENT_STA_DISCONNECTED)) {
+        esp_wifi_connect();
+    } else if (base == IP_EVENT && id == IP_EVENT_STA_GOT_IP) {
+        ip_event_got_ip_t* got = data;
+        ESP_LOGI(TAG, "connect a VNC client to " IPSTR ":%d",
+            IP2STR(&got->ip_info.ip), CONFIG_MINIVMAC_RFB_PORT);
+    }
+}
+
+static bool rfb_wifi_ok(esp_err_t ret, const char* what)
+{
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "%s failed: %s", what, esp_err_to_name(ret));
+        return false;
+    }
+    return true;
+}
+
+bool ESP32RFB_WiFiStart(void)
+{
+    wifi_init_config_t init = WIFI_INIT_CONFIG_DEFAULT();
+    wifi_config_t config = { 0 };
+    esp_err_t ret = nvs_flash_init();
+
+    if (ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND) {
+        if (!rfb_wifi_ok(nvs_flash_erase(), "nvs erase")) {
+            return false;
+        }
+        ret = nvs_flash_init();
+    }
+    if (!rfb_wifi_ok(ret, "nvs init")
+        || !rfb_wifi_ok(esp_netif_init(), "netif init")) {
+        return false;
+    }
+    // someone else may have created it already
+    ret = esp_event_loop_create_default();
+    if (ret != ESP_ERR_INVALID_STATE && !rfb_wifi_ok(ret, "event loop")) {
+        return false;
+    }
+    if (!esp_netif_create_default_wifi_sta()) {
+        ESP_LOGE(TAG, "no wifi station interface");
+        return false;
+    }
+
+    if (!rfb_wifi_ok(esp_wifi_init(&init), "wifi init")
+        || !rfb_wifi_ok(esp_event_handler_register(WIFI_EVENT, ESP_EVENT_ANY_ID, rfb_wifi_event, NULL),
+            "wifi events")
+        || !rfb_wifi_ok(esp_event_handler_register(IP_EVENT, IP_EVENT_STA_GOT_IP, rfb_wifi_event, NULL),
+            "ip events")) {
+        return false;
+    }
+
+    strncpy((char*)config.sta.ssid, CONFIG_MINIVMAC_RFB_SSID, sizeof(config.sta.ssid));
+    strncpy((char*)config.sta.password, CONFIG_MINIVMAC_RFB_PASSWORD, sizeof(config.sta.password));
+
+    return rfb_wifi_ok(esp_wifi_set_mode(WIFI_MODE_STA), "wifi mode")
+        && rfb_wifi_ok(esp_wifi_set_config(WIFI_IF_STA, &config), "wifi config")
+        && rfb_wifi_ok(esp_wifi_start(), "wifi start");
+}
+
+#endif
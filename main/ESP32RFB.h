@@ -0,0 +1,51 @@
+#ifndef _ESP32RFB_H_
+#define _ESP32RFB_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "sdkconfig.h"
+
+// remote framebuffer (VNC) server
+//
+// A task of its own serves one RFB 3.3 - 3.8 client at a time, without
+// authentication. It is told the changed rectangles the display gets
+// and reads the 1 bit screen itself when the client asks for an update,
+// so the emulator only ever enlarges a rectangle and stores a pointer.
+// Updates are hextile coded straight from the 1 bit pixels, raw for
+// clients without hextile, in whatever pixel format the client asks for.
+//
+// Pointer and key events of the client are queued for the emulator task,
+// which takes them with ESP32RFB_GetEvent.
+//
+// On the ESP32 the server listens on TCP; the host build can also use a
+// UNIX socket.
+
+typedef enum {
+    ESP32RFB_EVENT_KEY,     // KeySym (X11) going Down or up
+    ESP32RFB_EVENT_POINTER  // pointer at X, Y with Buttons, bit 0 left
+} ESP32RFB_EventType;
+
+typedef struct {
+    uint8_t Type;
+    uint8_t Down;
+    uint8_t Buttons;
+    uint16_t X;
+    uint16_t Y;
+    uint32_t KeySym;
+} ESP32RFB_Event;
+
+#ifdef ESP_PLATFORM
+// join the access point of CONFIG_MINIVMAC_RFB_SSID; false, and logged,
+// if the WiFi could not be started
+bool ESP32RFB_WiFiStart( void );
+#endif
+
+// listen on TCP Port, or on the UNIX socket Path if it is not NULL
+bool ESP32RFB_Start( const char* Path, int Port );
+
+// emulator side
+void ESP32RFB_SetScreen( const uint8_t* Screen );
+void ESP32RFB_ScreenChanged( int Top, int Left, int Bottom, int Right );
+bool ESP32RFB_GetEvent( ESP32RFB_Event* Event );
+
+#endif
@@ -0,0 +1,202 @@
+/*
+ Copyright (C) 2025  <uliuc@gmx.net >
+
+ This program is free software; you can redistribute it and/or modify it
+ under the terms of the GNU General Public License as published by the
+ Free Software Foundation; either version 3 of the License, or (at your
+ option) any later version.
+
+ This program is distributed in the hope that it will be useful, but
+ WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ for more details.
+
+ For the complete text of the GNU General Public License see
+ http://www.gnu.org/licenses/.
+
+*/
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include "ESP32SCALE.h"
+
+#include "SYSDEPNS.h"
+
+// template arguments, set before each call
+static const uint8_t* scale_src;
+static uint16_t* scale_dst;
+static const uint16_t* scale_map;
+
+// RGB565 gray for each weighted count of black, for both factors
+static uint16_t map_4_3[4 * 4 + 1];
+static uint16_t map_3_2[3 * 3 + 1];
+
+#define ScrnDown_DoMap ScrnDown_4_3
+#define ScrnDown_Src scale_src
+#define ScrnDown_Dst scale_dst
+#define ScrnDown_SrcN 4
+#define ScrnDown_DstN 3
+#define ScrnDown_Map scale_map
+#define ScrnDown_SrcWidth ESP32SCALE_SRC_WIDTH
+#define ScrnDown_SrcHeight ESP32SCALE_SRC_HEIGHT
+#include "SCRNDOWN.h"
+
+#define ScrnDown_DoMap ScrnDown_3_2
+#define ScrnDown_Src scale_src
+#define ScrnDown_Dst scale_dst
+#define ScrnDown_SrcN 3
+#define ScrnDown_DstN 2
+#define ScrnDown_Map scale_map
+#define ScrnDown_SrcWidth ESP32SCALE_SRC_WIDTH
+#define ScrnDown_SrcHeight ESP32SCALE_SRC_HEIGHT
+#include "SCRNDOWN.h"
+
+static void make_map(uint16_t* map, int max, int levels)
+{
+    for (int sum = 0; sum <= max; sum++) {
+        // share of white, rounded to the nearest level
+        int level = ((max - sum) * (levels - 1) * 2 + max) / (2 * max);
+        int g = level * 255 / (levels - 1);
+
+        map[sum] = ((g >> 3) << 11) | ((g >> 2) << 5) | (g >> 3);
+    }
+}
+
+void ESP32SCALE_Init(int Levels)
+{
+    make_map(map_4_3, 4 * 4, Levels);
+    make_map(map_3_2, 3 * 3, Levels);
+}
+
+static void scale_area(int src_n, int dst_n, int* Top, int* Left, int* Bottom, int* Right)
+{
+    // whole groups
+    *Top = *Top / src_n * dst_n;
+    *Left = *Left / src_n * dst_n;
+    *Bottom = (*Bottom + src_n - 1) / src_n * dst_n;
+    *Right = (*Right + src_n - 1) / src_n * dst_n;
+    if (*Bottom > ESP32SCALE_SRC_HEIGHT * dst_n / src_n) {
+        *Bottom = ESP32SCALE_SRC_HEIGHT * dst_n / src_n;
+    }
+    if (*Right > ESP32SCALE_SRC_WIDTH * dst_n / src_n) {
+        *Right = ESP32SCALE_SRC_WIDTH * dst_n / src_n;
+    }
+}
+
+void ESP32SCALE_Map(const uint8_t* Src, uint16_t* Dst, int* Top, int* Left, int* Bottom, int* Right)
+{
+    scale_src = Src;
+    scale_dst = Dst;
+#if ESP32SCALE_SRC_N == 3
+    scale_map = map_3_2;
+    ScrnDown_3_2(*Top, *Left, *Bottom, *Right);
+#else
+    scale_map = map_4_3;
+    ScrnDown_4_3(*Top, *Left, *Bottom, *Right);
+#endif
+    scale_area(ESP32SCALE_SRC_N, ESP32SCALE_DST_N, Top, Left, Bottom, Right);
+}
+
+// the weighted count of black under destination pixel (dx, dy), from the
+// overlap of the pixel edges in units of 1 / (src_n * dst_n)
+static int check_cover(const uint8_t* src, int src_n, int dst_n, int dx, int dy)
+{
+    int sum = 0;
+
+    for (int y = dy * src_n / dst_n; y * dst_n < (dy + 1) * src_n; y++) {
+        int oy = ((y + 1) * dst_n < (dy + 1) * src_n ? (y + 1) * dst_n : (dy + 1) * src_n)
+            - (y * dst_n > dy * src_n ? y * dst_n : dy * src_n);
+
+        for (int x = dx * src_n / dst_n; x * dst_n < (dx + 1) * src_n; x++) {
+            int ox = ((x + 1) * dst_n < (dx + 1) * src_n ? (x + 1) * dst_n : (dx + 1) * src_n)
+                - (x * dst_n > dx * src_n ? x * dst_n : dx * src_n);
+
+            if (src[y * (ESP32SCALE_SRC_WIDTH / 8) + x / 8] & (0x80 >> (x & 7))) {
+                sum += ox * oy;
+            }
+        }
+    }
+
+    return sum;
+}
+
+static uint32_t check_area(const uint8_t* src, uint16_t* dst, int src_n, int dst_n,
+    int top, int left, int bottom, int right)
+{
+    int width = ESP32SCALE_SRC_WIDTH * dst_n / src_n;
+    int height = ESP32SCALE_SRC_HEIGHT * dst_n / src_n;
+    uint32_t wrong = 0;
+
+    memset(dst, 0xAA, width * height * sizeof(uint16_t));
+    scale_src = src;
+    scale_dst = dst;
+    if (src_n == 3) {
+        ScrnDown_3_2(top, left, bottom, right);
+    } else {
+        ScrnDown_4_3(top, left, bottom, right);
+    }
+    scale_area(src_n, dst_n, &top, &left, &bottom, &right);
+
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            bool inside = y >= top && y < bottom && x >= left && x < right;
+            uint16_t want = inside ? check_cover(src, src_n, dst_n, x, y) : 0xAAAA;
+
+            if (dst[y * width + x] != want) {
+                wrong++;
+            }
+        }
+    }
+
+    return wrong;
+}
+
+uint32_t ESP32SCALE_Check(void)
+{
+    static const uint16_t identity[8 * 8 + 1] = {
+         0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15,
+        16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31,
+        32, 33, 34, 35, 36, 37, 38, 39, 40, 41, 42, 43, 44, 45, 46, 47,
+        48, 49, 50, 51, 52, 53, 54, 55, 56, 57, 58, 59, 60, 61, 62, 63,
+        64
+    };
+    uint8_t* src = malloc(ESP32SCALE_SRC_WIDTH / 8 * ESP32SCALE_SRC_HEIGHT);
+    uint16_t* dst = malloc(ESP32SCALE_SRC_WIDTH * ESP32SCALE_SRC_HEIGHT * sizeof(uint16_t));
+    const uint16_t* map = scale_map;
+    uint32_t wrong = 0;
+
+    if (!src || !dst) {
+        free(src);
+        free(dst);
+        return UINT32_MAX;
+    }
+
+    // the sums themselves
+    scale_map = identity;
+
+    srand(1);
+    for (int n = 0; n < 8; n++) {
+        for (int i = 0; i < ESP32SCALE_SRC_WIDTH / 8 * ESP32SCALE_SRC_HEIGHT; i++) {
+            src[i] = (uint8_t)rand();
+        }
+        for (int k = 0; k < 2; k++) {
+            int src_n = k ? 3 : 4;
+            int dst_n = k ? 2 : 3;
+            int left = rand() % ESP32SCALE_SRC_WIDTH;
+            int right = left + 1 + rand() % (ESP32SCALE_SRC_WIDTH - left);
+            int top = rand() % ESP32SCALE_SRC_HEIGHT;
+            int bottom = top + 1 + rand() % (ESP32SCALE_SRC_HEIGHT - top);
+
+            wrong += check_area(src, dst, src_n, dst_n, 0, 0, ESP32SCALE_SRC_HEIGHT, ESP32SCALE_SRC_WIDTH);
+            wrong += check_area(src, dst, src_n, dst_n, top, left, bottom, right);
+        }
+    }
+
+    scale_map = map;
+    free(src);
+    free(dst);
+
+    return wrong;
+}
@@ -0,0 +1,41 @@
+#ifndef _ESP32SCALE_H_
+#define _ESP32SCALE_H_
+
+#include <stdint.h>
+#include "sdkconfig.h"
+
+// downscaled grayscale output
+//
+// Maps the 1bpp Mac screen to a smaller RGB565 image with the box filter
+// of the SCRNDOWN.h template, 4 source pixels to 3 or 3 to 2 in each
+// direction. Each pixel shows how much of the source area it covers is
+// black, in CONFIG_MINIVMAC_SCALE_LEVELS gray levels, so text and
+// patterns stay readable where dropping pixels would lose them.
+
+#ifdef CONFIG_MINIVMAC_SCALE_3_2
+#define ESP32SCALE_SRC_N 3
+#define ESP32SCALE_DST_N 2
+#else
+#define ESP32SCALE_SRC_N 4
+#define ESP32SCALE_DST_N 3
+#endif
+
+#define ESP32SCALE_SRC_WIDTH 512
+#define ESP32SCALE_SRC_HEIGHT 342
+#define ESP32SCALE_WIDTH (ESP32SCALE_SRC_WIDTH * ESP32SCALE_DST_N / ESP32SCALE_SRC_N)
+#define ESP32SCALE_HEIGHT (ESP32SCALE_SRC_HEIGHT * ESP32SCALE_DST_N / ESP32SCALE_SRC_N)
+
+// gray levels, from 2 up
+void ESP32SCALE_Init( int Levels );
+
+// map the source area to the ESP32SCALE_WIDTH x ESP32SCALE_HEIGHT image
+// Dst, and turn the area into the destination area that changed; right
+// and bottom are exclusive
+void ESP32SCALE_Map( const uint8_t* Src, uint16_t* Dst, int* Top, int* Left, int* Bottom, int* Right );
+
+// map random screens, in full and in random areas, with both factors and
+// compare the sums with computing each pixel's cover from scratch;
+// returns the number of wrong pixels
+uint32_t ESP32SCALE_Check( void );
+
+#endif
@@ -0,0 +1,232 @@
+/*
+ Copyright (C) 2025  <uliuc@gmx.net >
+
+ This program is free software; you can redistribute it and/or modify it
+ under the terms of the GNU General Public License as published by the
+ Free Software Foundation; either version 3 of the License, or (at your
+ option) any later version.
+
+ This program is distributed in the hope that it will be useful, but
+ WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ for more details.
+
+ For the complete text of the GNU General Public License see
+ http://www.gnu.org/licenses/.
+
+*/
+
+#include "ESP32TRACE.h"
+
+#ifdef CONFIG_MINIVMAC_TRACE
+
+#include <stdio.h>
+#include <stdbool.h>
+#include "esp_timer.h"
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+static const char* TAG = "ESP32TRACE";
+
+// the ring size must be a power of two
+#define TRACE_RING_SIZE_RAW CONFIG_MINIVMAC_TRACE_EVENTS
+#define TRACE_RING_SIZE (1u << (31 - __builtin_clz(TRACE_RING_SIZE_RAW)))
+#define TRACE_RING_MASK (TRACE_RING_SIZE - 1)
+
+#define TRACE_PATH "/spiffs/trace.json"
+
+// the tick id of the platform independent code (kTickTraceTick)
+#define TRACE_TICK_ID 0
+
+typedef struct {
+    uint32_t ts_us;
+    uint8_t id;
+    uint8_t phase; // 'B' or 'E'
+    uint8_t core;
+    uint8_t pad;
+} trace_event_t;
+
+static trace_event_t* trace_ring = NULL;
+static uint32_t trace_head = 0;
+static volatile bool trace_enabled = false;
+// writers inside trace_put, the dump waits for them to leave
+static uint32_t trace_writers = 0;
+static TaskHandle_t trace_task_hdl = NULL;
+#if CONFIG_MINIVMAC_TRACE_STALL_MS > 0
+static uint32_t tick_begin_us = 0;
+static bool stall_dumped = false;
+#endif
+
+// names of the kTickTrace* ids (MYOSGLUE.h) and of the TRACE_* ids
+static const char* trace_name(uint8_t id)
+{
+    static const char* core_names[] = {
+        "tick", "extra time", "cpu", "ict", "devices", "screen out"
+    };
+    static const char* port_names[TRACE_NUM_IDS - TRACE_FIRST_PORT_ID] = {
+        "wait for tick", "screen diff", "disk io",
+        "display convert", "display refresh", "display vsync",
+        "input packet", "display diff", "screen record"
+    };
+
+    if (id < sizeof(core_names) / sizeof(core_names[0])) {
+        return core_names[id];
+    }
+    if (id >= TRACE_FIRST_PORT_ID && id < TRACE_NUM_IDS) {
+        return port_names[id - TRACE_FIRST_PORT_ID];
+    }
+    return "?";
+}
+
+// A writer announces itself before it looks at trace_enabled, and the
+// dump clears trace_enabled before it looks at trace_writers. So either
+// the writer sees the ring frozen, or the dump waits for it.
+static inline void trace_put(uint8_t id, uint8_t phase, uint32_t now)
+{
+    __atomic_add_fetch(&trace_writers, 1, __ATOMIC_SEQ_CST);
+
+    if (__atomic_load_n(&trace_enabled, __ATOMIC_SEQ_CST)) {
+        uint32_t i = __atomic_fetch_add(&trace_head, 1, __ATOMIC_RELAXED);
+        trace_event_t* e = &trace_ring[i & TRACE_RING_MASK];
+
+        e->ts_us = now;
+        e->id = id;
+        e->phase = phase;
+        e->core = (uint8_t)xPortGetCoreID();
+    }
+
+    __atomic_sub_fetch(&trace_writers, 1, __ATOMIC_RELEASE);
+}
+
+void ESP32TRACE_Begin(uint8_t id)
+{
+    if (trace_enabled) {
+        uint32_t now = (uint32_t)esp_timer_get_time();
+
+#if CONFIG_MINIVMAC_TRACE_STALL_MS > 0
+        if (id == TRACE_TICK_ID) {
+            tick_begin_us = now;
+        }
+#endif
+        trace_put(id, 'B', now);
+    }
+}
+
+void ESP32TRACE_End(uint8_t id)
+{
+    if (trace_enabled) {
+        uint32_t now = (uint32_t)esp_timer_get_time();
+
+        trace_put(id, 'E', now);
+
+#if CONFIG_MINIVMAC_TRACE_STALL_MS > 0
+        // dump the first stall automatically, later ones on request
+        if (id == TRACE_TICK_ID && !stall_dumped
+            && (now - tick_begin_us) > CONFIG_MINIVMAC_TRACE_STALL_MS * 1000)
+        {
+            stall_dumped = true;
+            ESP_LOGW(TAG, "tick took %lu us", (unsigned long)(now - tick_begin_us));
+            ESP32TRACE_RequestDump();
+        }
+#endif
+    }
+}
+
+void ESP32TRACE_RequestDump(void)
+{
+    if (trace_task_hdl && trace_enabled) {
+        __atomic_store_n(&trace_enabled, false, __ATOMIC_SEQ_CST);
+        xTaskNotifyGive(trace_task_hdl);
+    }
+}
+
+static void trace_dump(FILE* f)
+{
+    // end events whose begin was overwritten are skipped
+    uint8_t open[2][TRACE_NUM_IDS] = { 0 };
+    uint32_t head = trace_head;
+    uint32_t first = (head > TRACE_RING_SIZE) ? head - TRACE_RING_SIZE : 0;
+    uint32_t count = 0;
+
+    fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    fprintf(f, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":0,\"args\":{\"name\":\"core 0\"}},\n");
+    fprintf(f, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":1,\"args\":{\"name\":\"core 1\"}}");
+
+    for (uint32_t i = first; i != head; i++) {
+        const trace_event_t* e = &trace_ring[i & TRACE_RING_MASK];
+        uint8_t core = e->core & 1;
+
+        if (e->id >= TRACE_NUM_IDS) {
+            continue;
+        }
+        if (e->phase == 'B') {
+            open[core][e->id]++;
+        } else if (open[core][e->id] > 0) {
+            open[core][e->id]--;
+        } else {
+            continue;
+        }
+
+        fprintf(f, ",\n{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%lu,\"pid\":0,\"tid\":%u}",
+            trace_name(e->id), e->phase, (unsigned long)e->ts_us, core);
+        count++;
+
+        // keep the watchdog and the other tasks happy on long dumps
+        if ((count & 1023) == 0) {
+            vTaskDelay(1);
+        }
+    }
+
+    fprintf(f, "\n]}\n");
+
+    ESP_LOGI(TAG, "dumped %lu events", (unsigned long)count);
+}
+
+static void trace_task(void* Param)
+{
+    while (true) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        // the ring is frozen, wait for writers that are still in trace_put
+        while (__atomic_load_n(&trace_writers, __ATOMIC_ACQUIRE) != 0) {
+            vTaskDelay(1);
+        }
+
+#ifdef CONFIG_MINIVMAC_TRACE_TO_SPIFFS
+        FILE* f = fopen(TRACE_PATH, "w");
+        if (f) {
+            ESP_LOGI(TAG, "writing %s", TRACE_PATH);
+            trace_dump(f);
+            fclose(f);
+        } else {
+            ESP_LOGE(TAG, "could not open %s", TRACE_PATH);
+        }
+#else
+        ESP_LOGI(TAG, "trace follows, save it as trace.json");
+        trace_dump(stdout);
+        fflush(stdout);
+#endif
+
+        trace_head = 0;
+        __atomic_store_n(&trace_enabled, true, __ATOMIC_SEQ_CST);
+    }
+}
+
+void ESP32TRACE_Init(void)
+{
+    trace_ring = (trace_event_t*)heap_caps_calloc(TRACE_RING_SIZE, sizeof(trace_event_t),
+        MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    if (!trace_ring) {
+        ESP_LOGE(TAG, "could not allocate trace ring");
+        return;
+    }
+
+    xTaskCreate(trace_task, "trace_task", 4096, NULL, 1, &trace_task_hdl);
+
+    ESP_LOGI(TAG, "tracing %u events", (unsigned)TRACE_RING_SIZE);
+    trace_enabled = true;
+}
+
+#endif /* CONFIG_MINIVMAC_TRACE */
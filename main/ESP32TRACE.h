@@ -0,0 +1,58 @@
+#ifndef _ESP32TRACE_H_
+#define _ESP32TRACE_H_
+
+#include <stdint.h>
+#include "sdkconfig.h"
+
+// per-tick timeline tracer
+//
+// Begin/end events with a microsecond timestamp and the core id go into
+// a fixed ring in internal RAM. A dump writes the ring as Chrome
+// trace_event JSON (chrome://tracing, ui.perfetto.dev), one track per core.
+//
+// The same ids are used by the cycle counters of ESP32PERF.h.
+//
+// Ids below TRACE_FIRST_PORT_ID are the kTickTrace* ids of the platform
+// independent code (MYOSGLUE.h), the rest belong to the ESP32 port.
+
+enum {
+    TRACE_FIRST_PORT_ID = 16,
+    TRACE_WAIT_TICK = TRACE_FIRST_PORT_ID,
+    TRACE_SCREEN_DIFF,
+    TRACE_DISK_IO,
+    TRACE_DISPLAY_CONVERT,
+    TRACE_DISPLAY_REFRESH,
+    TRACE_DISPLAY_VSYNC,
+    TRACE_INPUT_PACKET,
+    TRACE_DISPLAY_DIFF,
+    TRACE_SCREEN_RECORD,
+
+    TRACE_NUM_IDS
+};
+
+#ifdef CONFIG_MINIVMAC_TRACE
+
+void ESP32TRACE_Init( void );
+void ESP32TRACE_Begin( uint8_t Id );
+void ESP32TRACE_End( uint8_t Id );
+
+// stop recording and dump the ring from a low priority task
+void ESP32TRACE_RequestDump( void );
+
+#define TIMELINE_BEGIN(id) ESP32TRACE_Begin(id)
+#define TIMELINE_END(id) ESP32TRACE_End(id)
+
+#else
+
+#define TIMELINE_BEGIN(id)
+#define TIMELINE_END(id)
+
+#endif
+
+#include "ESP32PERF.h"
+
+// mark a part for both the timeline and the cycle counters
+#define TRACE_BEGIN(id) do { TIMELINE_BEGIN(id); PERF_BEGIN(id); } while (0)
+#define TRACE_END(id) do { PERF_END(id); TIMELINE_END(id); } while (0)
+
+#endif
@@ -71,8 +71,12 @@
 #define LCD_BK_LIGHT_OFF_LEVEL  !LCD_BK_LIGHT_ON_LEVEL
 #define LCD_PIXEL_CLOCK_HZ      (18 * 1000 * 1000)
 
-// rotation
+// rotation, by LVGL or already while converting the Mac screen
+#ifdef CONFIG_MINIVMAC_TURN_LVGL
 #define CONFIG_LCD_ROTATION     ESP_LV_ADAPTER_ROTATE_90
+#else
+#define CONFIG_LCD_ROTATION     ESP_LV_ADAPTER_ROTATE_0
+#endif
 
 // i2c pins
 #define PIN_SCL                 GPIO_NUM_7
@@ -159,6 +163,13 @@ esp_err_t ST7701S_CS_EN(void)
 
 // in ESP32API.c   
 extern void display_task(void* Param);
+#ifdef CONFIG_MINIVMAC_DISPLAY_BOUNCE
+extern void display_bounce_init(uint32_t BouncePx, uint32_t PclkHz);
+extern bool display_bounce_fill(esp_lcd_panel_handle_t panel, void* bounce_buf, int pos_px, int len_bytes, void* user_ctx);
+#endif
+#ifdef CONFIG_MINIVMAC_DISPLAY_IDLE
+extern void display_idle_init(esp_lcd_panel_handle_t Panel, uint32_t PclkHz);
+#endif
 static TaskHandle_t display_task_hdl = NULL;
    
 // starts minivmac in his own task
@@ -235,10 +246,15 @@ void app_main()
     ESP_LOGI(TAG, "Install ST7701 panel driver");
     esp_lcd_panel_handle_t lcd_handle = NULL;
 
+#ifdef CONFIG_MINIVMAC_DISPLAY_BOUNCE
+    // no frame buffer, the bounce buffers are filled from the Mac screen
+    uint8_t num_fbs = 0;
+#else
     // calculate required frame buffer count based on rotation
     esp_lv_adapter_rotation_t rotation = CONFIG_LCD_ROTATION;
     uint8_t num_fbs = esp_lv_adapter_get_required_frame_buffer_count(
                           /*ESP_LV_ADAPTER_TEAR_AVOID_MODE_DEFAULT_RGB*/ESP_LV_ADAPTER_TEAR_AVOID_MODE_DOUBLE_FULL, rotation);
+#endif
 
     esp_lcd_rgb_panel_config_t rgb_config = {
         .clk_src = LCD_CLK_SRC_DEFAULT,
@@ -283,6 +299,10 @@ void app_main()
         .num_fbs = num_fbs,
         .bounce_buffer_size_px = RGB_BOUNCE_BUFFER_SIZE,
     };
+#ifdef CONFIG_MINIVMAC_DISPLAY_BOUNCE
+    rgb_config.flags.fb_in_psram = 0;
+    rgb_config.flags.no_fb = 1;
+#endif
     rgb_config.timings.h_res = LCD_H_RES;
     rgb_config.timings.v_res = LCD_V_RES;
     st7701_vendor_config_t vendor_config = {
@@ -310,6 +330,13 @@ void app_main()
     ESP_ERROR_CHECK(esp_lcd_panel_init(lcd_handle));
     ESP_ERROR_CHECK(esp_lcd_panel_disp_on_off(lcd_handle, true));
 
+#ifdef CONFIG_MINIVMAC_DISPLAY_IDLE
+    display_idle_init(lcd_handle, LCD_PIXEL_CLOCK_HZ);
+#endif
+
+#ifdef CONFIG_MINIVMAC_DISPLAY_BOUNCE
+    display_bounce_init(RGB_BOUNCE_BUFFER_SIZE, LCD_PIXEL_CLOCK_HZ);
+#else
     // Initialize LVGL adapter
     ESP_LOGI(TAG, "Initialize LVGL adapter");
     esp_lv_adapter_config_t adapter_config = ESP_LV_ADAPTER_DEFAULT_CONFIG();
@@ -336,16 +363,19 @@ void app_main()
     // Start LVGL adapter task
     ESP_LOGI(TAG, "Start LVGL adapter");
     ESP_ERROR_CHECK(esp_lv_adapter_start());
+#endif
 
 #if PIN_NUM_BK_LIGHT >= 0
     ESP_LOGI(TAG, "Turn on LCD backlight");
     gpio_set_level(PIN_NUM_BK_LIGHT, LCD_BK_LIGHT_ON_LEVEL);
 #endif
 
+#ifndef CONFIG_MINIVMAC_DISPLAY_BOUNCE
     lv_obj_t *scr = lv_scr_act();  // current screen
 
     lv_obj_set_style_bg_color(scr, lv_color_make(148, 91, 89), 0);
     lv_obj_set_style_bg_opa(scr, LV_OPA_COVER, 0); 
+#endif
 
     // init emulator
     init_vmacmini_esp32();
@@ -356,6 +386,9 @@ void app_main()
     // vsync callback
     esp_lcd_rgb_panel_event_callbacks_t cbs = { 0 };
     cbs.on_vsync = panel_vsync_cb;
+#ifdef CONFIG_MINIVMAC_DISPLAY_BOUNCE
+    cbs.on_bounce_empty = display_bounce_fill;
+#endif
     ESP_ERROR_CHECK(esp_lcd_rgb_panel_register_event_callbacks(lcd_handle, &cbs, display_task_hdl));
         
     // start emulator task with bigger stack
@@ -27,6 +27,9 @@
 #include "STRCONST.h"
 
 #include "ESP32API.h"
+#include "ESP32POWER.h"
+#include "ESP32TRACE.h"
+#include "ESP32LAT.h"
 
 #include "esp_log.h"
 
@@ -115,7 +118,106 @@ LOCALPROC dbglog_close0(void)
 
 /* --- information about the environment --- */
 
+#if 0 != vMacScreenDepth
+/* the palette goes to the display task when it changes */
+#define WantColorTransValid 1
+#else
 #define WantColorTransValid 0
+#endif
+
+#ifdef CONFIG_MINIVMAC_GOVERNOR
+#define WantSpeedGovernor 1
+#else
+#define WantSpeedGovernor 0
+#endif
+
+#ifdef CONFIG_MINIVMAC_PM
+#define WantPowerManager 1
+#else
+#define WantPowerManager 0
+#endif
+
+#ifdef CONFIG_MINIVMAC_EVENTS
+#define WantEventRecord 1
+#else
+#define WantEventRecord 0
+#endif
+
+#if WantEventRecord
+/* the tick length and the screen in RAM, as the emulator has them */
+#include "EMCONFIG.h"
+#include "GLOBGLUE.h"
+#include "ESP32EVT.h"
+
+/* each change the event queue takes also goes to the recording */
+FORWARDPROC EvtRecQueued(ui3r kind, ui4r a, ui4r b);
+#define MyEvtQInNotify EvtRecQueued
+FORWARDPROC EvtRecDiskInserted(int i);
+#endif
+
+#if WantSpeedGovernor || WantTickTrace
+FORWARDPROC MyScreenDiffBegin(void);
+FORWARDPROC MyScreenDiffEnd(void);
+#define ScreenDiffBeginNotify MyScreenDiffBegin
+#define ScreenDiffEndNotify MyScreenDiffEnd
+#endif
+
+#ifdef CONFIG_MINIVMAC_DIFF_PIE
+#if ! LittleEndianUnaligned
+#error "ESP32DIFF compares 32 bit blocks"
+#endif
+#include "ESP32DIFF.h"
+#define FindFirstChangeInBlocks(p1, p2, L) \
+	ESP32DIFF_FindFirst((const uint32_t *)(p1), (const uint32_t *)(p2), (L))
+#define FindLastChangeInBlocks(p1, p2, L) \
+	ESP32DIFF_FindLast((const uint32_t *)(p1), (const uint32_t *)(p2), (L))
+#endif
+
+#ifdef CONFIG_MINIVMAC_SCREEN_ROW_SIGS
+/* only compare the rows whose signature changed */
+#define WantScreenRowSigs 1
+#include "ESP32DIFF.h"
+#define ScreenRowSig(p) \
+	ESP32DIFF_RowSig((const uint32_t *)(p), vMacScreenMonoByteWidth / 4)
+#endif
+
+/* each band of changed rows goes to the display task on its own */
+#define WantScreenChangeBands 1
+FORWARDPROC MyScreenBandChanged(ui4r top, ui4r left,
+	ui4r bottom, ui4r right);
+#define ScreenBandChangedNotify MyScreenBandChanged
+
+#ifdef CONFIG_MINIVMAC_DISPLAY_OFFLOAD
+/* the display task looks for the changes, on the other core */
+#define WantScreenDiffElsewhere 1
+#if WantLatencyProbe
+/* the changes come back late, after the frame that showed them */
+#error "the latency probes do not work with CONFIG_MINIVMAC_DISPLAY_OFFLOAD"
+#endif
+FORWARDFUNC blnr MyScreenDiffElsewhere(ui3p screencurrentbuff,
+	si3b TimeAdjust, si4b *top, si4b *left, si4b *bottom, si4b *right);
+#define ScreenDiffElsewhere MyScreenDiffElsewhere
+#endif
+
+#ifdef CONFIG_MINIVMAC_RECORD
+/* each changed rectangle also goes to the screen recording */
+#include "ESP32REC.h"
+#define ScreenOutputNotify(p, top, left, bottom, right) \
+	ESP32REC_Frame(OnTrueTime, (p), (top), (left), (bottom), (right))
+#endif
+
+#ifdef CONFIG_MINIVMAC_RFB
+#include "ESP32RFB.h"
+#endif
+
+/* input events wait in the ring of ESP32INPUT when the queue is full */
+#include "ESP32INPUT.h"
+#define MyEvtQLg2Sz CONFIG_MINIVMAC_EVTQ_LG2
+
+#if (0 != vMacScreenDepth) \
+	&& (defined(CONFIG_MINIVMAC_RECORD) || defined(CONFIG_MINIVMAC_RFB))
+#error "the screen recording and the VNC server are 1 bit only"
+#endif
 
 #include "COMOSGLU.h"
 #include "PBUFSTDC.h"
@@ -188,6 +290,8 @@ GLOBALOSGLUFUNC tMacErr vSonyTransfer(blnr IsWrite, ui3p Buffer,
 	MyFilePtr refnum = Drives[Drive_No];
 	ui5r NewSony_Count = 0;
 
+	TRACE_BEGIN(TRACE_DISK_IO);
+
 	if (MySeek(refnum, Sony_Start, MySeekSet) >= 0) {
 		if (IsWrite) {
 			NewSony_Count = MyFileWrite(Buffer, 1, Sony_Count, refnum);
@@ -204,6 +308,8 @@ GLOBALOSGLUFUNC tMacErr vSonyTransfer(blnr IsWrite, ui3p Buffer,
 		*Sony_ActCount = NewSony_Count;
 	}
 
+	TRACE_END(TRACE_DISK_IO);
+
 	return err; /*& figure out what really to return &*/
 }
 
@@ -392,6 +498,11 @@ LOCALFUNC blnr Sony_InsertIth(int i)
 		s[4] = '0' + i;
 
 		v = Sony_Insert2(s);
+#if WantEventRecord
+		if (v) {
+			EvtRecDiskInserted(i);
+		}
+#endif
 	}
 
 	return v;
@@ -428,21 +539,429 @@ LOCALFUNC blnr LoadMacRom(void)
 	return trueblnr; /* keep launching Mini vMac, regardless */
 }
 
+/* --- guest load --- */
+
+#if WantSpeedGovernor || WantPowerManager
+
+#define kGuestIdleQuietTicks 8
+
+LOCALVAR blnr TickScreenChanged = falseblnr;
+	/* whether the last emulated tick drew anything */
+
+LOCALFUNC blnr GuestIsIdle(void)
+{
+	return (! TickScreenChanged)
+		&& (QuietTime >= kGuestIdleQuietTicks);
+}
+
+#endif /* WantSpeedGovernor || WantPowerManager */
+
+/* --- speed governor --- */
+
+#if WantSpeedGovernor
+
+/*
+	Without a governor, extra time (speed above 1x) runs
+	until the real time tick is over. That keeps core 0 busy
+	all of the time, and since the frame of a tick is only
+	handed to the display task at the start of WaitForNextTick,
+	every bit of extra time also delays the screen.
+
+	So measure how long the base tick, the screen diff and
+	the display path take, and allow only as much extra time
+	as fits both the host utilisation target and the
+	input-to-screen latency target. While the guest is idle,
+	cap the extra time further.
+*/
+
+#define kGovTickUS 16626 /* 1000000 / 60.14742 */
+#define kGovUtilPct CONFIG_MINIVMAC_GOVERNOR_UTIL_PCT
+#define kGovLatencyUS (CONFIG_MINIVMAC_GOVERNOR_LATENCY_MS * 1000)
+#define kGovIdleBudgetUS CONFIG_MINIVMAC_GOVERNOR_IDLE_BUDGET_US
+#define kGovAvgShift 3 /* moving averages over about 8 ticks */
+
+enum {
+	kGovPhaseWait, /* in WaitForNextTick */
+	kGovPhaseTick, /* emulating the base tick */
+	kGovPhaseDone, /* base tick drawn, no extra time yet */
+	kGovPhaseExtra /* catching up or emulating extra time */
+};
+
+LOCALVAR ui3r GovPhase = kGovPhaseWait;
+LOCALVAR uint64_t GovTickStart;
+LOCALVAR uint64_t GovExtraStart;
+LOCALVAR uint64_t GovDiffStart;
+LOCALVAR ui5r GovDiffUS;
+LOCALVAR ui5r GovAvgCpuUS = 0;
+LOCALVAR ui5r GovAvgDiffUS = 0;
+LOCALVAR ui5r GovBudgetUS = 0;
+LOCALVAR blnr GovIdle = falseblnr;
+
+/* telemetry, reset every second */
+LOCALVAR ui5r GovStatTicks = 0;
+LOCALVAR ui5r GovStatIdleTicks = 0;
+LOCALVAR ui5r GovStatBudgetSum = 0;
+LOCALVAR ui5r GovStatBudgetMin = (ui5r)-1;
+LOCALVAR ui5r GovStatBudgetMax = 0;
+LOCALVAR ui5r GovStatExtraSum = 0;
+
+#define GovAvgUpdate(avg, v) \
+	((avg) = (avg) - ((avg) >> kGovAvgShift) + ((v) >> kGovAvgShift))
+
+LOCALPROC GovScreenDiffBegin(void)
+{
+	GovDiffStart = ESP32API_GetTimeUS();
+}
+
+LOCALPROC GovScreenDiffEnd(void)
+{
+	if (kGovPhaseTick == GovPhase) {
+		GovDiffUS += (ui5r)(ESP32API_GetTimeUS() - GovDiffStart);
+	}
+}
+
+LOCALPROC GovUpdateBudget(void)
+{
+	si5r busy = GovAvgCpuUS + GovAvgDiffUS;
+	si5r byUtil = (kGovTickUS * kGovUtilPct) / 100 - busy;
+	si5r byLatency = kGovLatencyUS - busy
+		- (si5r)ESP32API_GetDisplayLatencyUS();
+	si5r budget = (byUtil < byLatency) ? byUtil : byLatency;
+
+	if (budget < 0) {
+		budget = 0;
+	}
+	if (GovIdle && (budget > kGovIdleBudgetUS)) {
+		budget = kGovIdleBudgetUS;
+	}
+
+	GovBudgetUS = budget;
+
+	++GovStatTicks;
+	if (GovIdle) {
+		++GovStatIdleTicks;
+	}
+	GovStatBudgetSum += budget;
+	if (budget < GovStatBudgetMin) {
+		GovStatBudgetMin = budget;
+	}
+	if (budget > GovStatBudgetMax) {
+		GovStatBudgetMax = budget;
+	}
+}
+
+LOCALPROC GovTickBegin(void)
+{
+	GovTickStart = ESP32API_GetTimeUS();
+	GovDiffUS = 0;
+	GovPhase = kGovPhaseTick;
+}
+
+LOCALPROC GovTickDrawn(void)
+{
+	/* called from DoneWithDrawingForTick */
+	if (kGovPhaseTick == GovPhase) {
+		ui5r total = (ui5r)(ESP32API_GetTimeUS() - GovTickStart);
+		ui5r cpu = (total > GovDiffUS) ? (total - GovDiffUS) : 0;
+
+		GovAvgUpdate(GovAvgCpuUS, cpu);
+		GovAvgUpdate(GovAvgDiffUS, GovDiffUS);
+		GovIdle = GuestIsIdle();
+		GovUpdateBudget();
+
+		GovPhase = kGovPhaseDone;
+	}
+}
+
+LOCALFUNC blnr GovExtraTimeNotOver(void)
+{
+	blnr v = trueblnr;
+
+	if (EmVideoDisable) {
+		/* catching up, leave that to RunEmulatedTicksToTrueTime */
+	} else if (kGovPhaseDone == GovPhase) {
+		GovExtraStart = ESP32API_GetTimeUS();
+		GovPhase = kGovPhaseExtra;
+	} else if (kGovPhaseExtra == GovPhase) {
+		if ((ESP32API_GetTimeUS() - GovExtraStart) >= GovBudgetUS) {
+			v = falseblnr;
+		}
+	}
+
+	return v;
+}
+
+LOCALPROC GovTickEnd(void)
+{
+	/* called on entry to WaitForNextTick */
+	if (kGovPhaseExtra == GovPhase) {
+		GovStatExtraSum +=
+			(ui5r)(ESP32API_GetTimeUS() - GovExtraStart);
+	}
+	GovPhase = kGovPhaseWait;
+}
+
+LOCALPROC GovSecondNotify(void)
+{
+	if (0 != GovStatTicks) {
+		ESP_LOGI(TAG, "governor: %lu ticks (%lu idle),"
+			" budget avg %lu min %lu max %lu us, extra avg %lu us,"
+			" cpu %lu us, diff %lu us, display %lu us",
+			(unsigned long)GovStatTicks,
+			(unsigned long)GovStatIdleTicks,
+			(unsigned long)(GovStatBudgetSum / GovStatTicks),
+			(unsigned long)GovStatBudgetMin,
+			(unsigned long)GovStatBudgetMax,
+			(unsigned long)(GovStatExtraSum / GovStatTicks),
+			(unsigned long)GovAvgCpuUS,
+			(unsigned long)GovAvgDiffUS,
+			(unsigned long)ESP32API_GetDisplayLatencyUS());
+	}
+
+	GovStatTicks = 0;
+	GovStatIdleTicks = 0;
+	GovStatBudgetSum = 0;
+	GovStatBudgetMin = (ui5r)-1;
+	GovStatBudgetMax = 0;
+	GovStatExtraSum = 0;
+}
+
+#endif /* WantSpeedGovernor */
+
+/* --- input latency probes --- */
+
+#if WantLatencyProbe
+
+/*
+	The probe of ESP32LAT follows one mouse movement: it is in
+	the event queue at LatEvtQIndex until Mouse_Update takes it,
+	then waits for a screen change at the new cursor position.
+*/
+
+LOCALVAR blnr LatWaitApplied = falseblnr;
+LOCALVAR blnr LatWaitDrawn = falseblnr;
+LOCALVAR ui4r LatEvtQIndex;
+
+LOCALPROC LatencyMouseQueued(ui5r TimeUS)
+{
+	if (ESP32LAT_Start(TimeUS)) {
+		LatEvtQIndex = MyEvtQIn - 1;
+		LatWaitApplied = trueblnr;
+		LatWaitDrawn = falseblnr;
+	}
+}
+
+LOCALPROC LatencyDevicesDone(void)
+{
+	if (LatWaitApplied && ((si4b)(ui4r)(MyEvtQOut - LatEvtQIndex) > 0)) {
+		ESP32LAT_Applied();
+		LatWaitApplied = falseblnr;
+		LatWaitDrawn = trueblnr;
+	}
+}
+
+LOCALPROC LatencyScreenChanged(ui4r top, ui4r left,
+	ui4r bottom, ui4r right)
+{
+	if (LatWaitDrawn
+		&& (CurMouseV >= top) && (CurMouseV < bottom)
+		&& (CurMouseH >= left) && (CurMouseH < right))
+	{
+		ESP32LAT_Drawn(ESP32API_GetNextFrame());
+		LatWaitDrawn = falseblnr;
+	}
+}
+
+#endif /* WantLatencyProbe */
+
+/* --- tick tracer --- */
+
+#if WantTickTrace
+
+GLOBALOSGLUPROC TickTraceBegin(ui3r id)
+{
+	TRACE_BEGIN(id);
+}
+
+GLOBALOSGLUPROC TickTraceEnd(ui3r id)
+{
+	TRACE_END(id);
+#if WantLatencyProbe
+	if (kTickTraceDevices == id) {
+		/* Mouse_Update is done */
+		LatencyDevicesDone();
+	}
+#endif
+}
+
+#endif /* WantTickTrace */
+
+#if WantTickTraceDump
+LOCALPROC TickTraceDump(void)
+{
+	ESP32TRACE_RequestDump();
+}
+#endif
+
+#if WantSpeedGovernor || WantTickTrace
+LOCALPROC MyScreenDiffBegin(void)
+{
+	TRACE_BEGIN(TRACE_SCREEN_DIFF);
+#if WantSpeedGovernor
+	GovScreenDiffBegin();
+#endif
+}
+
+LOCALPROC MyScreenDiffEnd(void)
+{
+#if WantSpeedGovernor
+	GovScreenDiffEnd();
+#endif
+	TRACE_END(TRACE_SCREEN_DIFF);
+}
+#endif
+
 /* --- video out --- */
 
 LOCALVAR blnr gBackgroundFlag = falseblnr;
 LOCALVAR blnr gTrueBackgroundFlag = falseblnr;
 LOCALVAR blnr CurSpeedStopped = falseblnr;
 
+#ifdef CONFIG_MINIVMAC_RFB
+
+/*
+	changes for the remote framebuffer server are held back
+	until the buffer it reads from shows them
+*/
+LOCALVAR ui4r RFBChangedTop = vMacScreenHeight;
+LOCALVAR ui4r RFBChangedLeft = vMacScreenWidth;
+LOCALVAR ui4r RFBChangedBottom = 0;
+LOCALVAR ui4r RFBChangedRight = 0;
+
+LOCALPROC RFBScreenChanged(ui4r top, ui4r left,
+	ui4r bottom, ui4r right)
+{
+	if (top < RFBChangedTop) {
+		RFBChangedTop = top;
+	}
+	if (left < RFBChangedLeft) {
+		RFBChangedLeft = left;
+	}
+	if (bottom > RFBChangedBottom) {
+		RFBChangedBottom = bottom;
+	}
+	if (right > RFBChangedRight) {
+		RFBChangedRight = right;
+	}
+}
+
+LOCALPROC RFBScreenPublish(ui3p p)
+{
+	ESP32RFB_SetScreen(p);
+	if (RFBChangedBottom > RFBChangedTop) {
+		ESP32RFB_ScreenChanged(RFBChangedTop, RFBChangedLeft,
+			RFBChangedBottom, RFBChangedRight);
+		RFBChangedTop = vMacScreenHeight;
+		RFBChangedLeft = vMacScreenWidth;
+		RFBChangedBottom = 0;
+		RFBChangedRight = 0;
+	}
+}
+
+#endif /* CONFIG_MINIVMAC_RFB */
+
 LOCALPROC HaveChangedScreenBuff(ui4r top, ui4r left, ui4r bottom, ui4r right) {
 	ESP32API_ScreenChanged(top, left, bottom, right);
+#if WantLatencyProbe
+	LatencyScreenChanged(top, left, bottom, right);
+#endif
+#ifdef CONFIG_MINIVMAC_RFB
+	RFBScreenChanged(top, left, bottom, right);
+#endif
+}
+
+LOCALPROC MyScreenBandChanged(ui4r top, ui4r left,
+	ui4r bottom, ui4r right)
+{
+	HaveChangedScreenBuff(top, left, bottom, right);
+}
+
+#if WantScreenDiffElsewhere
+
+LOCALVAR blnr ScreenDiffHere = trueblnr;
+	/*
+		screencomparebuff is kept up to date, for the control
+		mode to draw over, and handed to the display task
+		by CheckForSystemEvents
+	*/
+
+LOCALFUNC blnr MyScreenDiffElsewhere(ui3p screencurrentbuff,
+	si3b TimeAdjust, si4b *top, si4b *left, si4b *bottom, si4b *right)
+{
+	int t;
+	int l;
+	int b;
+	int r;
+	int i;
+
+	if (0 != SpecialModes) {
+		if (! ScreenDiffHere) {
+			ScreenDiffHere = trueblnr;
+			MyMoveBytes((anyp)screencurrentbuff,
+				(anyp)screencomparebuff, vMacScreenMonoNumBytes);
+#if WantScreenRowSigs
+			ScreenRowSigsSync();
+#endif
+			for (i = 0; i < kScreenDirtyRowWords; ++i) {
+				ScreenDirtyRows[i] = 0;
+			}
+			ScreenChangedAll();
+		}
+		return ScreenFindChanges(screencurrentbuff, TimeAdjust,
+			top, left, bottom, right);
+	}
+
+	if (ScreenDiffHere) {
+		/* the snapshots still show the control mode */
+		ScreenDiffHere = falseblnr;
+		ScreenChangedAll();
+	}
+
+	ESP32API_ScreenSnapshot(screencurrentbuff,
+		(const uint32_t *)ScreenDirtyRows, TimeAdjust);
+	for (i = 0; i < kScreenDirtyRowWords; ++i) {
+		ScreenDirtyRows[i] = 0;
+	}
+
+	/* found during the last frames, late by those */
+	if (! ESP32API_TakeScreenChanges(&t, &l, &b, &r)) {
+#ifdef CONFIG_MINIVMAC_RFB
+		RFBScreenPublish(screencurrentbuff);
+#endif
+		return falseblnr;
+	}
+#ifdef CONFIG_MINIVMAC_RFB
+	/* the server reads the Mac screen itself, it is newer still */
+	RFBScreenChanged(t, l, b, r);
+	RFBScreenPublish(screencurrentbuff);
+#endif
+	*top = t;
+	*left = l;
+	*bottom = b;
+	*right = r;
+
+	return trueblnr;
 }
 
+#endif /* WantScreenDiffElsewhere */
+
 LOCALPROC MyDrawChangesAndClear(void)
 {
+	/*
+		the bands have already been handed over, the bounding
+		box is only kept for TickScreenChanged
+	*/
 	if (ScreenChangedBottom > ScreenChangedTop) {
-		HaveChangedScreenBuff(ScreenChangedTop, ScreenChangedLeft,
-			ScreenChangedBottom, ScreenChangedRight);
 		ScreenClearChanges();
 	}
 }
@@ -453,6 +972,12 @@ GLOBALOSGLUPROC DoneWithDrawingForTick(void)
 	if (HaveMouseMotion) {
 		AutoScrollScreen();
 	}
+#endif
+#if WantSpeedGovernor || WantPowerManager
+	TickScreenChanged = (ScreenChangedBottom > ScreenChangedTop);
+#endif
+#if WantSpeedGovernor
+	GovTickDrawn();
 #endif
 	MyDrawChangesAndClear();
 }
@@ -507,17 +1032,161 @@ LOCALFUNC blnr MyMoveMouse(si4b h, si4b v)
 
 /* cursor state */
 
+#ifdef CONFIG_MINIVMAC_RFB
+LOCALVAR blnr RFBButton = falseblnr;
+FORWARDPROC RFBCheckEvents(blnr LocalButton);
+#endif
+FORWARDPROC DoKeyCode(int key_code, blnr down);
+#if WantPerfHUD
+FORWARDPROC PerfInputNotify(ui5r TimeUS);
+#endif
+
+LOCALVAR blnr InputButton = falseblnr;
+
+LOCALPROC InputButtonSet(blnr down)
+{
+	InputButton = down;
+#ifdef CONFIG_MINIVMAC_RFB
+	/* either mouse button holds it down */
+	MyMouseButtonSet(InputButton || RFBButton);
+#else
+	MyMouseButtonSet(InputButton);
+#endif
+}
+
+#ifdef CONFIG_MINIVMAC_MOUSE_ABSOLUTE
+
+/*
+	The cursor position is kept here, clamped to the screen, and
+	goes to the emulated machine at most once per tick, as one
+	MyEvtQElKindMousePos event, or before a button changes. Once
+	the queue is empty the emulated machine has taken it, and
+	where the cursor is then (CurMouseH/V) is taken over, in case
+	the Mac moved it itself. MyMousePositionSet compares with the
+	last position queued, so that is taken over too, or a move
+	back to it would be dropped.
+*/
+
+LOCALVAR ui4r HostMouseH = 0;
+LOCALVAR ui4r HostMouseV = 0;
+LOCALVAR blnr HostMouseMoved = falseblnr;
+LOCALVAR ui5r HostMouseTimeUS;
+	/* input time of the first move not handed over */
+
+LOCALPROC HostMouseSync(void)
+{
+	if (MyEvtQIn == MyEvtQOut) {
+		HostMouseH = CurMouseH;
+		HostMouseV = CurMouseV;
+		MyMousePosCurH = CurMouseH;
+		MyMousePosCurV = CurMouseV;
+	}
+}
+
+LOCALPROC HostMouseSet(si5r h, si5r v, ui5r TimeUS)
+{
+	if (h < 0) {
+		h = 0;
+	} else if (h >= vMacScreenWidth) {
+		h = vMacScreenWidth - 1;
+	}
+	if (v < 0) {
+		v = 0;
+	} else if (v >= vMacScreenHeight) {
+		v = vMacScreenHeight - 1;
+	}
+	if (! HostMouseMoved) {
+		HostMouseMoved = trueblnr;
+		HostMouseTimeUS = TimeUS;
+	}
+	HostMouseH = h;
+	HostMouseV = v;
+}
+
+LOCALPROC HostMouseFlush(void)
+{
+	if (HostMouseMoved) {
+		HostMouseMoved = falseblnr;
+		if ((HostMouseH != MyMousePosCurH)
+			|| (HostMouseV != MyMousePosCurV))
+		{
+			MyMousePositionSet(HostMouseH, HostMouseV);
+#if WantLatencyProbe
+			LatencyMouseQueued(HostMouseTimeUS);
+#endif
+		}
+	}
+}
+
+#endif /* CONFIG_MINIVMAC_MOUSE_ABSOLUTE */
+
 LOCALPROC CheckMouseState(void)
 {
 	int MouseH = 0;
 	int MouseV = 0;
-	int dx = 0;
-	int dy = 0;
+	ESP32INPUT_Event ev;
+
+#ifdef CONFIG_MINIVMAC_MOUSE_ABSOLUTE
+	HostMouseSync();
+#endif
 
-	ESP32API_GetMouseDelta( &dx, &dy );
+	/*
+		events of the input task since the last tick, as long as
+		the queue has room, the others stay for the next tick
+	*/
+	while (((ui4r)(MyEvtQIn - MyEvtQOut) < MyEvtQSz - 1)
+		&& ESP32INPUT_Get(&ev))
+	{
+#if WantPerfHUD
+		PerfInputNotify(ev.TimeUS);
+#endif
+		switch (ev.Type) {
+			case ESP32INPUT_KEY:
+				DoKeyCode(ev.Code, 0 != ev.Down);
+				break;
+			case ESP32INPUT_BUTTON:
+#ifdef CONFIG_MINIVMAC_MOUSE_ABSOLUTE
+				/* the click goes where the cursor is by now */
+				HostMouseFlush();
+#endif
+				InputButtonSet(0 != ev.Down);
+				break;
+#ifdef CONFIG_MINIVMAC_MOUSE_ABSOLUTE
+			case ESP32INPUT_DELTA:
+				HostMouseSet((si5r)HostMouseH + ev.DX,
+					(si5r)HostMouseV + ev.DY, ev.TimeUS);
+				break;
+			case ESP32INPUT_POSITION:
+				HostMouseSet(ev.DX, ev.DY, ev.TimeUS);
+				break;
+#else
+			case ESP32INPUT_DELTA:
+				MyMousePositionSetDelta(ev.DX, ev.DY);
+#if WantLatencyProbe
+				LatencyMouseQueued(ev.TimeUS);
+#endif
+				break;
+			case ESP32INPUT_POSITION:
+				MyMousePositionSet(ev.DX, ev.DY);
+#if WantLatencyProbe
+				LatencyMouseQueued(ev.TimeUS);
+#endif
+				break;
+#endif
+			default:
+				break;
+		}
+	}
+#ifdef CONFIG_MINIVMAC_MOUSE_ABSOLUTE
+	HostMouseFlush();
+#endif
 
-	MyMousePositionSetDelta( dx, dy );
-	MyMouseButtonSet( ESP32API_GetMouseButton( ) );
+	/* again, in case the queue was full */
+#ifdef CONFIG_MINIVMAC_RFB
+	RFBCheckEvents(InputButton);
+#else
+	MyMouseButtonSet(InputButton);
+#endif
 
 	MouseH = CurMouseH;
 	MouseV = CurMouseV;
@@ -645,7 +1314,7 @@ LOCALFUNC ui3r HIDKeyCode2MacKeyCode(ui3r hid_code)
 	return v;
 }
 
-GLOBALPROC DoKeyCode(int key_code, blnr down)
+LOCALPROC DoKeyCode(int key_code, blnr down)
 {
 	ui3r v = HIDKeyCode2MacKeyCode(key_code);
 	if (MKC_None != v) {
@@ -653,6 +1322,145 @@ GLOBALPROC DoKeyCode(int key_code, blnr down)
 	}
 }
 
+#ifdef CONFIG_MINIVMAC_RFB
+
+/* X11 keysyms of a VNC client, for a US keyboard */
+LOCALFUNC ui3r RFBKeySym2MacKeyCode(ui5r keysym)
+{
+	ui3r v = MKC_None;
+
+	if ((keysym >= 'a') && (keysym <= 'z')) {
+		keysym -= 'a' - 'A';
+	}
+
+	switch (keysym) {
+		case 'A': v = MKC_A; break;
+		case 'B': v = MKC_B; break;
+		case 'C': v = MKC_C; break;
+		case 'D': v = MKC_D; break;
+		case 'E': v = MKC_E; break;
+		case 'F': v = MKC_F; break;
+		case 'G': v = MKC_G; break;
+		case 'H': v = MKC_H; break;
+		case 'I': v = MKC_I; break;
+		case 'J': v = MKC_J; break;
+		case 'K': v = MKC_K; break;
+		case 'L': v = MKC_L; break;
+		case 'M': v = MKC_M; break;
+		case 'N': v = MKC_N; break;
+		case 'O': v = MKC_O; break;
+		case 'P': v = MKC_P; break;
+		case 'Q': v = MKC_Q; break;
+		case 'R': v = MKC_R; break;
+		case 'S': v = MKC_S; break;
+		case 'T': v = MKC_T; break;
+		case 'U': v = MKC_U; break;
+		case 'V': v = MKC_V; break;
+		case 'W': v = MKC_W; break;
+		case 'X': v = MKC_X; break;
+		case 'Y': v = MKC_Y; break;
+		case 'Z': v = MKC_Z; break;
+
+		/* digits and what shift makes of them */
+		case '1': case '!': v = MKC_1; break;
+		case '2': case '@': v = MKC_2; break;
+		case '3': case '#': v = MKC_3; break;
+		case '4': case '$': v = MKC_4; break;
+		case '5': case '%': v = MKC_5; break;
+		case '6': case '^': v = MKC_6; break;
+		case '7': case '&': v = MKC_7; break;
+		case '8': case '*': v = MKC_8; break;
+		case '9': case '(': v = MKC_9; break;
+		case '0': case ')': v = MKC_0; break;
+
+		case '-': case '_': v = MKC_Minus; break;
+		case '=': case '+': v = MKC_Equal; break;
+		case '[': case '{': v = MKC_LeftBracket; break;
+		case ']': case '}': v = MKC_RightBracket; break;
+		case '\\': case '|': v = MKC_formac_BackSlash; break;
+		case ';': case ':': v = MKC_SemiColon; break;
+		case '\'': case '"': v = MKC_SingleQuote; break;
+		case '`': case '~': v = MKC_formac_Grave; break;
+		case ',': case '<': v = MKC_Comma; break;
+		case '.': case '>': v = MKC_Period; break;
+		case '/': case '?': v = MKC_formac_Slash; break;
+		case ' ': v = MKC_Space; break;
+
+		case 0xFF08: v = MKC_BackSpace; break;
+		case 0xFF09: v = MKC_Tab; break;
+		case 0xFF0D: v = MKC_Return; break;
+		case 0xFF1B: v = MKC_formac_Escape; break;
+		case 0xFFFF: v = MKC_formac_ForwardDel; break;
+		case 0xFF8D: v = MKC_formac_Enter; break;
+
+		case 0xFF51: v = MKC_Left; break;
+		case 0xFF52: v = MKC_Up; break;
+		case 0xFF53: v = MKC_Right; break;
+		case 0xFF54: v = MKC_Down; break;
+
+		case 0xFFE1: v = MKC_formac_Shift; break;
+		case 0xFFE2: v = MKC_formac_RShift; break;
+		case 0xFFE3: v = MKC_formac_Control; break;
+		case 0xFFE4: v = MKC_formac_RControl; break;
+		case 0xFFE5: v = MKC_formac_CapsLock; break;
+		case 0xFFE9: v = MKC_formac_Option; break;
+		case 0xFFEA: v = MKC_formac_ROption; break;
+		case 0xFFE7: case 0xFFEB: v = MKC_formac_Command; break;
+		case 0xFFE8: case 0xFFEC: v = MKC_formac_RCommand; break;
+
+		case 0xFFBE: v = MKC_formac_F1; break;
+		case 0xFFBF: v = MKC_formac_F2; break;
+		case 0xFFC0: v = MKC_formac_F3; break;
+		case 0xFFC1: v = MKC_formac_F4; break;
+		case 0xFFC2: v = MKC_formac_F5; break;
+		case 0xFFC3: v = MKC_F6; break;
+		case 0xFFC4: v = MKC_F7; break;
+		case 0xFFC5: v = MKC_F8; break;
+		case 0xFFC6: v = MKC_F9; break;
+		case 0xFFC7: v = MKC_F10; break;
+		case 0xFFC8: v = MKC_F11; break;
+		case 0xFFC9: v = MKC_F12; break;
+
+		default: break;
+	}
+
+	return v;
+}
+
+/* events of the VNC client, either mouse button holds it down */
+LOCALPROC RFBCheckEvents(blnr LocalButton)
+{
+	ESP32RFB_Event ev;
+
+	while (ESP32RFB_GetEvent(&ev)) {
+		if (ESP32RFB_EVENT_POINTER == ev.Type) {
+			ui4r h = (ev.X < vMacScreenWidth) ? ev.X
+				: vMacScreenWidth - 1;
+			ui4r v = (ev.Y < vMacScreenHeight) ? ev.Y
+				: vMacScreenHeight - 1;
+
+#ifdef CONFIG_MINIVMAC_MOUSE_ABSOLUTE
+			HostMouseSet(h, v, (ui5r)ESP32API_GetTimeUS());
+			HostMouseFlush();
+#else
+			MyMousePositionSet(h, v);
+#endif
+			RFBButton = (0 != (ev.Buttons & 1));
+			MyMouseButtonSet(LocalButton || RFBButton);
+		} else {
+			ui3r k = RFBKeySym2MacKeyCode(ev.KeySym);
+
+			if (MKC_None != k) {
+				Keyboard_UpdateKeyMap2(k, 0 != ev.Down);
+			}
+		}
+	}
+
+	MyMouseButtonSet(LocalButton || RFBButton);
+}
+
+#endif /* CONFIG_MINIVMAC_RFB */
+
 LOCALPROC DisableKeyRepeat(void)
 {
 	/*
@@ -826,6 +1634,636 @@ LOCALFUNC blnr InitLocationDat(void)
 	return trueblnr;
 }
 
+#if WantEventRecord
+
+/*
+	Recording and replay of the input, see ESP32EVT.h.
+
+	Everything the emulated machine takes from outside
+	reaches it in WaitForNextTick, which is one gap between
+	two runs of the emulator: the changes of the event queue,
+	disks inserted, the date, and the tick the next run
+	starts. Within a gap only the order of these matters.
+
+	Before a gap the emulator normally ran one tick. When it
+	ran longer (extra time, catching up) or not at all, a RUN
+	record has the cycle count it reached, and the replay has
+	ExtraTimeNotOver say yes up to exactly that count. So the
+	replay needs no real time: it does not wait, runs at the
+	speed "all out" without the automatic slow down, and
+	still does what the recording did.
+
+	Disks inserted before the first gap, from the command line
+	or diskN.dsk, are not recorded; the replay inserts its own
+	the same way. They have to be the same images as at the
+	start of the recording, as does the ROM.
+*/
+
+#define EvtRecTickCycles (130240UL * kMyClockMult)
+	/* EmCycleCount of one tick, CyclesScaledPerTick of PROGMAIN.c */
+
+LOCALVAR blnr EvtRecording = falseblnr;
+LOCALVAR blnr EvtReplaying = falseblnr;
+LOCALVAR ui5r EvtRecGap = 0;
+LOCALVAR ui5r EvtRecCycles = 0;
+	/* EmCycleCount at the last gap */
+LOCALVAR blnr EvtRecHaveTarget = falseblnr;
+LOCALVAR ui5r EvtRecTarget;
+	/* replay: EmCycleCount the run before the next gap ends at */
+LOCALVAR ui3b EvtRecSavedSpeed;
+LOCALVAR blnr EvtRecSavedNotAutoSlow;
+
+LOCALPROC EvtRecPut(ui3r kind, ui4r a, ui5r b)
+{
+	ESP32EVT_Record r;
+
+	r.Gap = EvtRecGap;
+	r.Cycles = EmCycleCount;
+	r.Kind = kind;
+	r.A = a;
+	r.B = b;
+	ESP32EVT_Put(&r);
+}
+
+LOCALPROC EvtRecQueued(ui3r kind, ui4r a, ui4r b)
+{
+	if (EvtRecording) {
+		switch (kind) {
+			case MyEvtQElKindKey:
+				EvtRecPut(ESP32EVT_KEY, a, b);
+				break;
+			case MyEvtQElKindMouseButton:
+				EvtRecPut(ESP32EVT_BUTTON, 0, b);
+				break;
+			case MyEvtQElKindMousePos:
+				EvtRecPut(ESP32EVT_POSITION, a, b);
+				break;
+			case MyEvtQElKindMouseDelta:
+				EvtRecPut(ESP32EVT_DELTA, a, b);
+				break;
+			default:
+				break;
+		}
+	}
+}
+
+LOCALPROC EvtRecDiskInserted(int i)
+{
+	if (EvtRecording && (0 != EvtRecGap)) {
+		EvtRecPut(ESP32EVT_DISK, i, 0);
+	}
+}
+
+LOCALFUNC ui5r EvtRecScreenHash(void)
+{
+#if IncludeVidMem
+	return ESP32EVT_Hash(VidMem, vMacScreenNumBytes);
+#else
+	return ESP32EVT_Hash(RAM + kMain_Buffer, vMacScreenNumBytes);
+#endif
+}
+
+LOCALPROC EvtRecNextTarget(void)
+{
+	ESP32EVT_Record r;
+
+	EvtRecHaveTarget = ESP32EVT_Peek(&r)
+		&& (ESP32EVT_RUN == r.Kind) && (EvtRecGap + 1 == r.Gap);
+	if (EvtRecHaveTarget) {
+		ESP32EVT_Skip();
+		EvtRecTarget = r.Cycles;
+	}
+}
+
+LOCALPROC EvtRecStop(void)
+{
+	ESP32EVT_Stop(EvtRecGap, EvtRecScreenHash());
+	if (EvtReplaying) {
+		/* the real time takes over again */
+		EvtReplaying = falseblnr;
+		SpeedValue = EvtRecSavedSpeed;
+		WantNotAutoSlow = EvtRecSavedNotAutoSlow;
+		StartUpTimeAdjust();
+	}
+	EvtRecording = falseblnr;
+}
+
+LOCALPROC EvtRecBegin(void)
+{
+	ESP32EVT_Record r;
+
+	EvtRecording = ESP32EVT_IsRecording();
+	EvtReplaying = ESP32EVT_IsReplaying();
+
+	if (EvtRecording) {
+		EvtRecPut(ESP32EVT_DATE, 0, CurMacDateInSeconds);
+	} else if (EvtReplaying) {
+		EvtRecSavedSpeed = SpeedValue;
+		EvtRecSavedNotAutoSlow = WantNotAutoSlow;
+		SpeedValue = (ui3b) -1;
+		WantNotAutoSlow = trueblnr;
+
+		while (ESP32EVT_Peek(&r) && (0 == r.Gap)) {
+			ESP32EVT_Skip();
+			if (ESP32EVT_DATE == r.Kind) {
+				CurMacDateInSeconds = r.B;
+				NewMacDateInSeconds = r.B;
+			}
+		}
+		EvtRecNextTarget();
+	}
+}
+
+/* called on entry to WaitForNextTick */
+LOCALPROC EvtRecGapBegin(void)
+{
+	++EvtRecGap;
+	if (EvtRecording) {
+		if ((ui5r)(EmCycleCount - EvtRecCycles) != EvtRecTickCycles) {
+			EvtRecPut(ESP32EVT_RUN, 0, 0);
+		}
+	}
+	EvtRecCycles = EmCycleCount;
+}
+
+LOCALFUNC blnr EvtRecExtraTimeNotOver(void)
+{
+	return EvtRecHaveTarget
+		&& ((si5b)(EmCycleCount - EvtRecTarget) < 0);
+}
+
+LOCALPROC EvtRecDropInput(void)
+{
+	ESP32INPUT_Event ev;
+#ifdef CONFIG_MINIVMAC_RFB
+	ESP32RFB_Event rev;
+
+	while (ESP32RFB_GetEvent(&rev)) {
+	}
+#endif
+	while (ESP32INPUT_Get(&ev)) {
+	}
+}
+
+/*
+	replay: instead of waiting for the next tick, hand over what
+	the recording has for this gap; false once the replay ended
+*/
+LOCALFUNC blnr EvtRecReplayGap(void)
+{
+	ESP32EVT_Record r;
+	ui5b NextTime = OnTrueTime + 1;
+
+	EvtRecDropInput();
+
+	while (ESP32EVT_Peek(&r) && (r.Gap == EvtRecGap)) {
+		if (ESP32EVT_END == r.Kind) {
+			/* left for ESP32EVT_Stop */
+			break;
+		}
+		ESP32EVT_Skip();
+		if (r.Cycles != EmCycleCount) {
+			ESP32EVT_Diverged(EvtRecGap);
+		}
+		switch (r.Kind) {
+			case ESP32EVT_KEY:
+				Keyboard_UpdateKeyMap(r.A, 0 != r.B);
+				break;
+			case ESP32EVT_BUTTON:
+				MyMouseButtonSet(0 != r.B);
+				break;
+			case ESP32EVT_POSITION:
+				MyMousePositionSet(r.A, r.B);
+				break;
+#if EnableFSMouseMotion
+			case ESP32EVT_DELTA:
+				MyMousePositionSetDelta(r.A, r.B);
+				break;
+#endif
+			case ESP32EVT_DISK:
+				(void) Sony_InsertIth(r.A);
+				break;
+			case ESP32EVT_DATE:
+				NewMacDateInSeconds = r.B;
+				break;
+			case ESP32EVT_TICK:
+				NextTime = r.B;
+				break;
+			default:
+				break;
+		}
+	}
+
+	if ((! ESP32EVT_Peek(&r))
+		|| ((ESP32EVT_END == r.Kind) && (r.Gap == EvtRecGap)))
+	{
+		/* the recording ends here */
+		EvtRecStop();
+		return falseblnr;
+	}
+
+	TrueEmulatedTime = NextTime;
+	EvtRecNextTarget();
+
+	return trueblnr;
+}
+
+/* recording: once the tick the next run starts is known */
+LOCALPROC EvtRecTick(void)
+{
+	if (EvtRecording && (TrueEmulatedTime != OnTrueTime + 1)) {
+		EvtRecPut(ESP32EVT_TICK, 0, TrueEmulatedTime);
+	}
+}
+
+LOCALPROC EvtRecDate(void)
+{
+	if (EvtRecording) {
+		EvtRecPut(ESP32EVT_DATE, 0, CurMacDateInSeconds);
+	}
+}
+
+#endif /* WantEventRecord */
+
+/* --- performance HUD --- */
+
+#if WantPerfHUD
+
+/*
+	Host time per part of the pipeline, counted by ESP32PERF
+	through the tick trace hooks, plus emulated speed, lag and
+	frames per second. Shown in control mode, key U, and
+	redrawn once per second while shown.
+*/
+
+LOCALVAR ui5r PerfLastCycleCount = 0;
+LOCALVAR uint64_t PerfLastTime = 0;
+LOCALVAR ui5r PerfEmKHz = 0;
+LOCALVAR si3b PerfMaxLag = 0;
+LOCALVAR si3b PerfShownLag = 0;
+LOCALVAR ui5r PerfLastDiffBytes = 0;
+LOCALVAR ui5b PerfLastTick = 0;
+LOCALVAR ui5r PerfDiffBytesPerTick = 0;
+LOCALVAR uint32_t PerfLastFrames[3];
+LOCALVAR uint32_t PerfFrames[3];
+	/* produced, consumed, dropped per second */
+#if WantScreenDiffElsewhere
+LOCALVAR uint32_t PerfLastHandoffUS = 0;
+LOCALVAR uint32_t PerfLastFindUS = 0;
+LOCALVAR uint32_t PerfHandoffUS = 0;
+LOCALVAR uint32_t PerfFindUS = 0;
+	/* per tick */
+#endif
+#ifdef CONFIG_MINIVMAC_DISPLAY_BOUNCE
+LOCALVAR uint32_t PerfLastFills = 0;
+LOCALVAR uint32_t PerfLastLateFills = 0;
+LOCALVAR uint32_t PerfFills = 0;
+LOCALVAR uint32_t PerfLateFills = 0;
+LOCALVAR uint32_t PerfMaxFillUS = 0;
+#endif
+LOCALVAR uint32_t PerfLastInput[4];
+LOCALVAR uint32_t PerfInput[4];
+	/* wake ups, packets, merged, errors; per second */
+LOCALVAR uint32_t PerfInputSumUS = 0;
+LOCALVAR uint32_t PerfInputCount = 0;
+LOCALVAR uint32_t PerfInputWorstUS = 0;
+	/* input to emulator, this second */
+LOCALVAR uint32_t PerfInputLatencyUS = 0;
+LOCALVAR uint32_t PerfInputMaxUS = 0;
+#ifdef CONFIG_MINIVMAC_DISPLAY_IDLE
+LOCALVAR uint32_t PerfLastIdleMS = 0;
+LOCALVAR uint32_t PerfLastIdleSwitches = 0;
+LOCALVAR uint32_t PerfIdlePct = 0;
+LOCALVAR uint32_t PerfIdleSwitches = 0;
+#endif
+
+LOCALPROC PerfInputNotify(ui5r TimeUS)
+{
+	ui5r us = (ui5r)ESP32API_GetTimeUS() - TimeUS;
+
+	PerfInputSumUS += us;
+	++PerfInputCount;
+	if (us > PerfInputWorstUS) {
+		PerfInputWorstUS = us;
+	}
+}
+
+LOCALPROC PerfTickNotify(void)
+{
+	if (EmLagTime > PerfMaxLag) {
+		PerfMaxLag = EmLagTime;
+	}
+}
+
+LOCALPROC PerfSecondNotify(void)
+{
+	uint64_t now = ESP32API_GetTimeUS();
+	ui5r cycles = EmCycleCount - PerfLastCycleCount;
+	ui5r us = (ui5r)(now - PerfLastTime);
+
+	if (0 != us) {
+		PerfEmKHz = (ui5r)(((uint64_t)cycles * 1000) / us);
+	}
+	PerfLastCycleCount = EmCycleCount;
+	PerfLastTime = now;
+	PerfShownLag = PerfMaxLag;
+	PerfMaxLag = 0;
+	if (OnTrueTime != PerfLastTick) {
+		PerfDiffBytesPerTick = (ScreenDiffByteCount - PerfLastDiffBytes)
+			/ (OnTrueTime - PerfLastTick);
+	}
+	PerfLastDiffBytes = ScreenDiffByteCount;
+#if WantScreenDiffElsewhere
+	{
+		uint32_t handoff;
+		uint32_t find;
+
+		ESP32API_GetDiffTimes(&handoff, &find);
+		if (OnTrueTime != PerfLastTick) {
+			PerfHandoffUS = (handoff - PerfLastHandoffUS)
+				/ (OnTrueTime - PerfLastTick);
+			PerfFindUS = (find - PerfLastFindUS)
+				/ (OnTrueTime - PerfLastTick);
+		}
+		PerfLastHandoffUS = handoff;
+		PerfLastFindUS = find;
+	}
+#endif
+	PerfLastTick = OnTrueTime;
+
+	{
+		uint32_t f[3];
+		int i;
+
+		ESP32API_GetFrameCounts(&f[0], &f[1], &f[2]);
+		for (i = 0; i < 3; ++i) {
+			PerfFrames[i] = f[i] - PerfLastFrames[i];
+			PerfLastFrames[i] = f[i];
+		}
+	}
+	{
+		uint32_t n[4];
+		int i;
+
+		ESP32API_GetInputStats(&n[0], &n[1], &n[2], &n[3]);
+		for (i = 0; i < 4; ++i) {
+			PerfInput[i] = n[i] - PerfLastInput[i];
+			PerfLastInput[i] = n[i];
+		}
+		if (0 != PerfInputCount) {
+			PerfInputLatencyUS = PerfInputSumUS / PerfInputCount;
+		}
+		PerfInputMaxUS = PerfInputWorstUS;
+		PerfInputSumUS = 0;
+		PerfInputCount = 0;
+		PerfInputWorstUS = 0;
+	}
+#ifdef CONFIG_MINIVMAC_DISPLAY_BOUNCE
+	{
+		uint32_t fills;
+		uint32_t late;
+
+		ESP32API_GetBounceStats(&fills, &late, &PerfMaxFillUS);
+		PerfFills = fills - PerfLastFills;
+		PerfLateFills = late - PerfLastLateFills;
+		PerfLastFills = fills;
+		PerfLastLateFills = late;
+	}
+#endif
+#ifdef CONFIG_MINIVMAC_DISPLAY_IDLE
+	{
+		uint32_t idle_ms;
+		uint32_t switches;
+
+		ESP32API_GetDisplayIdle(&idle_ms, &switches);
+		if (0 != us) {
+			PerfIdlePct = (uint32_t)(((uint64_t)(idle_ms - PerfLastIdleMS)
+				* 100000) / us);
+		}
+		PerfIdleSwitches = switches - PerfLastIdleSwitches;
+		PerfLastIdleMS = idle_ms;
+		PerfLastIdleSwitches = switches;
+	}
+#endif
+
+	ESP32PERF_SecondNotify();
+
+	if (SpecialModeTst(SpclModeControl)
+		&& (kCntrlMsgPerfHUD == ControlMessage))
+	{
+		NeedWholeScreenDraw = trueblnr;
+	}
+}
+
+LOCALPROC DrawCellsPerfLine(char *name, ui3r id)
+{
+	char s[48];
+	ui5r us = ESP32PERF_GetTimeUS(id);
+
+	snprintf(s, sizeof(s), "%-14s%5lu.%lu ms %3lu pct", name,
+		(unsigned long)(us / 1000),
+		(unsigned long)((us / 100) % 10),
+		(unsigned long)ESP32PERF_GetPct(id));
+	DrawCellsOneLineStr(s);
+}
+
+LOCALPROC DrawCellsPerfHUDBody(void)
+{
+	char s[48];
+
+	snprintf(s, sizeof(s), "emulated %lu.%02lu MHz, lag %d, %lu fps",
+		(unsigned long)(PerfEmKHz / 1000),
+		(unsigned long)((PerfEmKHz / 10) % 100),
+		(int)PerfShownLag,
+		(unsigned long)ESP32PERF_GetFPS());
+	DrawCellsOneLineStr(s);
+	snprintf(s, sizeof(s), "converted %lu kpixels per second",
+		(unsigned long)(ESP32PERF_GetPixels() / 1000));
+	DrawCellsOneLineStr(s);
+	snprintf(s, sizeof(s), "compared %lu screen bytes per tick",
+		(unsigned long)PerfDiffBytesPerTick);
+	DrawCellsOneLineStr(s);
+	snprintf(s, sizeof(s), "frames %lu made, %lu shown, %lu dropped",
+		(unsigned long)PerfFrames[0],
+		(unsigned long)PerfFrames[1],
+		(unsigned long)PerfFrames[2]);
+	DrawCellsOneLineStr(s);
+	snprintf(s, sizeof(s), "input %lu wakes, %lu pkts, %lu merged",
+		(unsigned long)PerfInput[0],
+		(unsigned long)PerfInput[1],
+		(unsigned long)PerfInput[2]);
+	DrawCellsOneLineStr(s);
+	snprintf(s, sizeof(s), "input to emu %lu us, max %lu, %lu errors",
+		(unsigned long)PerfInputLatencyUS,
+		(unsigned long)PerfInputMaxUS,
+		(unsigned long)PerfInput[3]);
+	DrawCellsOneLineStr(s);
+#if WantScreenDiffElsewhere
+	/*
+		what the emulator core would spend looking for the
+		changes, less handing the screen over
+	*/
+	snprintf(s, sizeof(s), "core 0 saves %ld us/tick, handoff %lu us",
+		(long)PerfFindUS - (long)PerfHandoffUS,
+		(unsigned long)PerfHandoffUS);
+	DrawCellsOneLineStr(s);
+#endif
+#ifdef CONFIG_MINIVMAC_DISPLAY_BOUNCE
+	snprintf(s, sizeof(s), "scanout %lu fills, %lu late, max %lu us",
+		(unsigned long)PerfFills,
+		(unsigned long)PerfLateFills,
+		(unsigned long)PerfMaxFillUS);
+	DrawCellsOneLineStr(s);
+#endif
+#ifdef CONFIG_MINIVMAC_DISPLAY_IDLE
+	snprintf(s, sizeof(s), "panel slowed %lu pct, %lu times",
+		(unsigned long)PerfIdlePct,
+		(unsigned long)PerfIdleSwitches);
+	DrawCellsOneLineStr(s);
+#endif
+	DrawCellsBlankLine();
+	snprintf(s, sizeof(s), "host time per second, %lu nested:",
+		(unsigned long)ESP32PERF_GetNested());
+	DrawCellsOneLineStr(s);
+	DrawCellsPerfLine("68k cpu", kTickTraceCPU);
+	DrawCellsPerfLine("ict tasks", kTickTraceICT);
+	DrawCellsPerfLine("devices", kTickTraceDevices);
+	DrawCellsPerfLine("disk io", TRACE_DISK_IO);
+	DrawCellsPerfLine("screen diff", TRACE_SCREEN_DIFF);
+#if WantScreenDiffElsewhere
+	DrawCellsPerfLine("display diff", TRACE_DISPLAY_DIFF);
+#endif
+#ifdef CONFIG_MINIVMAC_RECORD
+	DrawCellsPerfLine("screen record", TRACE_SCREEN_RECORD);
+#endif
+	DrawCellsPerfLine("1bpp convert", TRACE_DISPLAY_CONVERT);
+	DrawCellsPerfLine("lvgl refresh", TRACE_DISPLAY_REFRESH);
+}
+
+#endif /* WantPerfHUD */
+
+/* --- input latency --- */
+
+#if WantLatencyProbe
+
+LOCALPROC LatencyDump(void)
+{
+	ESP32LAT_RequestDump();
+}
+
+LOCALPROC LatencySecondNotify(void)
+{
+	if (SpecialModeTst(SpclModeControl)
+		&& (kCntrlMsgLatency == ControlMessage))
+	{
+		NeedWholeScreenDraw = trueblnr;
+	}
+}
+
+/* tenths of a millisecond, up to 999.9 */
+LOCALPROC LatencyFormatMS(char *s, size_t n, ui5r us)
+{
+	if (us > 999900) {
+		us = 999900;
+	}
+	snprintf(s, n, "%3lu.%lu", (unsigned long)(us / 1000),
+		(unsigned long)((us / 100) % 10));
+}
+
+LOCALPROC DrawCellsLatencyBody(void)
+{
+	char s[64];
+	char mean[8];
+	char max[8];
+	ESP32LAT_Hist h;
+	int i;
+	int b;
+	int n;
+
+	snprintf(s, sizeof(s), "mouse moves followed, ms, %lu given up:",
+		(unsigned long)ESP32LAT_GetLost());
+	DrawCellsOneLineStr(s);
+	DrawCellsOneLineStr("stage      count    mean     max");
+	for (i = 0; i < ESP32LAT_NUM_STAGES; ++i) {
+		ESP32LAT_GetHist(i, &h);
+		LatencyFormatMS(mean, sizeof(mean),
+			h.Count ? (ui5r)(h.SumUS / h.Count) : 0);
+		LatencyFormatMS(max, sizeof(max), h.MaxUS);
+		snprintf(s, sizeof(s), "%-8s %7lu   %s   %s",
+			ESP32LAT_StageName(i), (unsigned long)h.Count, mean, max);
+		DrawCellsOneLineStr(s);
+	}
+	DrawCellsBlankLine();
+
+	/* pct of each stage below 1/8, 1/4 ... 128 ms, and above */
+	DrawCellsOneLineStr(
+		"below ms .12 .25  .5   1   2   4   8  16  32  64 128 more");
+	for (i = 0; i < ESP32LAT_NUM_STAGES; ++i) {
+		ESP32LAT_GetHist(i, &h);
+		n = snprintf(s, sizeof(s), "%-8s", ESP32LAT_StageName(i));
+		for (b = 0; b < ESP32LAT_BUCKETS; ++b) {
+			n += snprintf(s + n, sizeof(s) - n, " %3lu",
+				(unsigned long)(h.Count
+					? (ui5r)(((uint64_t)h.Buckets[b] * 100) / h.Count)
+					: 0));
+		}
+		DrawCellsOneLineStr(s);
+	}
+}
+
+#endif /* WantLatencyProbe */
+
+/* --- power management --- */
+
+#if WantPowerManager
+
+/*
+	The emulator task holds ESP32POWER's CPU_FREQ_MAX lock
+	only while it has work to do. It is dropped while waiting
+	for the next tick, while stopped, and for whole ticks once
+	the guest has been idle for kPowerIdleTicks ticks in a row.
+	Deciding on the last tick alone would let a tick that just
+	fits at full speed run slowly, fall behind, take the lock
+	again and so on. Input at the start of a tick ends
+	QuietTime, and a lagging emulation is never idle, so full
+	speed is back within one tick once work appears.
+*/
+
+#define kPowerStoppedWaitMS 16
+#define kPowerIdleTicks 8
+
+LOCALVAR ui3r PowerIdleTicks = 0;
+
+LOCALPROC PowerTickBegin(void)
+{
+	if ((0 != EmLagTime) || ! GuestIsIdle()) {
+		PowerIdleTicks = 0;
+	} else if (PowerIdleTicks < kPowerIdleTicks) {
+		++PowerIdleTicks;
+	}
+
+	ESP32POWER_SetEmulatorBusy(PowerIdleTicks < kPowerIdleTicks);
+}
+
+LOCALPROC PowerWaitForTickTime(void)
+{
+	si5b TimeDiff = NextIntTime - LastTime;
+
+	ESP32POWER_SetEmulatorBusy(falseblnr);
+
+	/*
+		block instead of spinning, so the idle task runs, but
+		wake up a millisecond early to start the tick on time
+	*/
+	if (TimeDiff > 1) {
+		ESP32POWER_Delay(TimeDiff - 1);
+	} else {
+		ESP32API_Yield();
+	}
+}
+
+#endif /* WantPowerManager */
+
 /* --- sound --- */
 
 #if MySoundEnabled
@@ -1382,6 +2820,34 @@ LOCALFUNC blnr Screen_Init(void)
 
 	InitKeyCodes();
 
+#ifdef CONFIG_MINIVMAC_RECORD_FILE
+	if (! ESP32REC_Start(ESP32API_open(CONFIG_MINIVMAC_RECORD_FILE, "wb"),
+		vMacScreenWidth, vMacScreenHeight))
+	{
+		ESP_LOGE(TAG, "could not record to %s",
+			CONFIG_MINIVMAC_RECORD_FILE);
+	}
+#endif
+#ifdef CONFIG_MINIVMAC_EVENTS_RECORD
+	if (! ESP32EVT_StartRecord(ESP32API_open(CONFIG_MINIVMAC_EVENTS_FILE, "wb"),
+		vMacScreenWidth, vMacScreenHeight))
+	{
+		ESP_LOGE(TAG, "could not record the input to %s",
+			CONFIG_MINIVMAC_EVENTS_FILE);
+	}
+#endif
+#ifdef CONFIG_MINIVMAC_EVENTS_REPLAY
+	if (! ESP32EVT_StartReplay(ESP32API_open(CONFIG_MINIVMAC_EVENTS_FILE, "rb"),
+		vMacScreenWidth, vMacScreenHeight))
+	{
+		ESP_LOGE(TAG, "could not replay the input of %s",
+			CONFIG_MINIVMAC_EVENTS_FILE);
+	}
+#endif
+#if WantEventRecord
+	EvtRecBegin();
+#endif
+
 	return trueblnr;
 }
 
@@ -1545,9 +3011,32 @@ LOCALPROC CheckForSavedTasks(void)
 
 LOCALPROC WaitForTheNextEvent(void)
 {
+#if WantPowerManager
+	ESP32POWER_SetEmulatorBusy(falseblnr);
+	ESP32POWER_Delay(kPowerStoppedWaitMS);
+#else
 	ESP32API_Yield();
+#endif
 }
 
+#if 0 != vMacScreenDepth
+LOCALVAR blnr ColorModeShown = falseblnr;
+
+/*
+	ColorTransValid is cleared by ScreenFindChanges when the
+	palette changes, which also marks the whole screen changed.
+*/
+LOCALPROC CheckScreenColors(void)
+{
+	if ((! ColorTransValid) || (UseColorMode != ColorModeShown)) {
+		ColorTransValid = trueblnr;
+		ColorModeShown = UseColorMode;
+		ESP32API_SetScreenColors(UseColorMode ? vMacScreenDepth : 0,
+			CLUT_reds, CLUT_greens, CLUT_blues);
+	}
+}
+#endif
+
 LOCALPROC CheckForSystemEvents(void)
 {
 	/*
@@ -1557,7 +3046,23 @@ LOCALPROC CheckForSystemEvents(void)
 		are waiting, don't wait for more.
 	*/
 	ESP32API_CheckForEvents();
-	ESP32API_DrawScreen(GetCurDrawBuff());
+#if WantScreenDiffElsewhere
+	if (! ScreenDiffHere) {
+		/* handed over at the end of the tick */
+		return;
+	}
+#endif
+	{
+		ui3p p = GetCurDrawBuff();
+
+#if 0 != vMacScreenDepth
+		CheckScreenColors();
+#endif
+#ifdef CONFIG_MINIVMAC_RFB
+		RFBScreenPublish(p);
+#endif
+		ESP32API_DrawScreen(p);
+	}
 }
 
 /*
@@ -1576,17 +3081,40 @@ LOCALPROC CheckForSystemEvents(void)
 
 GLOBALOSGLUFUNC blnr ExtraTimeNotOver(void)
 {
+#if WantEventRecord
+	if (EvtReplaying) {
+		return EvtRecExtraTimeNotOver();
+	}
+#endif
 	UpdateTrueEmulatedTime();
-	return TrueEmulatedTime == OnTrueTime;
+	return (TrueEmulatedTime == OnTrueTime)
+#if WantSpeedGovernor
+		&& GovExtraTimeNotOver()
+#endif
+		;
 }
 
 GLOBALOSGLUPROC WaitForNextTick(void)
 {
+#if WantSpeedGovernor
+	GovTickEnd();
+#endif
+	TRACE_BEGIN(TRACE_WAIT_TICK);
+#if WantEventRecord
+	EvtRecGapBegin();
+#endif
+
 label_retry:
 	CheckForSystemEvents();
 	CheckForSavedTasks();
 
 	if (ForceMacOff) {
+#if WantEventRecord
+		if (EvtRecording || EvtReplaying) {
+			EvtRecStop();
+		}
+#endif
+		TRACE_END(TRACE_WAIT_TICK);
 		return;
 	}
 
@@ -1600,23 +3128,53 @@ label_retry:
 	++TrueEmulatedTime;
 #endif
 
+#if WantEventRecord
+	if (EvtReplaying && EvtRecReplayGap()) {
+		/* no waiting, the tick is the one of the recording */
+	} else
+#endif
 	if (ExtraTimeNotOver()) {
+#if WantPowerManager
+		PowerWaitForTickTime();
+#else
 		ESP32API_Yield( );
+#endif
 		goto label_retry;
 	}
+#if WantEventRecord
+	EvtRecTick();
+#endif
 
 	if (CheckDateTime()) {
+#if WantEventRecord
+		EvtRecDate();
+#endif
 #if MySoundEnabled
 		MySound_SecondNotify();
 #endif
 #if EnableDemoMsg
 		DemoModeSecondNotify();
+#endif
+#if WantSpeedGovernor
+		GovSecondNotify();
+#endif
+#if WantPowerManager
+		ESP32POWER_SecondNotify();
+#endif
+#if WantPerfHUD
+		PerfSecondNotify();
+#endif
+#if WantLatencyProbe
+		LatencySecondNotify();
 #endif
 	}
 
 	if ((! gBackgroundFlag)
 #if UseMotionEvents
 		&& (! CaughtMouse)
+#endif
+#if WantEventRecord
+		&& (! EvtReplaying)
 #endif
 		)
 	{
@@ -1625,6 +3183,18 @@ label_retry:
 
 	OnTrueTime = TrueEmulatedTime;
 
+	TRACE_END(TRACE_WAIT_TICK);
+
+#if WantSpeedGovernor
+	GovTickBegin();
+#endif
+#if WantPowerManager
+	PowerTickBegin();
+#endif
+#if WantPerfHUD
+	PerfTickNotify();
+#endif
+
 #if dbglog_TimeStuff
 	dbglog_writelnNum("WaitForNextTick, OnTrueTime", OnTrueTime);
 #endif
@@ -1750,6 +3320,9 @@ LOCALPROC UnInitOSGLU(void)
 	UnInitPbufs();
 #endif
 	UnInitDrives();
+#ifdef CONFIG_MINIVMAC_RECORD
+	ESP32REC_Stop();
+#endif
 
 	ForceShowCursor();
 